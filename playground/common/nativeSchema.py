@@ -0,0 +1,50 @@
+import json
+
+import numpy as np
+
+
+# Builds numpy dtypes from the layout descriptors emitted by
+# schema::describe() / schema::catalog() on the C++ side, so records read out
+# of shared memory can be viewed with np.frombuffer instead of unpickled.
+
+def _fieldDtype(field):
+    if "dtype" in field:
+        base = np.dtype(field["dtype"])
+    else:
+        base = _structDtype(field["fields"], field["itemsize"])
+    count = field.get("count", 1)
+    return base if count == 1 else np.dtype((base, (count,)))
+
+
+def _structDtype(fields, itemsize):
+    return np.dtype({
+        "names": [f["name"] for f in fields],
+        "formats": [_fieldDtype(f) for f in fields],
+        "offsets": [f["offset"] for f in fields],
+        "itemsize": itemsize,
+    })
+
+
+def dtypeFor(descriptor):
+    if isinstance(descriptor, str):
+        descriptor = json.loads(descriptor)
+    return _structDtype(descriptor["fields"], descriptor["itemsize"])
+
+
+def loadCatalog(text):
+    # Returns {schema id: (name, version, dtype)}.
+    out = {}
+    for d in json.loads(text):
+        out[d["id"]] = (d["name"], d["version"], dtypeFor(d))
+    return out
+
+
+def view(dtype, buffer):
+    # Zero-copy view of one record. Variable-length messages (detection
+    # lists) arrive shorter than the full struct; those are copied into a
+    # zero-filled buffer first.
+    if len(buffer) < dtype.itemsize:
+        padded = bytearray(dtype.itemsize)
+        padded[:len(buffer)] = buffer
+        buffer = padded
+    return np.frombuffer(buffer, dtype=dtype, count=1)[0]
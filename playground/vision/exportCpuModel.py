@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+# exportCpuModel.py
+# ================================================================
+# Converts a YOLOv5 ONNX export into the RBNN file the native CPU
+# engine (src/infer/cpu.h) loads.
+#
+#   python export.py --weights yolov5n.pt --include onnx   (ultralytics repo)
+#   python exportCpuModel.py yolov5n.onnx yolov5n.rbnn
+#
+# Batch norm is already folded into the convolutions by the ONNX export.
+# Weights are quantized to int8 per output channel; activations are
+# quantized at run time, so no calibration images are needed. The graph
+# is cut at the three Detect convolutions: decoding happens natively.
+# ================================================================
+import argparse
+import struct
+import sys
+from collections import defaultdict
+
+import numpy as np
+import onnx
+from onnx import numpy_helper
+
+OP_CONV, OP_ADD, OP_CONCAT, OP_UPSAMPLE, OP_MAXPOOL = range(5)
+ACT_NONE, ACT_SILU = 0, 1
+
+
+def attrs(node):
+    return {a.name: onnx.helper.get_attribute_value(a) for a in node.attribute}
+
+
+def quantize(w):
+    """Per-output-channel symmetric int8; returns (cout, kh, kw, cin) weights and scales."""
+    cout = w.shape[0]
+    scale = np.abs(w.reshape(cout, -1)).max(axis=1) / 127.0
+    scale[scale == 0] = 1.0
+    q = np.clip(np.round(w / scale[:, None, None, None]), -127, 127).astype(np.int8)
+    return q.transpose(0, 2, 3, 1), scale.astype(np.float32)
+
+
+class Exporter:
+    def __init__(self, graph):
+        self.graph = graph
+        self.init = {t.name: numpy_helper.to_array(t) for t in graph.initializer}
+        for n in graph.node:
+            if n.op_type == "Constant":
+                self.init[n.output[0]] = numpy_helper.to_array(attrs(n)["value"])
+        self.producer = {}
+        self.consumers = defaultdict(list)
+        for n in graph.node:
+            for o in n.output:
+                self.producer[o] = n
+            for i in n.input:
+                self.consumers[i].append(n)
+
+        dims = [d.dim_value for d in graph.input[0].type.tensor_type.shape.dim]
+        if len(dims) != 4 or dims[1] != 3:
+            sys.exit(f"expected a 1x3xHxW input, got {dims}")
+        self.shapes = [(dims[2], dims[3], 3)]
+        self.ids = {graph.input[0].name: 0}
+        self.nodes = []
+
+    def tensor(self, h, w, c):
+        self.shapes.append((h, w, c))
+        return len(self.shapes) - 1
+
+    def heads(self):
+        found = [n.output[0] for n in self.graph.node
+                 if n.op_type == "Conv" and any(c.op_type == "Reshape" for c in self.consumers[n.output[0]])]
+        if len(found) != 3:
+            sys.exit(f"expected 3 Detect convolutions, found {len(found)}")
+        return found
+
+    def needed(self, heads):
+        seen, stack = set(), list(heads)
+        while stack:
+            t = stack.pop()
+            if t in seen or t not in self.producer:
+                continue
+            seen.add(t)
+            stack.extend(i for i in self.producer[t].input if i and i not in self.init)
+        return seen
+
+    def conv(self, n):
+        a = attrs(n)
+        if a.get("group", 1) != 1 or any(d != 1 for d in a.get("dilations", [1, 1])):
+            sys.exit(f"{n.name}: grouped or dilated convolution")
+        kh, kw = a["kernel_shape"]
+        sh, sw = a.get("strides", [1, 1])
+        pads = a.get("pads", [0, 0, 0, 0])
+        if kh != kw or sh != sw or len(set(pads)) != 1:
+            sys.exit(f"{n.name}: only square kernels with symmetric padding")
+        w = self.init[n.input[1]]
+        b = self.init[n.input[2]] if len(n.input) > 2 else np.zeros(w.shape[0], np.float32)
+        src = self.ids[n.input[0]]
+        h, wd, _ = self.shapes[src]
+        k, s, p = kh, sh, pads[0]
+        out = self.tensor((h + 2 * p - k) // s + 1, (wd + 2 * p - k) // s + 1, w.shape[0])
+        q, scale = quantize(w)
+        self.nodes.append(dict(op=OP_CONV, act=ACT_NONE, inputs=[src], output=out, params=(k, s, p),
+                               scale=scale, bias=b.astype(np.float32), weights=q))
+        self.ids[n.output[0]] = out
+
+    def silu(self, n):
+        # Mul(x, Sigmoid(x)) after a convolution becomes its activation.
+        x, sig = n.input
+        if self.producer.get(sig) is None or self.producer[sig].op_type != "Sigmoid":
+            x, sig = sig, x
+        last = self.nodes[-1] if self.nodes else None
+        if (self.producer.get(sig) is None or self.producer[sig].input[0] != x
+                or last is None or last["op"] != OP_CONV or last["output"] != self.ids.get(x)):
+            sys.exit(f"{n.name}: Mul is not a SiLU following a convolution")
+        last["act"] = ACT_SILU
+        self.ids[n.output[0]] = last["output"]
+
+    def simple(self, n, op, inputs, shape, params=None):
+        out = self.tensor(*shape)
+        self.nodes.append(dict(op=op, act=ACT_NONE, inputs=inputs, output=out, params=params))
+        self.ids[n.output[0]] = out
+
+    def run(self):
+        heads = self.heads()
+        needed = self.needed(heads)
+        for n in self.graph.node:
+            if n.output[0] not in needed:
+                continue
+            t = n.op_type
+            if t == "Conv":
+                self.conv(n)
+            elif t == "Sigmoid":
+                continue
+            elif t == "Mul":
+                self.silu(n)
+            elif t == "Add":
+                a, b = (self.ids[i] for i in n.input)
+                self.simple(n, OP_ADD, [a, b], self.shapes[a])
+            elif t == "Concat":
+                if attrs(n).get("axis") != 1:
+                    sys.exit(f"{n.name}: concat must be over channels")
+                ins = [self.ids[i] for i in n.input]
+                h, w, _ = self.shapes[ins[0]]
+                self.simple(n, OP_CONCAT, ins, (h, w, sum(self.shapes[i][2] for i in ins)))
+            elif t == "MaxPool":
+                a = attrs(n)
+                k, s, p = a["kernel_shape"][0], a.get("strides", [1, 1])[0], a.get("pads", [0])[0]
+                src = self.ids[n.input[0]]
+                h, w, c = self.shapes[src]
+                self.simple(n, OP_MAXPOOL, [src], ((h + 2 * p - k) // s + 1, (w + 2 * p - k) // s + 1, c), (k, s, p))
+            elif t in ("Resize", "Upsample"):
+                src = self.ids[n.input[0]]
+                h, w, c = self.shapes[src]
+                scales = self.init.get(n.input[2] if t == "Resize" and len(n.input) > 2 else n.input[-1])
+                if scales is not None and scales.size == 4:
+                    f = int(scales[2])
+                else:
+                    sizes = self.init[n.input[3]]
+                    f = int(sizes[2]) // h
+                self.simple(n, OP_UPSAMPLE, [src], (h * f, w * f, c))
+            else:
+                sys.exit(f"{n.name}: unsupported op {t}")
+        return [self.ids[h] for h in heads]
+
+    def write(self, path, outputs):
+        with open(path, "wb") as f:
+            f.write(b"RBNN" + struct.pack("<I", 1))
+            f.write(struct.pack("<I", len(self.shapes)))
+            for s in self.shapes:
+                f.write(struct.pack("<3I", *s))
+            f.write(struct.pack("<I", len(self.nodes)))
+            for n in self.nodes:
+                f.write(struct.pack("<BBHI", n["op"], n["act"], 0, len(n["inputs"])))
+                f.write(struct.pack(f"<{len(n['inputs'])}I", *n["inputs"]))
+                f.write(struct.pack("<I", n["output"]))
+                if n["op"] in (OP_CONV, OP_MAXPOOL):
+                    f.write(struct.pack("<3I", *n["params"]))
+                if n["op"] == OP_CONV:
+                    f.write(n["scale"].astype("<f4").tobytes())
+                    f.write(n["bias"].astype("<f4").tobytes())
+                    f.write(n["weights"].tobytes())
+            f.write(struct.pack("<I", len(outputs)))
+            f.write(struct.pack(f"<{len(outputs)}I", *outputs))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="YOLOv5 ONNX -> RBNN for the native CPU engine")
+    parser.add_argument("onnx")
+    parser.add_argument("output")
+    args = parser.parse_args()
+
+    e = Exporter(onnx.load(args.onnx).graph)
+    outputs = e.run()
+    e.write(args.output, outputs)
+    convs = sum(1 for n in e.nodes if n["op"] == OP_CONV)
+    print(f"✓ {len(e.nodes)} nodes ({convs} conv), {len(e.shapes)} tensors -> {args.output}")
+
+
+if __name__ == "__main__":
+    main()
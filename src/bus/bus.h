@@ -0,0 +1,490 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <typeindex>
+#include <utility>
+#include <vector>
+
+#include "bus/conflate.h"
+#include "dispatch/dispatch.h"
+
+namespace bus {
+
+enum class delivery {
+    latest,         // keep only the newest message (conflating); never blocks
+    drop_oldest,    // bounded FIFO; the oldest queued message is dropped when full
+    drop_newest,    // bounded FIFO; the incoming message is dropped when full
+    blocking,       // bounded FIFO; the publisher waits up to timeout, then drops
+    credit          // at most depth messages unacknowledged; see mailbox::grant()
+};
+
+struct policy {
+    delivery                    mode    = delivery::drop_oldest;
+    size_t                      depth   = 8;
+    std::chrono::milliseconds   timeout = std::chrono::milliseconds(20);   // blocking only
+};
+
+// Flow-control counters. A stall is a publish that had to wait for room;
+// stalled is the total time publishers spent waiting.
+struct flow_stats {
+    uint64_t                    delivered = 0;
+    uint64_t                    dropped   = 0;
+    uint64_t                    stalls    = 0;
+    std::chrono::nanoseconds    stalled{0};
+
+    flow_stats& operator+=(const flow_stats& o) {
+        delivered += o.delivered;
+        dropped   += o.dropped;
+        stalls    += o.stalls;
+        stalled   += o.stalled;
+        return *this;
+    }
+};
+
+struct channel_stats {
+    std::string name;
+    uint64_t    published   = 0;
+    size_t      subscribers = 0;
+    flow_stats  flow;
+};
+
+template<typename T>
+using message = std::shared_ptr<const T>;
+
+// One subscriber's inbox. Consumers either pull (pop/try_pop) or let the
+// mailbox drain itself into a handler on a dispatch pool, one message at a
+// time, so handlers never run concurrently with themselves. The latest policy
+// goes through a triple buffer instead of the queue, so the publisher never
+// takes the mailbox lock and the consumer always sees the freshest message.
+// Only the blocking policy ever makes a publisher wait, and then only for
+// policy.timeout.
+template<typename T>
+class mailbox : public std::enable_shared_from_this<mailbox<T>> {
+public:
+    using handler_t = std::function<void(const message<T>&)>;
+
+    static constexpr size_t batch = 32;
+
+    explicit mailbox(policy p) : policy_(p) {
+        if (policy_.mode == delivery::latest) policy_.depth = 1;
+        if (policy_.depth == 0) policy_.depth = 1;
+        credits_ = policy_.depth;
+    }
+
+    void attach(dispatch::dispatch& pool, handler_t h) {
+        pool_    = &pool;
+        handler_ = std::move(h);
+    }
+
+    void deliver(const message<T>& m) {
+        if (policy_.mode == delivery::latest) {
+            if (closed_.load(std::memory_order_acquire)) return;
+            // The triple buffer has a single producer side. One publisher
+            // never waits here; several serialize on producer_, which is held
+            // for one slot store and one index exchange (the displaced
+            // message is released after it), and yield to a preempted holder.
+            message<T> stale;
+            acquire(producer_);
+            bool overwrote = latest_.write(m, stale);
+            producer_.clear(std::memory_order_release);
+            if (overwrote) dropped_.fetch_add(1, std::memory_order_relaxed);
+            delivered_.fetch_add(1, std::memory_order_relaxed);
+            ready_.notify_one();
+            if (handler_ && !draining_.exchange(true, std::memory_order_acq_rel)) schedule();
+            return;
+        }
+
+        bool claim = false;
+        {
+            std::unique_lock<std::mutex> lock(m_);
+            if (closed_) return;
+            if (policy_.mode == delivery::credit) {
+                if (credits_ == 0) {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                --credits_;
+            } else if (q_.size() >= policy_.depth) {
+                switch (policy_.mode) {
+                case delivery::drop_newest:
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                case delivery::blocking: {
+                    auto start = std::chrono::steady_clock::now();
+                    bool room = space_.wait_for(lock, policy_.timeout, [this] { return q_.size() < policy_.depth || closed_; });
+                    stalls_.fetch_add(1, std::memory_order_relaxed);
+                    stalled_ns_.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count()), std::memory_order_relaxed);
+                    if (closed_) return;
+                    if (!room) {
+                        dropped_.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                    }
+                    break;
+                }
+                default:
+                    q_.pop_front();
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            q_.push_back(m);
+            delivered_.fetch_add(1, std::memory_order_relaxed);
+            claim = handler_ && !draining_.exchange(true, std::memory_order_acq_rel);
+        }
+        ready_.notify_one();
+        if (claim) schedule();
+    }
+
+    message<T> try_pop() {
+        if (policy_.mode == delivery::latest) return take_latest();
+        std::lock_guard<std::mutex> lock(m_);
+        return take();
+    }
+
+    // Waits for a message; returns null once closed or cancelled.
+    message<T> pop(const dispatch::cancel_token& tok, std::chrono::milliseconds poll = std::chrono::milliseconds(50)) {
+        if (policy_.mode == delivery::latest) {
+            for (;;) {
+                if (message<T> m = take_latest()) return m;
+                std::unique_lock<std::mutex> lock(m_);
+                if (closed_ || tok.cancelled()) return nullptr;
+                ready_.wait_for(lock, poll);
+            }
+        }
+        std::unique_lock<std::mutex> lock(m_);
+        while (q_.empty() && !closed_ && !tok.cancelled()) {
+            ready_.wait_for(lock, poll);
+        }
+        return take();
+    }
+
+    // Waits up to timeout for a message; null on timeout or once closed. For
+    // callers without a cancel token (foreign threads, bindings).
+    message<T> pop_for(std::chrono::milliseconds timeout) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        if (policy_.mode == delivery::latest) {
+            // The triple buffer is written without the lock, so wait in
+            // short slices rather than trust a single wakeup.
+            for (;;) {
+                if (message<T> m = take_latest()) return m;
+                std::unique_lock<std::mutex> lock(m_);
+                auto now = std::chrono::steady_clock::now();
+                if (closed_ || now >= deadline) return nullptr;
+                ready_.wait_until(lock, std::min(deadline, now + std::chrono::milliseconds(5)));
+            }
+        }
+        std::unique_lock<std::mutex> lock(m_);
+        ready_.wait_until(lock, deadline, [this] { return !q_.empty() || closed_; });
+        return take();
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            closed_ = true;
+        }
+        ready_.notify_all();
+        space_.notify_all();
+    }
+
+    // Credit policy: returns n credits once messages are fully processed.
+    // Push subscribers return theirs automatically after each handler call.
+    void grant(size_t n = 1) {
+        std::lock_guard<std::mutex> lock(m_);
+        credits_ = std::min(credits_ + n, policy_.depth);
+    }
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    flow_stats stats() const {
+        flow_stats s;
+        s.delivered = delivered_.load(std::memory_order_relaxed);
+        s.dropped   = dropped_.load(std::memory_order_relaxed);
+        s.stalls    = stalls_.load(std::memory_order_relaxed);
+        s.stalled   = std::chrono::nanoseconds(stalled_ns_.load(std::memory_order_relaxed));
+        return s;
+    }
+
+    const policy& flow() const { return policy_; }
+
+private:
+    message<T> take() {
+        if (q_.empty()) return nullptr;
+        message<T> m = std::move(q_.front());
+        q_.pop_front();
+        space_.notify_one();
+        return m;
+    }
+
+    static void acquire(std::atomic_flag& f) {
+        for (unsigned spins = 0; f.test_and_set(std::memory_order_acquire); ++spins) {
+            if (spins >= 64) std::this_thread::yield();
+        }
+    }
+
+    message<T> take_latest() {
+        acquire(consumer_);
+        message<T> m;
+        if (latest_.update()) m = std::move(latest_.read());
+        consumer_.clear(std::memory_order_release);
+        return m;
+    }
+
+    bool pending() {
+        if (policy_.mode == delivery::latest) return latest_.pending();
+        std::lock_guard<std::mutex> lock(m_);
+        return !q_.empty();
+    }
+
+    void schedule() {
+        try {
+            pool_->post([self = this->shared_from_this()] { self->drain(); });
+        } catch (const std::logic_error&) {
+            // Pool already shut down; messages stay queued for pull.
+            draining_.store(false, std::memory_order_release);
+        }
+    }
+
+    void drain() {
+        for (size_t n = 0; n < batch; ++n) {
+            message<T> m = try_pop();
+            if (!m) {
+                draining_.store(false, std::memory_order_release);
+                // A message may have landed between the empty pop and the
+                // release; take the drain back if nobody else has.
+                if (pending() && !draining_.exchange(true, std::memory_order_acq_rel)) schedule();
+                return;
+            }
+            handler_(m);
+            if (policy_.mode == delivery::credit) grant();
+        }
+        schedule();
+    }
+
+    policy                  policy_;
+    dispatch::dispatch*     pool_ = nullptr;
+    handler_t               handler_;
+
+    triple_buffer<message<T>>   latest_;
+    std::atomic_flag            producer_ = ATOMIC_FLAG_INIT;
+    std::atomic_flag            consumer_ = ATOMIC_FLAG_INIT;
+
+    mutable std::mutex          m_;
+    std::condition_variable     ready_;
+    std::condition_variable     space_;
+    std::deque<message<T>>      q_;
+    size_t                      credits_ = 0;
+    std::atomic<uint64_t>       delivered_{0};
+    std::atomic<uint64_t>       dropped_{0};
+    std::atomic<uint64_t>       stalls_{0};
+    std::atomic<uint64_t>       stalled_ns_{0};
+    std::atomic<bool>           draining_{false};
+    std::atomic<bool>           closed_{false};   // written under m_
+};
+
+class channel_base {
+public:
+    channel_base(std::string name, uint16_t id, std::type_index type)
+        : name_(std::move(name)), id_(id), type_(type) {}
+
+    virtual ~channel_base() = default;
+
+    const std::string&  name() const { return name_; }
+    uint16_t            id()   const { return id_; }
+    std::type_index     type() const { return type_; }
+
+    virtual channel_stats stats() const = 0;
+
+private:
+    std::string     name_;
+    uint16_t        id_;
+    std::type_index type_;
+};
+
+// A typed topic. publish() hands every subscriber the same refcounted
+// payload; nothing is copied or serialized per subscriber. Subscriptions
+// that do not name a policy get the channel's.
+template<typename T>
+class channel : public channel_base {
+public:
+    using subscribers = std::vector<std::shared_ptr<mailbox<T>>>;
+
+    channel(std::string name, uint16_t id, policy p = {})
+        : channel_base(std::move(name), id, typeid(T)), policy_(p), subs_(std::make_shared<const subscribers>()),
+          taps_(std::make_shared<const taps>()) {}
+
+    ~channel() override {
+        for (auto& s : *std::atomic_load(&subs_)) s->close();
+    }
+
+    using tap_t = std::function<void(const T&)>;
+
+    void publish(message<T> m) {
+        if (has_tap_.load(std::memory_order_acquire)) {
+            auto t = std::atomic_load(&taps_);
+            for (auto& entry : *t) entry.second(*m);
+        }
+        auto subs = std::atomic_load(&subs_);
+        for (auto& s : *subs) s->deliver(m);
+        published_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void publish(T value) { publish(std::make_shared<const T>(std::move(value))); }
+
+    // Pull-style subscription.
+    std::shared_ptr<mailbox<T>> subscribe() { return subscribe(policy_); }
+
+    std::shared_ptr<mailbox<T>> subscribe(policy p) {
+        auto box = std::make_shared<mailbox<T>>(p);
+        add(box);
+        return box;
+    }
+
+    // Push-style subscription: handler runs on pool, serialized per subscriber.
+    std::shared_ptr<mailbox<T>> subscribe(dispatch::dispatch& pool, typename mailbox<T>::handler_t h) {
+        return subscribe(pool, std::move(h), policy_);
+    }
+
+    std::shared_ptr<mailbox<T>> subscribe(dispatch::dispatch& pool, typename mailbox<T>::handler_t h, policy p) {
+        auto box = std::make_shared<mailbox<T>>(p);
+        box->attach(pool, std::move(h));
+        add(box);
+        return box;
+    }
+
+    void unsubscribe(const std::shared_ptr<mailbox<T>>& box) {
+        std::lock_guard<std::mutex> lock(m_);
+        auto next = std::make_shared<subscribers>(*subs_);
+        for (auto it = next->begin(); it != next->end(); ++it) {
+            if (*it == box) {
+                next->erase(it);
+                break;
+            }
+        }
+        std::atomic_store(&subs_, std::shared_ptr<const subscribers>(std::move(next)));
+        box->close();
+        retired_ += box->stats();
+    }
+
+    uint64_t published() const { return published_.load(std::memory_order_relaxed); }
+
+    // Observes every message synchronously on the publishing thread, before
+    // any subscriber sees it (used by the recorder). Taps add up; the id
+    // returned removes this one again with untap().
+    uint64_t tap(tap_t f) {
+        std::lock_guard<std::mutex> lock(m_);
+        auto next = std::make_shared<taps>(*taps_);
+        uint64_t id = ++tap_ids_;
+        next->emplace_back(id, std::move(f));
+        std::atomic_store(&taps_, std::shared_ptr<const taps>(std::move(next)));
+        has_tap_.store(true, std::memory_order_release);
+        return id;
+    }
+
+    void untap(uint64_t id) {
+        std::lock_guard<std::mutex> lock(m_);
+        auto next = std::make_shared<taps>(*taps_);
+        next->erase(std::remove_if(next->begin(), next->end(), [id](const auto& t) { return t.first == id; }), next->end());
+        has_tap_.store(!next->empty(), std::memory_order_release);
+        std::atomic_store(&taps_, std::shared_ptr<const taps>(std::move(next)));
+    }
+
+    const policy& flow() const { return policy_; }
+
+    // Totals over current subscribers plus those already unsubscribed.
+    channel_stats stats() const override {
+        channel_stats s;
+        s.name      = name();
+        s.published = published();
+        auto subs = std::atomic_load(&subs_);
+        s.subscribers = subs->size();
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            s.flow = retired_;
+        }
+        for (auto& b : *subs) s.flow += b->stats();
+        return s;
+    }
+
+private:
+    void add(std::shared_ptr<mailbox<T>> box) {
+        std::lock_guard<std::mutex> lock(m_);
+        auto next = std::make_shared<subscribers>(*subs_);
+        next->push_back(std::move(box));
+        std::atomic_store(&subs_, std::shared_ptr<const subscribers>(std::move(next)));
+    }
+
+    policy                              policy_;
+    mutable std::mutex                  m_;
+    std::shared_ptr<const subscribers>  subs_;
+    std::atomic<uint64_t>               published_{0};
+    flow_stats                          retired_;
+    using taps = std::vector<std::pair<uint64_t, tap_t>>;
+
+    std::shared_ptr<const taps>         taps_;
+    uint64_t                            tap_ids_ = 0;
+    std::atomic<bool>                   has_tap_{false};
+};
+
+// Registry of channels by name. Channels are created at startup with add<T>()
+// and looked up with get<T>(); the type is checked on every lookup.
+class bus {
+public:
+    template<typename T>
+    channel<T>& add(const std::string& name, policy p = {}) {
+        std::lock_guard<std::mutex> lock(m_);
+        if (by_name_.count(name)) throw std::invalid_argument("bus: channel '" + name + "' already registered");
+        auto c = std::make_unique<channel<T>>(name, static_cast<uint16_t>(channels_.size()), p);
+        channel<T>& ref = *c;
+        by_name_[name] = c.get();
+        channels_.push_back(std::move(c));
+        return ref;
+    }
+
+    template<typename T>
+    channel<T>& get(const std::string& name) const {
+        std::lock_guard<std::mutex> lock(m_);
+        auto it = by_name_.find(name);
+        if (it == by_name_.end()) throw std::out_of_range("bus: no channel '" + name + "'");
+        if (it->second->type() != typeid(T)) throw std::invalid_argument("bus: channel '" + name + "' has a different type");
+        return static_cast<channel<T>&>(*it->second);
+    }
+
+    channel_base* find(uint16_t id) const {
+        std::lock_guard<std::mutex> lock(m_);
+        return id < channels_.size() ? channels_[id].get() : nullptr;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(m_);
+        return channels_.size();
+    }
+
+    // One row per channel, in registration order, for monitors and logs.
+    std::vector<channel_stats> stats() const {
+        std::lock_guard<std::mutex> lock(m_);
+        std::vector<channel_stats> out;
+        out.reserve(channels_.size());
+        for (auto& c : channels_) out.push_back(c->stats());
+        return out;
+    }
+
+private:
+    mutable std::mutex                          m_;
+    std::vector<std::unique_ptr<channel_base>>  channels_;
+    std::map<std::string, channel_base*>        by_name_;
+};
+
+};
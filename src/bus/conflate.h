@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+#include "dispatch/arena.h"
+
+namespace bus {
+
+// Wait-free single-producer/single-consumer "latest value wins" slot.
+// The producer always writes into a private back buffer and swaps it with
+// the shared middle buffer; the consumer swaps the middle into its front
+// buffer only when something new arrived. Neither side ever waits.
+template<typename T>
+class triple_buffer {
+public:
+    triple_buffer() = default;
+
+    triple_buffer(const triple_buffer&) = delete;
+    triple_buffer& operator=(const triple_buffer&) = delete;
+
+    // Producer side. Returns true if an unread value was overwritten.
+    bool write(T v) {
+        T displaced;
+        return write(std::move(v), displaced);
+    }
+
+    // As write(), handing back what the back buffer held so the caller can
+    // destroy it outside any critical section of its own.
+    bool write(T v, T& displaced) {
+        displaced = std::move(slots_[back_].value);
+        slots_[back_].value = std::move(v);
+        uint8_t old = middle_.exchange(static_cast<uint8_t>(back_ | fresh), std::memory_order_acq_rel);
+        back_ = old & index_mask;
+        return (old & fresh) != 0;
+    }
+
+    // Consumer side. Makes the newest value current; false if nothing new.
+    bool update() {
+        if (!(middle_.load(std::memory_order_relaxed) & fresh)) return false;
+        uint8_t old = middle_.exchange(front_, std::memory_order_acq_rel);
+        front_ = old & index_mask;
+        return true;
+    }
+
+    bool pending() const { return (middle_.load(std::memory_order_relaxed) & fresh) != 0; }
+
+    const T& read() const { return slots_[front_].value; }
+    T&       read()       { return slots_[front_].value; }
+
+private:
+    static constexpr uint8_t index_mask = 3;
+    static constexpr uint8_t fresh      = 4;
+
+    struct alignas(dispatch::cache_line) slot {
+        T value{};
+    };
+
+    slot                                                slots_[3];
+    alignas(dispatch::cache_line) std::atomic<uint8_t>  middle_{1};
+    alignas(dispatch::cache_line) uint8_t               back_  = 0;
+    alignas(dispatch::cache_line) uint8_t               front_ = 2;
+};
+
+// Feeds the freshest value of a conflating slot into a plex handler. poll()
+// runs the handler registered under key at most once, with the newest value
+// only; stale values in between are simply never seen.
+template<typename T, typename Plex, typename Key>
+class conflating_source {
+public:
+    conflating_source(triple_buffer<T>& slot, Plex& plex, Key key)
+        : slot_(slot), plex_(plex), key_(key) {}
+
+    bool poll() {
+        if (!slot_.update()) return false;
+        plex_.run(key_, slot_.read());
+        return true;
+    }
+
+private:
+    triple_buffer<T>&   slot_;
+    Plex&               plex_;
+    Key                 key_;
+};
+
+};
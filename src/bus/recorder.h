@@ -0,0 +1,453 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bus/bus.h"
+#include "dispatch/dispatch.h"
+#include "frame/frame.h"
+#include "schema/messages.h"
+#include "schema/schema.h"
+
+namespace bus {
+
+// On-disk session log: a header, then 8-byte aligned entries in the order
+// they were published. A channel entry (kind::channel) declares a channel id
+// before its first message; its payload is the message size followed by the
+// channel name. Size 0 (frame_record) marks a frame channel, whose messages
+// are a schema::frame_descriptor followed by the frame's bytes. bytes in the
+// header is kept current after every flush, so a log cut short by a crash
+// replays up to its last flush.
+namespace log {
+
+constexpr uint32_t magic   = 0x474c4252;    // "RBLG"
+constexpr uint32_t version = 1;
+
+enum class kind : uint16_t { message = 0, channel = 1 };
+
+struct header {
+    uint32_t    magic;
+    uint32_t    version;
+    uint64_t    bytes;          // including this header
+    uint64_t    entries;
+    uint64_t    reserved[5];
+};
+
+struct entry {
+    uint64_t    ts_ns;          // since the recording started
+    uint32_t    size;
+    uint16_t    channel;
+    uint16_t    kind;
+};
+
+static_assert(sizeof(header) == 64 && sizeof(entry) == 16, "bus::log layout is part of the file format");
+
+inline uint64_t padded(uint64_t n) { return (n + 7) & ~uint64_t(7); }
+
+constexpr uint32_t frame_record = 0;
+
+};
+
+// Records every message published on the channels it is given. The tap on
+// the publishing thread only timestamps the message and copies it into a
+// pending batch; a background writer moves batches into the memory-mapped
+// log, growing the file as needed. Schema messages are recorded as they are;
+// frames as their descriptor and used bytes, but the tap only takes another
+// reference to the frame and the writer copies the pixels. Both queues are
+// bounded: past max_pending bytes or max_held frames (each held frame pins a
+// pool slot) new entries are dropped and counted, like a full mailbox.
+class recorder {
+public:
+    static constexpr size_t default_reserve = 64 << 20;
+    static constexpr size_t max_pending     = 64 << 20;     // bytes waiting for the writer
+    static constexpr size_t max_held        = 2;            // frames waiting for the writer
+
+    explicit recorder(const std::string& path, size_t reserve = default_reserve)
+        : sink_(std::make_shared<sink>()), start_(std::chrono::steady_clock::now()) {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd_ < 0) throw std::system_error(errno, std::generic_category(), "bus: open " + path);
+        map(std::max(reserve, sizeof(log::header)));
+        auto* h = head();
+        *h = log::header{log::magic, log::version, sizeof(log::header), 0, {}};
+        used_ = sizeof(log::header);
+        thread_ = std::thread([this] { loop(); });
+    }
+
+    recorder(const recorder&) = delete;
+    recorder& operator=(const recorder&) = delete;
+
+    ~recorder() {
+        for (auto& untap : untaps_) untap();
+        {
+            std::lock_guard<std::mutex> lock(sink_->m);
+            sink_->stopping = true;
+        }
+        sink_->cv.notify_all();
+        thread_.join();
+        ::munmap(base_, mapped_);
+        ::ftruncate(fd_, static_cast<off_t>(used_));
+        ::close(fd_);
+    }
+
+    template<typename T>
+    void record(channel<T>& ch) {
+        static_assert(std::is_trivially_copyable_v<T>, "bus: only trivially copyable messages can be recorded");
+        uint16_t id = declare(ch.name(), sizeof(T));
+        uint64_t tap = ch.tap([s = sink_, start = start_, id](const T& m) {
+            append(*s, start, id, log::kind::message, &m, sizeof(T));
+        });
+        untaps_.push_back([&ch, tap] { ch.untap(tap); });
+    }
+
+    void record(channel<frame::frame>& ch) {
+        uint16_t id = declare(ch.name(), log::frame_record);
+        uint64_t tap = ch.tap([s = sink_, start = start_, id](const frame::frame& f) {
+            if (!f) return;
+            schema::frame_descriptor d = f.descriptor();
+            d.bytes = static_cast<uint32_t>(std::min<size_t>(d.bytes ? d.bytes : size_t(d.stride) * d.height, f.capacity()));
+            append(*s, start, id, log::kind::message, &d, sizeof(d), &f, d.bytes);
+        });
+        untaps_.push_back([&ch, tap] { ch.untap(tap); });
+    }
+
+    // Blocks until everything recorded so far is in the log.
+    void flush() {
+        std::unique_lock<std::mutex> lock(sink_->m);
+        uint64_t target = sink_->appended;
+        sink_->flush = true;
+        sink_->cv.notify_all();
+        sink_->flushed_cv.wait(lock, [&] { return sink_->written >= target; });
+    }
+
+    uint64_t entries() const {
+        std::lock_guard<std::mutex> lock(sink_->m);
+        return sink_->written;
+    }
+
+    // Messages and frames not recorded because the writer was behind.
+    uint64_t dropped() const {
+        std::lock_guard<std::mutex> lock(sink_->m);
+        return sink_->dropped;
+    }
+
+private:
+    // A frame whose pixels belong at offset at of the pending batch,
+    // followed by pad zero bytes.
+    struct held {
+        size_t          at;
+        frame::frame    f;
+        uint32_t        bytes;
+        uint32_t        pad;
+    };
+
+    struct sink {
+        mutable std::mutex      m;
+        std::condition_variable cv;
+        std::condition_variable flushed_cv;
+        std::vector<char>       pending;
+        std::vector<held>       frames;
+        uint64_t                appended = 0;
+        uint64_t                written  = 0;
+        uint64_t                dropped  = 0;
+        bool                    flush    = false;
+        bool                    stopping = false;
+    };
+
+    static constexpr size_t batch_bytes = 256 << 10;
+
+    uint16_t declare(const std::string& name, uint32_t size) {
+        uint16_t id = static_cast<uint16_t>(untaps_.size());
+        std::string decl(sizeof(uint32_t), '\0');
+        std::memcpy(&decl[0], &size, sizeof(size));
+        decl += name;
+        append(*sink_, start_, id, log::kind::channel, decl.data(), static_cast<uint32_t>(decl.size()));
+        return id;
+    }
+
+    // One entry whose payload is data, followed by the first frame_bytes of
+    // *f if given. Channel declarations are never dropped.
+    static void append(sink& s, std::chrono::steady_clock::time_point start, uint16_t channel, log::kind k,
+                       const void* data, uint32_t size, const frame::frame* f = nullptr, uint32_t frame_bytes = 0) {
+        uint32_t total = size + frame_bytes;
+        log::entry e{static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - start).count()),
+                     total, channel, static_cast<uint16_t>(k)};
+        size_t inline_bytes = f ? sizeof(e) + size : sizeof(e) + log::padded(total);
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(s.m);
+            if (k == log::kind::message && (s.pending.size() + inline_bytes > max_pending || (f && s.frames.size() >= max_held))) {
+                ++s.dropped;
+                return;
+            }
+            size_t at = s.pending.size();
+            s.pending.resize(at + inline_bytes);
+            std::memcpy(s.pending.data() + at, &e, sizeof(e));
+            std::memcpy(s.pending.data() + at + sizeof(e), data, size);
+            if (f) s.frames.push_back({s.pending.size(), f->share(), frame_bytes, static_cast<uint32_t>(log::padded(total) - total)});
+            ++s.appended;
+            wake = f || s.pending.size() >= batch_bytes;
+        }
+        // A held frame pins a pool slot, so the writer takes it right away.
+        if (wake) s.cv.notify_one();
+    }
+
+    void loop() {
+        std::vector<char> batch;
+        std::vector<held> frames;
+        for (;;) {
+            uint64_t count;
+            bool stop;
+            {
+                std::unique_lock<std::mutex> lock(sink_->m);
+                sink_->cv.wait_for(lock, std::chrono::milliseconds(10), [&] {
+                    return sink_->stopping || sink_->flush || !sink_->frames.empty() || sink_->pending.size() >= batch_bytes;
+                });
+                sink_->flush = false;
+                batch.swap(sink_->pending);
+                frames.swap(sink_->frames);
+                count = sink_->appended;
+                stop  = sink_->stopping;
+            }
+            if (!batch.empty()) {
+                write(batch, frames);
+                batch.clear();
+                frames.clear();
+            }
+            {
+                std::lock_guard<std::mutex> lock(sink_->m);
+                sink_->written = count;
+            }
+            sink_->flushed_cv.notify_all();
+            if (stop) return;
+        }
+    }
+
+    // Copies the batch into the log with each held frame's pixels spliced
+    // in at its offset.
+    void write(const std::vector<char>& batch, const std::vector<held>& frames) {
+        size_t bytes = batch.size();
+        for (const held& h : frames) bytes += h.bytes + h.pad;
+        if (used_ + bytes > mapped_) grow(used_ + bytes);
+        char* out = static_cast<char*>(base_) + used_;
+        size_t from = 0;
+        for (const held& h : frames) {
+            std::memcpy(out, batch.data() + from, h.at - from);
+            out += h.at - from;
+            std::memcpy(out, h.f.data(), h.bytes);
+            std::memset(out + h.bytes, 0, h.pad);
+            out  += h.bytes + h.pad;
+            from  = h.at;
+        }
+        std::memcpy(out, batch.data() + from, batch.size() - from);
+        const char* mem = static_cast<const char*>(base_);
+        for (size_t off = used_; off < used_ + bytes;) {
+            const auto* e = reinterpret_cast<const log::entry*>(mem + off);
+            off += sizeof(*e) + log::padded(e->size);
+            head()->entries++;
+        }
+        used_ += bytes;
+        head()->bytes = used_;
+    }
+
+    void map(size_t bytes) {
+        if (::ftruncate(fd_, static_cast<off_t>(bytes)) != 0) throw std::system_error(errno, std::generic_category(), "bus: ftruncate");
+        base_ = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (base_ == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "bus: mmap");
+        mapped_ = bytes;
+    }
+
+    void grow(size_t need) {
+        size_t bytes = mapped_;
+        while (bytes < need) bytes *= 2;
+        if (::ftruncate(fd_, static_cast<off_t>(bytes)) != 0) throw std::system_error(errno, std::generic_category(), "bus: ftruncate");
+        void* p = ::mremap(base_, mapped_, bytes, MREMAP_MAYMOVE);
+        if (p == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "bus: mremap");
+        base_   = p;
+        mapped_ = bytes;
+    }
+
+    log::header* head() { return static_cast<log::header*>(base_); }
+
+    std::shared_ptr<sink>                   sink_;
+    std::chrono::steady_clock::time_point   start_;
+    std::vector<std::function<void()>>      untaps_;
+    int                                     fd_     = -1;
+    void*                                   base_   = nullptr;
+    size_t                                  mapped_ = 0;
+    size_t                                  used_   = 0;
+    std::thread                             thread_;
+};
+
+// Feeds a recorded session back into channels bound by name. run() publishes
+// in log order from the calling thread, so a replay is deterministic given
+// the same handlers; at speed 1 messages keep their recorded spacing, at
+// speed 0 they go out as fast as subscribers take them.
+class replayer {
+public:
+    explicit replayer(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) throw std::system_error(errno, std::generic_category(), "bus: open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            int e = errno;
+            ::close(fd);
+            throw std::system_error(e, std::generic_category(), "bus: fstat " + path);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ < sizeof(log::header)) {
+            ::close(fd);
+            throw std::runtime_error("bus: " + path + " is not a session log");
+        }
+        base_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (base_ == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "bus: mmap " + path);
+        const auto* h = static_cast<const log::header*>(base_);
+        if (h->magic != log::magic || h->version != log::version) {
+            ::munmap(base_, size_);
+            throw std::runtime_error("bus: " + path + " is not a session log");
+        }
+        end_ = std::min<size_t>(h->bytes, size_);
+        index();
+    }
+
+    replayer(const replayer&) = delete;
+    replayer& operator=(const replayer&) = delete;
+
+    ~replayer() { ::munmap(base_, size_); }
+
+    // Routes the recorded channel called name (default: ch's own name) into
+    // ch. False if the log has no such channel.
+    template<typename T>
+    bool bind(channel<T>& ch, const std::string& name = {}) {
+        static_assert(std::is_trivially_copyable_v<T>, "bus: only trivially copyable messages can be replayed");
+        const std::string& want = name.empty() ? ch.name() : name;
+        for (auto& c : channels_) {
+            if (c.name != want) continue;
+            if (c.size != sizeof(T)) throw std::invalid_argument("bus: recorded channel '" + want + "' has a different message size");
+            c.publish = [&ch](const void* data, uint32_t) {
+                auto m = std::make_shared<T>();
+                std::memcpy(m.get(), data, sizeof(T));
+                if (!schema::wire_size<T>::in_bounds(*m)) return;
+                ch.publish(message<T>(std::move(m)));
+            };
+            return true;
+        }
+        return false;
+    }
+
+    // Routes a recorded frame channel into ch, copying each frame into a slot
+    // of pool with its recorded layout and capture timestamp. A frame is
+    // skipped when the pool is exhausted or its slots are too small.
+    bool bind(channel<frame::frame>& ch, frame::pool& pool, const std::string& name = {}) {
+        const std::string& want = name.empty() ? ch.name() : name;
+        for (auto& c : channels_) {
+            if (c.name != want) continue;
+            if (c.size != log::frame_record) throw std::invalid_argument("bus: recorded channel '" + want + "' is not a frame channel");
+            c.publish = [&ch, &pool](const void* data, uint32_t size) {
+                if (size < sizeof(schema::frame_descriptor)) return;
+                schema::frame_descriptor d;
+                std::memcpy(&d, data, sizeof(d));
+                if (d.bytes > size - sizeof(d)) return;
+                frame::frame f = pool.acquire();
+                if (!f || f.capacity() < d.bytes) return;
+                std::memcpy(f.data(), static_cast<const char*>(data) + sizeof(d), d.bytes);
+                f.set({d.width, d.height, d.stride, d.fourcc, d.bytes}, d.timestamp_ns);
+                ch.publish(message<frame::frame>(std::make_shared<const frame::frame>(std::move(f))));
+            };
+            return true;
+        }
+        return false;
+    }
+
+    // Publishes the session; returns how many messages went out. Messages on
+    // unbound channels are skipped.
+    uint64_t run(const dispatch::cancel_token& tok, double speed = 1.0) {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t sent = 0;
+        for (size_t off = sizeof(log::header); off + sizeof(log::entry) <= end_ && !tok.cancelled();) {
+            const auto* e = reinterpret_cast<const log::entry*>(static_cast<const char*>(base_) + off);
+            off += sizeof(*e) + log::padded(e->size);
+            if (e->kind != static_cast<uint16_t>(log::kind::message)) continue;
+            auto it = by_id_.find(e->channel);
+            if (it == by_id_.end() || !channels_[it->second].publish) continue;
+            if (speed > 0) {
+                auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                       std::chrono::nanoseconds(static_cast<int64_t>(e->ts_ns / speed)));
+                auto wait = due - std::chrono::steady_clock::now();
+                if (wait > std::chrono::steady_clock::duration::zero() && !tok.sleep_for(wait)) break;
+            }
+            channels_[it->second].publish(e + 1, e->size);
+            ++sent;
+        }
+        return sent;
+    }
+
+    std::vector<std::string> channels() const {
+        std::vector<std::string> out;
+        for (auto& c : channels_) out.push_back(c.name);
+        return out;
+    }
+
+    uint64_t messages() const { return messages_; }
+
+    std::chrono::nanoseconds length() const { return std::chrono::nanoseconds(last_ns_); }
+
+private:
+    struct recorded {
+        std::string                         name;
+        uint32_t                            size;
+        std::function<void(const void*, uint32_t)> publish;
+    };
+
+    void index() {
+        size_t off = sizeof(log::header);
+        while (off + sizeof(log::entry) <= end_) {
+            const auto* e = reinterpret_cast<const log::entry*>(static_cast<const char*>(base_) + off);
+            if (off + sizeof(*e) + e->size > end_) break;
+            const char* payload = reinterpret_cast<const char*>(e + 1);
+            if (e->kind == static_cast<uint16_t>(log::kind::channel) && e->size >= sizeof(uint32_t)) {
+                recorded c;
+                std::memcpy(&c.size, payload, sizeof(uint32_t));
+                c.name.assign(payload + sizeof(uint32_t), e->size - sizeof(uint32_t));
+                by_id_[e->channel] = channels_.size();
+                channels_.push_back(std::move(c));
+            } else if (e->kind == static_cast<uint16_t>(log::kind::message)) {
+                ++messages_;
+                last_ns_ = e->ts_ns;
+            }
+            off += sizeof(*e) + log::padded(e->size);
+        }
+        end_ = off;     // drop a torn tail
+    }
+
+    void*                                   base_ = nullptr;
+    size_t                                  size_ = 0;
+    size_t                                  end_  = 0;
+    std::vector<recorded>                   channels_;
+    std::unordered_map<uint16_t, size_t>    by_id_;
+    uint64_t                                messages_ = 0;
+    uint64_t                                last_ns_  = 0;
+};
+
+};
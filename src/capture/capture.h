@@ -0,0 +1,432 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bus/bus.h"
+#include "dispatch/dispatch.h"
+#include "frame/frame.h"
+
+namespace capture {
+
+using clock = std::chrono::steady_clock;   // CLOCK_MONOTONIC, same base as V4L2 timestamps
+
+struct config {
+    std::string device  = "/dev/video1";
+    uint32_t    width   = 1920;
+    uint32_t    height  = 1080;
+    uint32_t    fourcc  = frame::mjpeg;
+    uint32_t    fps     = 30;
+    uint32_t    buffers = 4;
+    bool        latest  = true;     // skip frames that queued up behind a slow consumer
+};
+
+// A camera, or something pretending to be one. grab() returns the next frame
+// already published in the source's pool, or an empty frame on timeout.
+class source {
+public:
+    virtual ~source() = default;
+
+    virtual frame::frame grab(std::chrono::milliseconds timeout) = 0;
+
+    // False once a finite source has run out.
+    virtual bool live() const { return true; }
+
+    uint64_t captured() const { return captured_.load(std::memory_order_relaxed); }
+    uint64_t skipped()  const { return skipped_.load(std::memory_order_relaxed); }
+
+protected:
+    std::atomic<uint64_t> captured_{0};
+    std::atomic<uint64_t> skipped_{0};
+};
+
+namespace detail {
+
+inline int xioctl(int fd, unsigned long req, void* arg) {
+    int r;
+    do {
+        r = ::ioctl(fd, req, arg);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+inline uint64_t timestamp_ns(const timeval& tv) {
+    return uint64_t(tv.tv_sec) * 1000000000ull + uint64_t(tv.tv_usec) * 1000ull;
+}
+
+inline uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count());
+}
+
+// Width and height from a JPEG's SOF segment; false if there is none.
+inline bool jpeg_size(const uint8_t* p, size_t n, uint32_t& w, uint32_t& h) {
+    size_t i = 2;
+    while (i + 4 <= n) {
+        if (p[i] != 0xFF) return false;
+        uint8_t marker = p[i + 1];
+        if (marker == 0xFF) {
+            ++i;
+            continue;
+        }
+        size_t len = size_t(p[i + 2]) << 8 | p[i + 3];
+        bool sof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (sof && i + 9 <= n) {
+            h = uint32_t(p[i + 5]) << 8 | p[i + 6];
+            w = uint32_t(p[i + 7]) << 8 | p[i + 8];
+            return true;
+        }
+        i += 2 + len;
+    }
+    return false;
+}
+
+};
+
+// V4L2 streaming capture. When the driver supports USERPTR the pool's own
+// slots are queued as capture buffers, so the camera DMAs straight into
+// shared memory and a grabbed frame is handed on without a single copy;
+// otherwise the driver's mmap buffers are used and each frame costs one
+// memcpy into the pool. Frames carry the kernel's capture timestamp.
+class v4l2_source : public source {
+public:
+    v4l2_source(const config& c, std::shared_ptr<frame::pool> pool) : cfg_(c), pool_(std::move(pool)) {
+        fd_ = ::open(cfg_.device.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd_ < 0) throw std::system_error(errno, std::generic_category(), "capture: open " + cfg_.device);
+        try {
+            configure();
+            start();
+        } catch (...) {
+            ::close(fd_);
+            throw;
+        }
+    }
+
+    ~v4l2_source() override {
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        detail::xioctl(fd_, VIDIOC_STREAMOFF, &type);
+        for (auto& m : maps_) ::munmap(m.first, m.second);
+        ::close(fd_);
+    }
+
+    frame::frame grab(std::chrono::milliseconds timeout) override {
+        if (userptr_) {
+            // Indexes left idle by a dry pool get a slot as soon as one is
+            // back. With nothing queued the driver has nowhere to capture to
+            // and poll() fails at once, so wait for the pool instead of
+            // spinning on it.
+            if (!refill()) {
+                std::this_thread::sleep_for(std::min(timeout, std::chrono::milliseconds(5)));
+                return {};
+            }
+        }
+        pollfd p{fd_, POLLIN, 0};
+        if (::poll(&p, 1, static_cast<int>(timeout.count())) <= 0) return {};
+
+        v4l2_buffer buf;
+        if (!dequeue(buf)) return {};
+        // Latest-only: anything else already waiting is older than what the
+        // consumer will want by the time it gets there.
+        if (cfg_.latest) {
+            v4l2_buffer next;
+            while (dequeue(next)) {
+                requeue_unused(buf);
+                skipped_.fetch_add(1, std::memory_order_relaxed);
+                buf = next;
+            }
+        }
+
+        frame::frame f;
+        size_t used = 0;
+        if (userptr_) {
+            f = std::move(slots_[buf.index]);
+            refill();
+            if (f) used = std::min<size_t>(buf.bytesused, f.capacity());
+        } else {
+            f = pool_->acquire();
+            if (f) {
+                used = std::min<size_t>(buf.bytesused, f.capacity());
+                std::memcpy(f.data(), maps_[buf.index].first, used);
+            }
+            detail::xioctl(fd_, VIDIOC_QBUF, &buf);
+        }
+        if (!f) {
+            skipped_.fetch_add(1, std::memory_order_relaxed);
+            return {};
+        }
+        frame::format fmt = format_;
+        fmt.bytes = static_cast<uint32_t>(used);
+        f.set(fmt, kernel_clock_ ? detail::timestamp_ns(buf.timestamp) : detail::now_ns());
+        captured_.fetch_add(1, std::memory_order_relaxed);
+        return f;
+    }
+
+    const frame::format& format() const { return format_; }
+    bool zero_copy() const { return userptr_; }
+
+private:
+    void configure() {
+        v4l2_format fmt{};
+        fmt.type                = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        fmt.fmt.pix.width       = cfg_.width;
+        fmt.fmt.pix.height      = cfg_.height;
+        fmt.fmt.pix.pixelformat = cfg_.fourcc;
+        fmt.fmt.pix.field       = V4L2_FIELD_NONE;
+        if (detail::xioctl(fd_, VIDIOC_S_FMT, &fmt) < 0) throw std::system_error(errno, std::generic_category(), "capture: VIDIOC_S_FMT");
+        format_ = {fmt.fmt.pix.width, fmt.fmt.pix.height, fmt.fmt.pix.bytesperline, fmt.fmt.pix.pixelformat, fmt.fmt.pix.sizeimage};
+
+        v4l2_streamparm parm{};
+        parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        parm.parm.capture.timeperframe.numerator   = 1;
+        parm.parm.capture.timeperframe.denominator = cfg_.fps;
+        detail::xioctl(fd_, VIDIOC_S_PARM, &parm);  // best effort; not every driver takes it
+
+        userptr_ = pool_->slot_bytes() >= format_.bytes && request(V4L2_MEMORY_USERPTR, cfg_.buffers) > 0;
+        if (!userptr_ && request(V4L2_MEMORY_MMAP, cfg_.buffers) == 0) {
+            throw std::system_error(errno, std::generic_category(), "capture: VIDIOC_REQBUFS");
+        }
+    }
+
+    uint32_t request(v4l2_memory memory, uint32_t count) {
+        v4l2_requestbuffers req{};
+        req.count  = count;
+        req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        req.memory = memory;
+        if (detail::xioctl(fd_, VIDIOC_REQBUFS, &req) < 0) return 0;
+        count_ = req.count;
+        return req.count;
+    }
+
+    void start() {
+        if (userptr_) {
+            slots_.resize(count_);
+            refill();
+        } else {
+            for (uint32_t i = 0; i < count_; ++i) {
+                v4l2_buffer buf{};
+                buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                buf.memory = V4L2_MEMORY_MMAP;
+                buf.index  = i;
+                if (detail::xioctl(fd_, VIDIOC_QUERYBUF, &buf) < 0) throw std::system_error(errno, std::generic_category(), "capture: VIDIOC_QUERYBUF");
+                void* p = ::mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, buf.m.offset);
+                if (p == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "capture: mmap");
+                maps_.emplace_back(p, buf.length);
+                detail::xioctl(fd_, VIDIOC_QBUF, &buf);
+            }
+        }
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if (detail::xioctl(fd_, VIDIOC_STREAMON, &type) < 0) throw std::system_error(errno, std::generic_category(), "capture: VIDIOC_STREAMON");
+    }
+
+    bool dequeue(v4l2_buffer& buf) {
+        buf        = v4l2_buffer{};
+        buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = userptr_ ? V4L2_MEMORY_USERPTR : V4L2_MEMORY_MMAP;
+        if (detail::xioctl(fd_, VIDIOC_DQBUF, &buf) < 0) return false;
+        kernel_clock_ = (buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+        if (buf.flags & V4L2_BUF_FLAG_ERROR) {
+            requeue_unused(buf);
+            skipped_.fetch_add(1, std::memory_order_relaxed);
+            return dequeue(buf);
+        }
+        return true;
+    }
+
+    // Hands a fresh pool slot to the driver at every index that has none.
+    // If the pool is dry an index stays idle until a later grab. True while
+    // at least one buffer is queued.
+    bool refill() {
+        bool queued = false, dry = false;
+        for (uint32_t i = 0; i < count_; ++i) {
+            if (!slots_[i]) {
+                frame::frame f = dry ? frame::frame() : pool_->acquire();
+                if (!f) {
+                    dry = true;
+                    continue;
+                }
+                v4l2_buffer buf{};
+                buf.type      = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+                buf.memory    = V4L2_MEMORY_USERPTR;
+                buf.index     = i;
+                buf.m.userptr = reinterpret_cast<unsigned long>(f.data());
+                buf.length    = static_cast<uint32_t>(f.capacity());
+                if (detail::xioctl(fd_, VIDIOC_QBUF, &buf) < 0) continue;
+                slots_[i] = std::move(f);
+            }
+            queued = true;
+        }
+        return queued;
+    }
+
+    // Gives a dequeued buffer straight back without publishing it; for
+    // USERPTR the driver echoed the pointer and length in buf.
+    void requeue_unused(v4l2_buffer& buf) { detail::xioctl(fd_, VIDIOC_QBUF, &buf); }
+
+    config                              cfg_;
+    std::shared_ptr<frame::pool>        pool_;
+    int                                 fd_ = -1;
+    frame::format                       format_;
+    bool                                userptr_      = false;
+    bool                                kernel_clock_ = false;
+    uint32_t                            count_        = 0;
+    std::vector<frame::frame>           slots_;             // userptr: slot queued at each index
+    std::vector<std::pair<void*, size_t>> maps_;            // mmap fallback
+};
+
+// Stand-in camera for tests and offline runs. Plays a directory of JPEG
+// images (in name order) or a single MJPEG stream file (concatenated JPEGs,
+// as written by `ffmpeg -c:v copy -f mjpeg`) at fps, through the same pool
+// and interface as the real device. fps 0 plays as fast as it is grabbed.
+class file_source : public source {
+public:
+    file_source(const std::string& path, std::shared_ptr<frame::pool> pool, uint32_t fps = 30, bool loop = true)
+        : pool_(std::move(pool)), loop_(loop),
+          period_(fps ? std::chrono::nanoseconds(1000000000 / fps) : std::chrono::nanoseconds(0)) {
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0) throw std::system_error(errno, std::generic_category(), "capture: " + path);
+        if (S_ISDIR(st.st_mode)) load_directory(path);
+        else load_stream(path);
+        if (images_.empty()) throw std::runtime_error("capture: no frames in " + path);
+        next_ = clock::now();
+    }
+
+    frame::frame grab(std::chrono::milliseconds timeout) override {
+        if (!live()) return {};
+        auto now = clock::now();
+        if (next_ > now) {
+            if (next_ - now > timeout) {
+                std::this_thread::sleep_for(timeout);
+                return {};
+            }
+            std::this_thread::sleep_until(next_);
+        }
+        // Behind schedule: like a real sensor, the frames we missed are gone.
+        if (period_.count() && clock::now() - next_ > period_) {
+            auto behind = (clock::now() - next_) / period_;
+            skipped_.fetch_add(static_cast<uint64_t>(behind), std::memory_order_relaxed);
+            next_ += period_ * behind;
+            advance(static_cast<size_t>(behind));
+            if (!live()) return {};
+        }
+        next_ += period_;
+
+        const image& img = images_[pos_];
+        frame::frame f = pool_->acquire();
+        if (!f || f.capacity() < img.bytes.size()) {
+            skipped_.fetch_add(1, std::memory_order_relaxed);
+            advance(1);
+            return {};
+        }
+        std::memcpy(f.data(), img.bytes.data(), img.bytes.size());
+        f.set({img.width, img.height, 0, frame::mjpeg, static_cast<uint32_t>(img.bytes.size())}, detail::now_ns());
+        advance(1);
+        captured_.fetch_add(1, std::memory_order_relaxed);
+        return f;
+    }
+
+    bool live() const override { return loop_ || pos_ < images_.size(); }
+
+    size_t size() const { return images_.size(); }
+
+private:
+    struct image {
+        std::vector<uint8_t>    bytes;
+        uint32_t                width  = 0;
+        uint32_t                height = 0;
+    };
+
+    void advance(size_t n) {
+        pos_ += n;
+        if (loop_) pos_ %= images_.size();
+    }
+
+    void add(std::vector<uint8_t> bytes) {
+        image img;
+        detail::jpeg_size(bytes.data(), bytes.size(), img.width, img.height);
+        img.bytes = std::move(bytes);
+        images_.push_back(std::move(img));
+    }
+
+    static std::vector<uint8_t> read_file(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    void load_directory(const std::string& dir) {
+        std::vector<std::string> names;
+        if (DIR* d = ::opendir(dir.c_str())) {
+            while (dirent* e = ::readdir(d)) {
+                std::string n = e->d_name;
+                auto dot = n.rfind('.');
+                if (dot == std::string::npos) continue;
+                std::string ext = n.substr(dot + 1);
+                std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+                if (ext == "jpg" || ext == "jpeg") names.push_back(n);
+            }
+            ::closedir(d);
+        }
+        std::sort(names.begin(), names.end());
+        for (auto& n : names) add(read_file(dir + "/" + n));
+    }
+
+    // Splits a stream on SOI markers. Entropy-coded data never contains
+    // FF D8 (FF is always stuffed), so this is exact.
+    void load_stream(const std::string& path) {
+        std::vector<uint8_t> all = read_file(path);
+        size_t start = std::string::npos;
+        for (size_t i = 0; i + 1 < all.size(); ++i) {
+            if (all[i] != 0xFF || all[i + 1] != 0xD8) continue;
+            if (start != std::string::npos) add(std::vector<uint8_t>(all.begin() + start, all.begin() + i));
+            start = i;
+        }
+        if (start != std::string::npos) add(std::vector<uint8_t>(all.begin() + start, all.end()));
+    }
+
+    std::shared_ptr<frame::pool>    pool_;
+    bool                            loop_;
+    std::chrono::nanoseconds        period_;
+    std::vector<image>              images_;
+    size_t                          pos_ = 0;
+    clock::time_point               next_;
+};
+
+// Picks the real device or the stand-in: paths under /dev are cameras,
+// anything else is replayed from disk.
+inline std::unique_ptr<source> open(const config& c, std::shared_ptr<frame::pool> pool) {
+    if (c.device.rfind("/dev/", 0) == 0) return std::make_unique<v4l2_source>(c, std::move(pool));
+    return std::make_unique<file_source>(c.device, std::move(pool), c.fps);
+}
+
+// Capture loop for a dispatch task: every grabbed frame is published on ch
+// as is, so consumers get the pool slot itself. Returns when tok is
+// cancelled or a finite source runs out.
+inline void pump(source& src, bus::channel<frame::frame>& ch, const dispatch::cancel_token& tok) {
+    while (!tok.cancelled() && src.live()) {
+        frame::frame f = src.grab(std::chrono::milliseconds(100));
+        if (f) ch.publish(std::make_shared<const frame::frame>(std::move(f)));
+    }
+}
+
+};
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace dispatch {
+
+constexpr size_t cache_line = 64;
+
+// Bump allocator that never returns memory to the heap. reset() rewinds to the
+// first chunk but keeps every chunk it has grown, so once a frame's working set
+// has been seen the arena stops touching malloc entirely.
+class monotonic_arena : public std::pmr::memory_resource {
+public:
+    explicit monotonic_arena(size_t initial_bytes = 1 << 20) : initial_(initial_bytes) {}
+
+    monotonic_arena(const monotonic_arena&) = delete;
+    monotonic_arena& operator=(const monotonic_arena&) = delete;
+
+    ~monotonic_arena() override {
+        for (auto& c : chunks_) {
+            ::operator delete(c.base, std::align_val_t(cache_line));
+        }
+    }
+
+    void reset() {
+        current_ = 0;
+        offset_  = 0;
+    }
+
+    // A position in the arena; rewind(m) releases everything allocated
+    // after mark() returned m. Marks nest like a stack.
+    struct marker {
+        size_t  chunk  = 0;
+        size_t  offset = 0;
+    };
+
+    marker mark() const { return {current_, offset_}; }
+
+    void rewind(marker m) {
+        current_ = m.chunk;
+        offset_  = m.offset;
+    }
+
+    // Allocates the first chunk now, on the calling thread, so its pages are
+    // first-touched on the caller's NUMA node.
+    void prefault() {
+        if (chunks_.empty()) grow(initial_);
+        for (size_t i = 0; i < chunks_[0].size; i += 4096) {
+            chunks_[0].base[i] = std::byte{0};
+        }
+    }
+
+    size_t capacity() const {
+        size_t n = 0;
+        for (const auto& c : chunks_) n += c.size;
+        return n;
+    }
+
+    // Number of times the arena had to go to the heap; flat in steady state.
+    size_t growths() const { return chunks_.size(); }
+
+private:
+    struct chunk {
+        std::byte*  base;
+        size_t      size;
+    };
+
+    void* do_allocate(size_t bytes, size_t align) override {
+        while (current_ < chunks_.size()) {
+            chunk& c = chunks_[current_];
+            // Align the address, not the offset: chunks are only
+            // cache-line aligned and callers may ask for more.
+            uintptr_t at = reinterpret_cast<uintptr_t>(c.base) + offset_;
+            size_t p = offset_ + (((at + align - 1) & ~uintptr_t(align - 1)) - at);
+            if (p + bytes <= c.size) {
+                offset_ = p + bytes;
+                return c.base + p;
+            }
+            ++current_;
+            offset_ = 0;
+        }
+        grow(std::max(bytes + align, chunks_.empty() ? initial_ : chunks_.back().size * 2));
+        return do_allocate(bytes, align);
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& o) const noexcept override {
+        return this == &o;
+    }
+
+    void grow(size_t bytes) {
+        bytes = (bytes + cache_line - 1) & ~(cache_line - 1);
+        auto* p = static_cast<std::byte*>(::operator new(bytes, std::align_val_t(cache_line)));
+        chunks_.push_back({p, bytes});
+        current_ = chunks_.size() - 1;
+        offset_  = 0;
+    }
+
+    size_t              initial_;
+    std::vector<chunk>  chunks_;
+    size_t              current_ = 0;
+    size_t              offset_  = 0;
+};
+
+// A group of cpus that share a cache/performance class, e.g. the A76 or the
+// A55 cluster on the RK3588. Workers pinned to one domain keep their arenas
+// hot in that cluster's caches.
+struct cpu_domain {
+    int                 capacity = 1024;
+    int                 node     = 0;
+    std::vector<int>    cpus;
+};
+
+enum class cores { any, big, little };
+
+class topology {
+public:
+    static const topology& system() {
+        static const topology t = probe();
+        return t;
+    }
+
+    const std::vector<cpu_domain>& domains() const { return domains_; }
+
+    const cpu_domain* domain_of(int cpu) const {
+        for (const auto& d : domains_) {
+            if (std::find(d.cpus.begin(), d.cpus.end(), cpu) != d.cpus.end()) return &d;
+        }
+        return nullptr;
+    }
+
+    // cpus eligible for the given class, biggest domains first.
+    std::vector<int> cpus(cores c) const {
+        std::vector<int> out;
+        if (domains_.empty()) return out;
+        int hi = domains_.front().capacity;
+        int lo = domains_.back().capacity;
+        for (const auto& d : domains_) {
+            if (c == cores::big    && d.capacity != hi && hi != lo) continue;
+            if (c == cores::little && d.capacity != lo && hi != lo) continue;
+            out.insert(out.end(), d.cpus.begin(), d.cpus.end());
+        }
+        return out;
+    }
+
+private:
+    static int read_int(const std::string& path, int fallback) {
+        std::ifstream f(path);
+        int v = fallback;
+        if (f) f >> v;
+        return v;
+    }
+
+    static int node_of(int cpu) {
+        std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+        DIR* d = opendir(dir.c_str());
+        if (!d) return 0;
+        int node = 0;
+        while (dirent* e = readdir(d)) {
+            if (std::string(e->d_name).rfind("node", 0) == 0) {
+                node = std::atoi(e->d_name + 4);
+                break;
+            }
+        }
+        closedir(d);
+        return node;
+    }
+
+    static topology probe() {
+        topology t;
+        std::map<std::pair<int, int>, cpu_domain> by_key;
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int cpu = 0; cpu < n; ++cpu) {
+            std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+            int capacity = read_int(base + "/cpu_capacity", 1024);
+            int node     = node_of(cpu);
+            cpu_domain& d = by_key[{-capacity, node}];
+            d.capacity = capacity;
+            d.node     = node;
+            d.cpus.push_back(cpu);
+        }
+        for (auto& kv : by_key) t.domains_.push_back(std::move(kv.second));
+        return t;
+    }
+
+    std::vector<cpu_domain> domains_;
+};
+
+inline void pin_to(const std::vector<int>& cpus) {
+    if (cpus.empty()) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus) CPU_SET(c, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+// Per-thread allocation context handed to every task running on a dispatch
+// thread. frame() is rewound after each pooled task (or by frame_scope);
+// pool() recycles size-classed blocks for objects that outlive one frame and
+// keeps its chunks, so the heap is only touched while it warms up.
+class execution_context {
+public:
+    execution_context(int worker, size_t frame_bytes)
+        : worker_(worker), frame_(frame_bytes), pool_(std::pmr::new_delete_resource()) {}
+
+    static execution_context* current() { return slot(); }
+
+    int                         worker() const { return worker_; }
+    monotonic_arena&            frame()        { return frame_; }
+    std::pmr::memory_resource&  pool()         { return pool_; }
+
+    // Binds this context to the calling thread for its lifetime.
+    void attach() { slot() = this; }
+
+    void detach() {
+        if (slot() == this) slot() = nullptr;
+    }
+
+private:
+    static execution_context*& slot() {
+        static thread_local execution_context* ctx = nullptr;
+        return ctx;
+    }
+
+    int                                     worker_;
+    monotonic_arena                         frame_;
+    std::pmr::unsynchronized_pool_resource  pool_;
+};
+
+// Frame-lifetime arena for the current thread; falls back to the heap when
+// called off a dispatch thread.
+inline std::pmr::memory_resource& frame_arena() {
+    if (auto* c = execution_context::current()) return c->frame();
+    return *std::pmr::new_delete_resource();
+}
+
+inline std::pmr::memory_resource& pool_arena() {
+    if (auto* c = execution_context::current()) return c->pool();
+    return *std::pmr::new_delete_resource();
+}
+
+// Rewinds the current thread's frame arena on scope exit; use inside
+// long-running loops where one iteration is one frame.
+class frame_scope {
+public:
+    frame_scope() : ctx_(execution_context::current()) {}
+    ~frame_scope() {
+        if (ctx_) ctx_->frame().reset();
+    }
+
+    frame_scope(const frame_scope&) = delete;
+    frame_scope& operator=(const frame_scope&) = delete;
+
+private:
+    execution_context* ctx_;
+};
+
+// Frame-arena memory for one scope: what is allocated through resource() is
+// released when the scratch goes away, even if the frame goes on. Nests, so
+// parallel_for items and tasks that never reach frame_scope can use it per
+// call without growing the arena. Declare it before the containers using it.
+// Off a dispatch thread resource() is the heap.
+class scratch {
+public:
+    scratch() : ctx_(execution_context::current()) {
+        if (ctx_) mark_ = ctx_->frame().mark();
+    }
+
+    ~scratch() {
+        if (ctx_) ctx_->frame().rewind(mark_);
+    }
+
+    scratch(const scratch&) = delete;
+    scratch& operator=(const scratch&) = delete;
+
+    std::pmr::memory_resource& resource() {
+        if (ctx_) return ctx_->frame();
+        return *std::pmr::new_delete_resource();
+    }
+
+private:
+    execution_context*          ctx_;
+    monotonic_arena::marker     mark_;
+};
+
+};
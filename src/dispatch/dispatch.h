@@ -1,27 +1,368 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-namespace {
+#include <pthread.h>
+
+#include "dispatch/arena.h"
+
+namespace dispatch {
+
+using clock = std::chrono::steady_clock;
+
+// Cooperative cancellation. Tasks poll the token (or sleep on it) and return
+// once it trips; nothing is ever forcibly interrupted.
+class cancel_token {
+public:
+    bool cancelled() const {
+        return state_->cancelled.load(std::memory_order_relaxed);
+    }
+
+    explicit operator bool() const { return cancelled(); }
+
+    // Sleeps for d, waking early on cancellation. Returns false if cancelled.
+    template<typename Rep, typename Period>
+    bool sleep_for(std::chrono::duration<Rep, Period> d) const {
+        std::unique_lock<std::mutex> lock(state_->m);
+        return !state_->cv.wait_for(lock, d, [this] { return cancelled(); });
+    }
+
+private:
+    friend class dispatch;
+
+    struct state {
+        std::atomic<bool>       cancelled{false};
+        std::mutex              m;
+        std::condition_variable cv;
+    };
+
+    cancel_token() : state_(std::make_shared<state>()) {}
+
+    void cancel() const {
+        {
+            std::lock_guard<std::mutex> lock(state_->m);
+            state_->cancelled.store(true, std::memory_order_relaxed);
+        }
+        state_->cv.notify_all();
+    }
+
+    std::shared_ptr<state> state_;
+};
+
+struct stuck_task {
+    std::string         name;
+    clock::duration     running_for;
+};
+
+struct shutdown_report {
+    size_t                  joined = 0;
+    std::vector<stuck_task> abandoned;
+
+    bool clean() const { return abandoned.empty(); }
+};
+
+struct pool_options {
+    size_t  workers     = 0;            // 0: one per eligible cpu
+    cores   affinity    = cores::any;
+    size_t  frame_bytes = 1 << 20;      // initial frame arena per worker
+};
 
 class dispatch {
 public:
-    dispatch() = default;
+    using task_t = std::function<void(const cancel_token&)>;
+
+    // Grace period the destructor gives tasks before abandoning them.
+    static constexpr std::chrono::milliseconds default_grace{2000};
+
+    dispatch() : done_(std::make_shared<completion>()), queue_(std::make_shared<job_queue>()) {}
+
+    // Starts a worker pool for post(). Each worker is pinned to the cache
+    // domain of its cpu and owns an execution_context whose frame arena is
+    // rewound after every job.
+    explicit dispatch(pool_options o) : dispatch() {
+        std::vector<int> cpus = topology::system().cpus(o.affinity);
+        size_t n = o.workers ? o.workers : std::max<size_t>(cpus.size(), 1);
+        for (size_t i = 0; i < n; ++i) {
+            std::vector<int> pin;
+            if (!cpus.empty()) {
+                const cpu_domain* d = topology::system().domain_of(cpus[i % cpus.size()]);
+                if (d) pin = d->cpus;
+            }
+            run("worker-" + std::to_string(i), worker_loop(queue_, static_cast<int>(i), std::move(pin), o.frame_bytes));
+        }
+        workers_ = n;
+    }
+
+    dispatch(const dispatch&) = delete;
+    dispatch& operator=(const dispatch&) = delete;
 
     ~dispatch() {
-        for (auto& t : threads_) {
-            if (t.joinable()) {
-                t.join();
+        shutdown_report r = shutdown(clock::now() + default_grace);
+        for (const auto& s : r.abandoned) {
+            std::cerr << "dispatch: abandoned stuck task '" << s.name << "' after "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(s.running_for).count()
+                      << " ms\n";
+        }
+    }
+
+    size_t workers() const { return workers_; }
+
+    // Queues a short job on the pool. Jobs may take a cancel_token or nothing.
+    template<typename F>
+    void post(F&& f) {
+        if (workers_ == 0) {
+            throw std::logic_error("dispatch: post() needs a worker pool");
+        }
+        {
+            std::lock_guard<std::mutex> lock(queue_->m);
+            if constexpr (std::is_invocable_v<F&, const cancel_token&>) {
+                queue_->jobs.emplace_back(std::forward<F>(f));
+            } else {
+                queue_->jobs.emplace_back([f = std::forward<F>(f)](const cancel_token&) mutable { f(); });
             }
         }
+        queue_->cv.notify_one();
     }
 
     void run(void(*func)()) {
-        threads_.emplace_back(func);
+        run("anonymous", [func](const cancel_token&) { func(); });
+    }
+
+    void run(std::string name, task_t func) {
+        auto t = std::make_shared<task>();
+        t->name    = std::move(name);
+        t->started = clock::now();
+
+        std::shared_ptr<completion> done = done_;
+        std::lock_guard<std::mutex> lock(m_);
+        tasks_.push_back(t);
+        t->thread = std::thread([t, done, func = std::move(func)] {
+            if (execution_context::current()) {
+                func(t->token);
+            } else {
+                execution_context ctx(-1, 64 << 10);
+                ctx.attach();
+                func(t->token);
+                ctx.detach();
+            }
+            {
+                std::lock_guard<std::mutex> lock(done->m);
+                t->finished.store(true, std::memory_order_release);
+            }
+            done->cv.notify_all();
+        });
+    }
+
+    // Trips every task's token without waiting.
+    void cancel_all() {
+        std::lock_guard<std::mutex> lock(m_);
+        for (auto& t : tasks_) {
+            t->token.cancel();
+        }
+        {
+            std::lock_guard<std::mutex> qlock(queue_->m);
+        }
+        queue_->cv.notify_all();
+    }
+
+    // Tasks that have been running longer than threshold and have not finished.
+    std::vector<stuck_task> stuck(clock::duration threshold) const {
+        std::vector<stuck_task> out;
+        auto now = clock::now();
+        std::lock_guard<std::mutex> lock(m_);
+        for (const auto& t : tasks_) {
+            if (!t->finished.load(std::memory_order_acquire) && now - t->started > threshold) {
+                out.push_back({t->name, now - t->started});
+            }
+        }
+        return out;
+    }
+
+    // Cancels every task, joins those that finish before deadline and detaches
+    // the rest. Pool workers drain the jobs already queued before exiting.
+    // Abandoned threads keep their own task state alive, so they can still
+    // return safely later; whatever they captured is the caller's concern.
+    shutdown_report shutdown(clock::time_point deadline) {
+        workers_ = 0;
+        cancel_all();
+
+        std::vector<std::shared_ptr<task>> tasks;
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            tasks.swap(tasks_);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(done_->m);
+            done_->cv.wait_until(lock, deadline, [&tasks] {
+                for (const auto& t : tasks) {
+                    if (!t->finished.load(std::memory_order_acquire)) return false;
+                }
+                return true;
+            });
+        }
+
+        shutdown_report r;
+        auto now = clock::now();
+        for (auto& t : tasks) {
+            if (!t->thread.joinable()) continue;
+            if (t->finished.load(std::memory_order_acquire)) {
+                t->thread.join();
+                ++r.joined;
+            } else {
+                t->thread.detach();
+                r.abandoned.push_back({t->name, now - t->started});
+            }
+        }
+        return r;
     }
 
 private:
-    std::vector<std::thread> threads_;
-};
+    struct task {
+        std::string         name;
+        clock::time_point   started;
+        cancel_token        token;
+        std::atomic<bool>   finished{false};
+        std::thread         thread;
+    };
+
+    struct completion {
+        std::mutex              m;
+        std::condition_variable cv;
+    };
+
+    struct job_queue {
+        std::mutex              m;
+        std::condition_variable cv;
+        std::deque<task_t>      jobs;
+    };
+
+    // Owns only the shared queue, never the dispatch, so an abandoned worker
+    // cannot touch a destroyed pool.
+    static task_t worker_loop(std::shared_ptr<job_queue> q, int index, std::vector<int> pin, size_t frame_bytes) {
+        return [q, index, pin = std::move(pin), frame_bytes](const cancel_token& tok) {
+            pin_to(pin);
+            execution_context ctx(index, frame_bytes);
+            ctx.frame().prefault();
+            ctx.attach();
+            for (;;) {
+                task_t job;
+                {
+                    std::unique_lock<std::mutex> lock(q->m);
+                    q->cv.wait(lock, [&] { return !q->jobs.empty() || tok.cancelled(); });
+                    if (q->jobs.empty()) break;
+                    job = std::move(q->jobs.front());
+                    q->jobs.pop_front();
+                }
+                // One failing job must not take the worker, and with it the
+                // process, down.
+                try {
+                    job(tok);
+                } catch (const std::exception& e) {
+                    std::cerr << "dispatch: worker-" << index << " job threw: " << e.what() << "\n";
+                } catch (...) {
+                    std::cerr << "dispatch: worker-" << index << " job threw\n";
+                }
+                ctx.frame().reset();
+            }
+            ctx.detach();
+        };
+    }
 
+    mutable std::mutex                  m_;
+    std::vector<std::shared_ptr<task>>  tasks_;
+    std::shared_ptr<completion>         done_;
+    std::shared_ptr<job_queue>          queue_;
+    std::atomic<size_t>                 workers_{0};
 };
 
+// Runs fn(i) for i in [0, count) on the pool, with the calling thread taking
+// items too, so it also works from inside a pool worker. pool may be null.
+// If fn throws, the items not yet started are skipped, every item in flight
+// is waited for (helpers hold fn by reference), and the first exception is
+// rethrown on the calling thread.
+template<typename F>
+void parallel_for(dispatch* pool, size_t count, F&& fn) {
+    size_t helpers = pool ? std::min<size_t>(pool->workers(), count > 0 ? count - 1 : 0) : 0;
+    if (helpers == 0) {
+        for (size_t i = 0; i < count; ++i) fn(i);
+        return;
+    }
+    struct shared {
+        std::atomic<size_t>     next{0};
+        std::atomic<bool>       failed{false};
+        size_t                  done = 0;
+        std::exception_ptr      error;
+        std::mutex              m;
+        std::condition_variable cv;
+    };
+    auto s = std::make_shared<shared>();
+    auto work = [s, count, &fn] {
+        for (size_t i; (i = s->next.fetch_add(1, std::memory_order_relaxed)) < count;) {
+            std::exception_ptr e;
+            if (!s->failed.load(std::memory_order_relaxed)) {
+                try {
+                    fn(i);
+                } catch (...) {
+                    e = std::current_exception();
+                    s->failed.store(true, std::memory_order_relaxed);
+                }
+            }
+            std::lock_guard<std::mutex> lock(s->m);
+            if (e && !s->error) s->error = e;
+            if (++s->done == count) s->cv.notify_all();
+        }
+    };
+    for (size_t h = 0; h < helpers; ++h) {
+        try {
+            // Late helpers find nothing left and return without touching fn.
+            pool->post([work] { work(); });
+        } catch (const std::logic_error&) {
+            break;
+        }
+    }
+    work();
+    std::unique_lock<std::mutex> lock(s->m);
+    s->cv.wait(lock, [&] { return s->done == count; });
+    if (s->error) std::rethrow_exception(s->error);
+}
+
+// Blocks SIGINT/SIGTERM for the calling thread and every thread it spawns
+// afterwards. Call before constructing a dispatch so the signals are only
+// ever consumed by wait_for_shutdown_signal().
+inline void block_shutdown_signals() {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+}
+
+// Parks the calling thread until SIGINT or SIGTERM arrives; returns the signal.
+inline int wait_for_shutdown_signal() {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    int sig = 0;
+    sigwait(&set, &sig);
+    return sig;
+}
+
+};
@@ -0,0 +1,288 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "ipc/ipc.h"
+#include "schema/messages.h"
+
+namespace frame {
+
+// Image layout of one frame. fourcc uses the V4L2 codes (see fourcc()).
+struct format {
+    uint32_t width  = 0;
+    uint32_t height = 0;
+    uint32_t stride = 0;    // bytes per row
+    uint32_t fourcc = 0;
+    uint32_t bytes  = 0;    // payload actually used
+};
+
+constexpr uint32_t fourcc(char a, char b, char c, char d) {
+    return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+}
+
+constexpr uint32_t bgr24 = fourcc('B', 'G', 'R', '3');
+constexpr uint32_t rgb24 = fourcc('R', 'G', 'B', '3');
+constexpr uint32_t grey  = fourcc('G', 'R', 'E', 'Y');
+constexpr uint32_t yuyv  = fourcc('Y', 'U', 'Y', 'V');
+constexpr uint32_t mjpeg = fourcc('M', 'J', 'P', 'G');
+
+inline uint32_t channels_of(uint32_t fcc) {
+    switch (fcc) {
+    case bgr24:
+    case rgb24: return 3;
+    case yuyv:  return 2;
+    case grey:  return 1;
+    default:    return 0;   // compressed or unknown
+    }
+}
+
+class pool;
+
+// A counted reference to one pool slot. The slot goes back to the pool when
+// the last reference, in any process, is dropped. Move-only; share() takes
+// another reference explicitly.
+class frame {
+public:
+    frame() = default;
+
+    frame(frame&& o) noexcept : pool_(std::move(o.pool_)), slot_(o.slot_) {}
+
+    frame& operator=(frame&& o) noexcept {
+        if (this != &o) {
+            reset();
+            pool_ = std::move(o.pool_);
+            slot_ = o.slot_;
+        }
+        return *this;
+    }
+
+    frame(const frame&) = delete;
+    frame& operator=(const frame&) = delete;
+
+    ~frame() { reset(); }
+
+    explicit operator bool() const { return pool_ != nullptr; }
+
+    inline frame share() const;
+    inline void  reset();
+
+    inline uint8_t*         data() const;
+    inline size_t           capacity() const;
+    inline const format&    layout() const;
+    inline uint64_t         seq() const;
+    inline uint64_t         timestamp_ns() const;
+    uint32_t                slot() const { return slot_; }
+
+    // Producer side: describes what was written and publishes the slot;
+    // until then open() refuses it.
+    inline void set(const format& f, uint64_t timestamp_ns);
+
+    // What goes on the bus or through a ring instead of the pixels.
+    inline schema::frame_descriptor descriptor() const;
+
+private:
+    friend class pool;
+
+    frame(std::shared_ptr<pool> p, uint32_t slot) : pool_(std::move(p)), slot_(slot) {}
+
+    std::shared_ptr<pool>   pool_;
+    uint32_t                slot_ = 0;
+};
+
+// Fixed set of equally sized frame slots in a shared-memory segment (or in
+// process memory), reference counted in place. Producers acquire() a free
+// slot, fill it and publish its descriptor; consumers in any process turn the
+// descriptor back into a frame with open(), which fails cleanly if the slot
+// has been recycled since. Nothing is copied. Frames keep their pool alive.
+//
+// A process that dies holding references leaks those slots until the
+// segment is recreated. create() refuses a name that already exists; call
+// ipc::segment::remove() on it once its creator is known to be gone.
+class pool : public std::enable_shared_from_this<pool> {
+public:
+    static constexpr uint32_t magic     = 0x46504f4c;    // "FPOL"
+    static constexpr size_t   alignment = 4096;
+    static constexpr uint32_t writing   = 0x80000000u;   // refs flag: producer still filling
+
+    static std::shared_ptr<pool> create(const std::string& name, uint32_t slots, size_t slot_bytes) {
+        auto seg = std::make_unique<ipc::segment>(ipc::segment::create(name, bytes_for(slots, slot_bytes)));
+        std::shared_ptr<pool> p(new pool(std::move(seg)));
+        p->format(slots, slot_bytes);
+        return p;
+    }
+
+    static std::shared_ptr<pool> open(const std::string& name) {
+        auto seg = std::make_unique<ipc::segment>(ipc::segment::open(name));
+        std::shared_ptr<pool> p(new pool(std::move(seg)));
+        if (p->h_->magic.load(std::memory_order_acquire) != magic) throw std::runtime_error("frame: '" + name + "' is not a frame pool");
+        return p;
+    }
+
+    // Process-local pool, for single-process pipelines and tests.
+    static std::shared_ptr<pool> local(uint32_t slots, size_t slot_bytes) {
+        std::shared_ptr<pool> p(new pool(nullptr));
+        p->own_ = std::unique_ptr<std::byte[]>(new std::byte[bytes_for(slots, slot_bytes) + alignment]);
+        void* base = p->own_.get();
+        size_t space = bytes_for(slots, slot_bytes) + alignment;
+        p->h_ = static_cast<header*>(std::align(alignment, bytes_for(slots, slot_bytes), base, space));
+        p->format(slots, slot_bytes);
+        return p;
+    }
+
+    pool(const pool&) = delete;
+    pool& operator=(const pool&) = delete;
+
+    static size_t bytes_for(uint32_t slots, size_t slot_bytes) {
+        return round(sizeof(header) + slots * sizeof(slot_meta)) + slots * round(slot_bytes);
+    }
+
+    // A free slot with one reference, or an empty frame if all are in use.
+    frame acquire() {
+        uint32_t n = h_->slots;
+        uint32_t start = h_->cursor.fetch_add(1, std::memory_order_relaxed);
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t s = (start + i) % n;
+            uint32_t zero = 0;
+            if (meta(s).refs.compare_exchange_strong(zero, writing | 1, std::memory_order_acquire)) {
+                meta(s).seq.store(h_->next_seq.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                meta(s).layout = {};
+                return frame(shared_from_this(), s);
+            }
+        }
+        h_->exhausted.fetch_add(1, std::memory_order_relaxed);
+        return {};
+    }
+
+    // Takes a reference on the slot a descriptor points at, if it still
+    // holds that frame.
+    frame open(const schema::frame_descriptor& d) {
+        if (d.slot >= h_->slots) return {};
+        auto& m = meta(d.slot);
+        uint32_t refs = m.refs.load(std::memory_order_relaxed);
+        do {
+            if (refs == 0 || (refs & writing)) return {};
+        } while (!m.refs.compare_exchange_weak(refs, refs + 1, std::memory_order_acquire));
+        if (m.seq.load(std::memory_order_relaxed) != d.seq) {
+            release(d.slot);
+            return {};
+        }
+        return frame(shared_from_this(), d.slot);
+    }
+
+    uint32_t slots()      const { return h_->slots; }
+    size_t   slot_bytes() const { return h_->slot_bytes; }
+    uint64_t exhausted()  const { return h_->exhausted.load(std::memory_order_relaxed); }
+
+    uint32_t in_use() const {
+        uint32_t n = 0;
+        for (uint32_t s = 0; s < h_->slots; ++s) n += (meta(s).refs.load(std::memory_order_relaxed) & ~writing) != 0;
+        return n;
+    }
+
+private:
+    friend class frame;
+
+    struct header {
+        std::atomic<uint32_t>   magic{0};
+        uint32_t                slots      = 0;
+        uint64_t                slot_bytes = 0;
+        uint64_t                data_offset = 0;
+        std::atomic<uint64_t>   next_seq{0};
+        std::atomic<uint64_t>   exhausted{0};
+        alignas(dispatch::cache_line) std::atomic<uint32_t> cursor{0};
+    };
+
+    struct alignas(dispatch::cache_line) slot_meta {
+        std::atomic<uint32_t>   refs{0};
+        std::atomic<uint64_t>   seq{0};
+        uint64_t                timestamp_ns = 0;
+        ::frame::format         layout;
+    };
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+                  "frame: pools need address-free atomics");
+
+    explicit pool(std::unique_ptr<ipc::segment> seg) : seg_(std::move(seg)) {
+        if (seg_) h_ = static_cast<header*>(seg_->data());
+    }
+
+    static size_t round(size_t n) { return (n + alignment - 1) & ~(alignment - 1); }
+
+    void format(uint32_t slots, size_t slot_bytes) {
+        auto* h = new (h_) header();
+        h->slots       = slots;
+        h->slot_bytes  = round(slot_bytes);
+        h->data_offset = round(sizeof(header) + slots * sizeof(slot_meta));
+        for (uint32_t s = 0; s < slots; ++s) new (&meta(s)) slot_meta();
+        h->magic.store(magic, std::memory_order_release);
+    }
+
+    slot_meta& meta(uint32_t s) const {
+        return reinterpret_cast<slot_meta*>(reinterpret_cast<std::byte*>(h_) + sizeof(header))[s];
+    }
+
+    uint8_t* data(uint32_t s) const {
+        return reinterpret_cast<uint8_t*>(h_) + h_->data_offset + s * h_->slot_bytes;
+    }
+
+    void retain(uint32_t s) { meta(s).refs.fetch_add(1, std::memory_order_relaxed); }
+
+    void release(uint32_t s) {
+        uint32_t old = meta(s).refs.fetch_sub(1, std::memory_order_acq_rel);
+        // Dropped before ever being published: nobody else can hold it.
+        if (old == (writing | 1)) meta(s).refs.fetch_and(~writing, std::memory_order_release);
+    }
+
+    void publish(uint32_t s) { meta(s).refs.fetch_and(~writing, std::memory_order_release); }
+
+    std::unique_ptr<ipc::segment>   seg_;
+    std::unique_ptr<std::byte[]>    own_;
+    header*                         h_ = nullptr;
+};
+
+inline frame frame::share() const {
+    if (!pool_) return {};
+    pool_->retain(slot_);
+    return frame(pool_, slot_);
+}
+
+inline void frame::reset() {
+    if (pool_) pool_->release(slot_);
+    pool_.reset();
+}
+
+inline uint8_t*         frame::data()         const { return pool_->data(slot_); }
+inline size_t           frame::capacity()     const { return pool_->h_->slot_bytes; }
+inline const format&    frame::layout()       const { return pool_->meta(slot_).layout; }
+inline uint64_t         frame::seq()          const { return pool_->meta(slot_).seq.load(std::memory_order_acquire); }
+inline uint64_t         frame::timestamp_ns() const { return pool_->meta(slot_).timestamp_ns; }
+
+inline void frame::set(const format& f, uint64_t timestamp_ns) {
+    auto& m = pool_->meta(slot_);
+    m.layout       = f;
+    m.timestamp_ns = timestamp_ns;
+    pool_->publish(slot_);
+}
+
+inline schema::frame_descriptor frame::descriptor() const {
+    schema::frame_descriptor d;
+    const format& f = layout();
+    d.seq          = seq();
+    d.timestamp_ns = timestamp_ns();
+    d.slot         = slot_;
+    d.fourcc       = f.fourcc;
+    d.width        = f.width;
+    d.height       = f.height;
+    d.stride       = f.stride;
+    d.bytes        = f.bytes;
+    return d;
+}
+
+};
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <utility>
+
+namespace fsm {
+
+// State and event enums must end with a `count` enumerator.
+template<typename E>
+constexpr size_t count_of = static_cast<size_t>(E::count);
+
+template<typename E>
+constexpr size_t index(E e) { return static_cast<size_t>(e); }
+
+// Allowed-transition matrix: row i is a bitset of states reachable from state
+// i in one step. Built and queried entirely at compile time.
+template<typename State>
+class table {
+public:
+    static constexpr size_t states = count_of<State>;
+    static_assert(states > 0 && states <= 64, "fsm::table supports 1..64 states");
+
+    constexpr table& allow(State from, State to) {
+        rows_[index(from)] |= bit(to);
+        return *this;
+    }
+
+    constexpr table& allow(State from, std::initializer_list<State> to) {
+        for (State s : to) allow(from, s);
+        return *this;
+    }
+
+    // Every state may move to every state, as most of main.py's tables do.
+    constexpr table& allow_all() {
+        for (size_t i = 0; i < states; ++i) rows_[i] = all();
+        return *this;
+    }
+
+    constexpr bool allowed(State from, State to) const {
+        return (rows_[index(from)] & bit(to)) != 0;
+    }
+
+    constexpr uint64_t row(State from) const { return rows_[index(from)]; }
+
+    // Fixed-point closure of the rows from initial.
+    constexpr uint64_t reachable(State initial) const {
+        uint64_t seen = bit(initial), grown = 0;
+        while (grown != seen) {
+            grown = seen;
+            for (size_t i = 0; i < states; ++i) {
+                if (seen & (uint64_t(1) << i)) seen |= rows_[i];
+            }
+        }
+        return seen;
+    }
+
+    constexpr uint64_t unreachable(State initial) const {
+        return all() & ~reachable(initial);
+    }
+
+private:
+    static constexpr uint64_t bit(State s) { return uint64_t(1) << index(s); }
+
+    static constexpr uint64_t all() {
+        return states == 64 ? ~uint64_t(0) : (uint64_t(1) << states) - 1;
+    }
+
+    std::array<uint64_t, states> rows_{};
+};
+
+// (state, event) -> next state. Unlisted pairs reject the event.
+template<typename State, typename Event>
+class event_table {
+public:
+    static constexpr size_t  states = count_of<State>;
+    static constexpr size_t  events = count_of<Event>;
+    static constexpr uint8_t none   = 0xFF;
+
+    constexpr event_table() {
+        for (auto& r : next_) {
+            for (auto& n : r) n = none;
+        }
+    }
+
+    constexpr event_table& on(State from, Event e, State to) {
+        next_[index(from)][index(e)] = static_cast<uint8_t>(index(to));
+        return *this;
+    }
+
+    // The same event from every state.
+    constexpr event_table& on(Event e, State to) {
+        for (size_t i = 0; i < states; ++i) next_[i][index(e)] = static_cast<uint8_t>(index(to));
+        return *this;
+    }
+
+    constexpr bool handles(State from, Event e) const { return next_[index(from)][index(e)] != none; }
+    constexpr State next(State from, Event e) const { return static_cast<State>(next_[index(from)][index(e)]); }
+
+    // True if every edge the events can take is also in t.
+    constexpr bool within(const table<State>& t) const {
+        for (size_t i = 0; i < states; ++i) {
+            for (size_t e = 0; e < events; ++e) {
+                if (next_[i][e] != none && !t.allowed(static_cast<State>(i), static_cast<State>(next_[i][e]))) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    std::array<std::array<uint8_t, count_of<Event>>, count_of<State>> next_{};
+};
+
+// CRTP state machine over a Spec that provides:
+//
+//   enum class state { ..., count };
+//   static constexpr state initial;
+//   static constexpr fsm::table<state> transitions;
+//   (optional) enum class event { ..., count };
+//   (optional) static constexpr fsm::event_table<state, event> events;
+//
+// Derived may shadow on_enter<S>(), on_exit<S>() and on_failed(from, to).
+// Hooks are resolved at compile time; a transition check is one bit test.
+template<typename Derived, typename Spec>
+class machine {
+public:
+    using state_t = typename Spec::state;
+
+    static constexpr const table<state_t>& transitions = Spec::transitions;
+    static constexpr uint64_t dead_states = Spec::transitions.unreachable(Spec::initial);
+
+    static_assert(dead_states == 0, "fsm: transition table has states unreachable from initial");
+
+    machine() = default;
+
+    state_t current() const { return current_; }
+
+    static constexpr bool allowed(state_t from, state_t to) { return transitions.allowed(from, to); }
+
+    // Equivalent of SimpleFsm.requestUpdate.
+    bool request(state_t to) {
+        if (!transitions.allowed(current_, to)) {
+            derived().on_failed(current_, to);
+            return false;
+        }
+        exit(current_, std::make_index_sequence<table<state_t>::states>{});
+        enter(to, std::make_index_sequence<table<state_t>::states>{});
+        current_ = to;
+        return true;
+    }
+
+    template<typename Event>
+    bool fire(Event e) {
+        static_assert(Spec::events.within(Spec::transitions), "fsm: an event edge is missing from the transition table");
+        if (!Spec::events.handles(current_, e)) {
+            derived().on_failed(current_, current_);
+            return false;
+        }
+        return request(Spec::events.next(current_, e));
+    }
+
+    template<state_t S> void on_enter() {}
+    template<state_t S> void on_exit() {}
+    void on_failed(state_t, state_t) {}
+
+private:
+    Derived& derived() { return static_cast<Derived&>(*this); }
+
+    template<size_t... I>
+    void enter(state_t s, std::index_sequence<I...>) {
+        ((index(s) == I ? (derived().template on_enter<static_cast<state_t>(I)>(), 0) : 0), ...);
+    }
+
+    template<size_t... I>
+    void exit(state_t s, std::index_sequence<I...>) {
+        ((index(s) == I ? (derived().template on_exit<static_cast<state_t>(I)>(), 0) : 0), ...);
+    }
+
+    state_t current_ = Spec::initial;
+};
+
+};
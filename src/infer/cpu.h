@@ -0,0 +1,604 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "dispatch/dispatch.h"
+#include "frame/frame.h"
+#include "infer/kernels.h"
+#include "vision/letterbox.h"
+#include "vision/yolo.h"
+
+namespace infer {
+
+// CPU inference for the detector graph, as a fallback when there is no NPU
+// and as a reference that runs anywhere.
+//
+// Activations are float NHWC. Each convolution quantizes its input to int8
+// with one per-tensor scale, convolves directly against int8 weights with
+// per-channel scales (no im2col buffer; four output channels share every
+// input load) and applies bias, SiLU and any residual add while writing its
+// output. At load time:
+//
+//  - a conv whose output only feeds an add gets the add folded into it;
+//  - concat inputs are written straight into their slice of the concat
+//    output, so most concats never run;
+//  - every tensor gets a fixed offset in one arena, reusing memory between
+//    tensors whose lifetimes do not overlap.
+//
+// Models come from playground/vision/exportCpuModel.py. File layout, all
+// little-endian:
+//
+//   "RBNN" u32 version(1)
+//   u32 tensors, then per tensor u32 h, w, c         tensor 0 is the input
+//   u32 nodes, then per node:
+//     u8 op, u8 activation, u16 0, u32 inputs, u32 input[inputs], u32 output
+//     conv:    u32 k, stride, pad, f32 scale[cout], f32 bias[cout], i8 weight[cout][k][k][cin]
+//     maxpool: u32 k, stride, pad
+//   u32 outputs, u32 output[outputs]                 detection heads, NCHW order
+
+enum class op : uint8_t { conv = 0, add = 1, concat = 2, upsample = 3, maxpool = 4 };
+
+enum class activation : uint8_t { none = 0, silu = 1 };
+
+struct shape {
+    uint32_t h = 0, w = 0, c = 0;
+
+    size_t pixels() const { return size_t(h) * w; }
+    size_t size() const { return pixels() * c; }
+};
+
+struct node {
+    op                      kind = op::conv;
+    activation              act  = activation::none;
+    std::vector<uint32_t>   in;
+    uint32_t                out = 0;
+    uint32_t                k = 1, stride = 1, pad = 0;
+
+    // conv: weights packed [cout / 4][k * k][4][cin_padded], zero-filled.
+    size_t                  cin_padded = 0;
+    std::vector<int8_t>     weights;
+    std::vector<float>      scale;
+    std::vector<float>      bias;
+};
+
+class model {
+public:
+    bool load(const std::string& path) {
+        std::ifstream f(path, std::ios::binary);
+        if (!f) return false;
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+        return parse(data.data(), data.size());
+    }
+
+    // False if the data is not a well-formed model.
+    bool parse(const uint8_t* data, size_t size) {
+        tensors_.clear();
+        nodes_.clear();
+        outputs_.clear();
+        reader r{data, data + size};
+        if (size < 8 || std::memcmp(data, "RBNN", 4) != 0) return false;
+        r.p += 4;
+        if (r.u32() != 1) return false;
+
+        uint32_t count = r.u32();
+        if (!r.ok || count == 0 || count > (1u << 16) || r.left() < size_t(count) * 12) return false;
+        tensors_.resize(count);
+        uint64_t total = 0;
+        for (shape& s : tensors_) {
+            s.h = r.u32();
+            s.w = r.u32();
+            s.c = r.u32();
+            if (!s.h || !s.w || !s.c || s.h > max_side || s.w > max_side || s.c > max_channels) return false;
+            uint64_t elems = uint64_t(s.h) * s.w * s.c;
+            if (elems > max_tensor || (total += elems) > max_total) return false;
+        }
+
+        count = r.u32();
+        if (!r.ok || count > (1u << 16)) return false;
+        std::vector<bool> defined(tensors_.size(), false);
+        defined[0] = true;
+        for (uint32_t i = 0; i < count && r.ok; ++i) {
+            node n;
+            n.kind = static_cast<op>(r.u8());
+            n.act  = static_cast<activation>(r.u8());
+            r.skip(2);
+            uint32_t inputs = r.u32();
+            if (!r.ok || inputs == 0 || inputs > 64) return false;
+            for (uint32_t k = 0; k < inputs; ++k) {
+                uint32_t t = r.u32();
+                if (t >= tensors_.size() || !defined[t]) return false;
+                n.in.push_back(t);
+            }
+            n.out = r.u32();
+            if (!r.ok || n.out >= tensors_.size() || defined[n.out]) return false;
+            defined[n.out] = true;
+            if (n.kind == op::conv || n.kind == op::maxpool) {
+                n.k      = r.u32();
+                n.stride = r.u32();
+                n.pad    = r.u32();
+                if (!n.k || !n.stride || n.k > 15 || n.stride > 15 || n.pad > 15) return false;
+            }
+            if (n.kind == op::conv && !read_conv(r, n)) return false;
+            if (!r.ok || !check(n)) return false;
+            nodes_.push_back(std::move(n));
+        }
+
+        count = r.u32();
+        if (!r.ok || count == 0) return false;
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t t = r.u32();
+            if (t >= tensors_.size() || !defined[t]) return false;
+            outputs_.push_back(t);
+        }
+        return r.ok;
+    }
+
+    const shape&                    input() const { return tensors_[0]; }
+    const std::vector<shape>&       tensors() const { return tensors_; }
+    const std::vector<node>&        nodes() const { return nodes_; }
+    const std::vector<uint32_t>&    outputs() const { return outputs_; }
+
+private:
+    // Bounds on what a file may declare, far above any detector, so a corrupt
+    // header fails here instead of in an allocation.
+    static constexpr uint32_t max_side     = 1u << 14;
+    static constexpr uint32_t max_channels = 1u << 14;
+    static constexpr uint64_t max_tensor   = uint64_t(1) << 26;     // elements
+    static constexpr uint64_t max_total    = uint64_t(1) << 28;
+
+    struct reader {
+        const uint8_t*  p;
+        const uint8_t*  end;
+        bool            ok = true;
+
+        bool take(void* dst, size_t n) {
+            if (!ok || size_t(end - p) < n) return ok = false;
+            std::memcpy(dst, p, n);
+            p += n;
+            return true;
+        }
+        uint8_t  u8()  { uint8_t v = 0; take(&v, 1); return v; }
+        uint32_t u32() { uint8_t b[4] = {}; take(b, 4); return uint32_t(b[0]) | uint32_t(b[1]) << 8 | uint32_t(b[2]) << 16 | uint32_t(b[3]) << 24; }
+        void     skip(size_t n) { if (size_t(end - p) < n) ok = false; else p += n; }
+        size_t   left() const { return size_t(end - p); }
+    };
+
+    bool read_conv(reader& r, node& n) {
+        const shape& in  = tensors_[n.in[0]];
+        const shape& out = tensors_[n.out];
+        size_t cout = out.c, cin = in.c, taps = size_t(n.k) * n.k;
+        size_t groups = (cout + 3) / 4;
+        if (r.left() < cout * 8 || r.left() - cout * 8 < uint64_t(cout) * taps * cin) return r.ok = false;
+        n.cin_padded = pad_lanes(cin);
+        n.scale.assign(groups * 4, 0.0f);
+        n.bias.assign(groups * 4, 0.0f);
+        if (!r.take(n.scale.data(), cout * 4) || !r.take(n.bias.data(), cout * 4)) return false;
+        n.weights.assign(groups * taps * 4 * n.cin_padded, 0);
+        for (size_t co = 0; co < cout; ++co) {
+            for (size_t t = 0; t < taps; ++t) {
+                int8_t* dst = n.weights.data() + ((co / 4 * taps + t) * 4 + co % 4) * n.cin_padded;
+                std::memcpy(dst, r.p, cin);
+                for (size_t c = 0; c < cin; ++c) dst[c] = std::max<int8_t>(dst[c], -127);
+                r.p += cin;
+            }
+        }
+        return true;
+    }
+
+    // Output shape must follow from the inputs.
+    bool check(const node& n) const {
+        const shape& a = tensors_[n.in[0]];
+        const shape& o = tensors_[n.out];
+        switch (n.kind) {
+        case op::conv:
+        case op::maxpool: {
+            if (a.h + 2 * n.pad < n.k || a.w + 2 * n.pad < n.k) return false;
+            uint32_t h = (a.h + 2 * n.pad - n.k) / n.stride + 1;
+            uint32_t w = (a.w + 2 * n.pad - n.k) / n.stride + 1;
+            return n.in.size() == 1 && o.h == h && o.w == w && (n.kind == op::conv || o.c == a.c);
+        }
+        case op::add:
+            return n.in.size() == 2 && tensors_[n.in[1]].size() == a.size() && o.size() == a.size() && o.c == a.c;
+        case op::concat: {
+            uint32_t c = 0;
+            for (uint32_t t : n.in) {
+                if (tensors_[t].h != o.h || tensors_[t].w != o.w) return false;
+                c += tensors_[t].c;
+            }
+            return c == o.c;
+        }
+        case op::upsample:
+            return n.in.size() == 1 && o.c == a.c && o.h % a.h == 0 && o.w % a.w == 0 && o.h / a.h == o.w / a.w;
+        }
+        return false;
+    }
+
+    std::vector<shape>      tensors_;
+    std::vector<node>       nodes_;
+    std::vector<uint32_t>   outputs_;
+};
+
+// Runs one model. The arena and scratch are sized once, here; run() never
+// allocates. Not thread-safe; use one engine per inference thread.
+class engine {
+public:
+    explicit engine(const model& m, dispatch::dispatch* pool = nullptr) : m_(m), pool_(pool) {
+        plan();
+    }
+
+    engine(const engine&) = delete;
+    engine& operator=(const engine&) = delete;
+
+    // NHWC float input, model().input() sized.
+    float*          input() { return arena_.data() + views_[0].offset; }
+    const model&    source() const { return m_; }
+    size_t          arena_bytes() const { return arena_.size() * sizeof(float) + quant_.size(); }
+
+    void run() {
+        for (const step& s : steps_) {
+            switch (s.n->kind) {
+            case op::conv:      conv(s); break;
+            case op::add:       add(s); break;
+            case op::concat:    concat(s); break;
+            case op::upsample:  upsample(s); break;
+            case op::maxpool:   maxpool(s); break;
+            }
+        }
+        for (size_t i = 0; i < heads_.size(); ++i) {
+            const view& v = views_[m_.outputs()[i]];
+            const shape& s = m_.tensors()[m_.outputs()[i]];
+            float* dst = heads_[i].data();
+            const float* src = arena_.data() + v.offset;
+            for (size_t p = 0; p < s.pixels(); ++p) {
+                for (size_t c = 0; c < s.c; ++c) dst[c * s.pixels() + p] = src[p * v.stride + c];
+            }
+        }
+    }
+
+    size_t outputs() const { return heads_.size(); }
+
+    // Output i as an NCHW head for vision::yolo_decoder.
+    vision::head_tensor output(size_t i) const {
+        const shape& s = m_.tensors()[m_.outputs()[i]];
+        return {heads_[i].data(), s.c, s.w, s.h, vision::element::f32, 1.0f, 0};
+    }
+
+private:
+    // Where a tensor lives: floats from the arena start, pixel stride in floats.
+    struct view {
+        size_t      offset = 0;
+        size_t      stride = 0;
+        int32_t     parent = -1;    // concat output this tensor is a slice of
+        uint32_t    channel = 0;    // first channel within parent
+    };
+
+    struct step {
+        const node* n;
+        uint32_t    out;
+        int32_t     residual = -1;
+    };
+
+    void plan() {
+        const auto& nodes = m_.nodes();
+        const auto& tensors = m_.tensors();
+        std::vector<size_t> uses(tensors.size(), 0);
+        std::vector<int32_t> producer(tensors.size(), -1);
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            producer[nodes[i].out] = static_cast<int32_t>(i);
+            for (uint32_t t : nodes[i].in) ++uses[t];
+        }
+        std::vector<bool> is_output(tensors.size(), false);
+        for (uint32_t t : m_.outputs()) is_output[t] = true;
+
+        // Fold an add into the conv that feeds it when that is the conv's
+        // only consumer and the other operand already exists.
+        std::vector<int32_t> fused_into(nodes.size(), -1);
+        std::vector<int32_t> residual(nodes.size(), -1);
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const node& a = nodes[i];
+            if (a.kind != op::add) continue;
+            for (int side = 0; side < 2; ++side) {
+                uint32_t t = a.in[side], other = a.in[1 - side];
+                int32_t p = producer[t];
+                if (p < 0 || nodes[p].kind != op::conv || uses[t] != 1 || is_output[t] || residual[p] >= 0) continue;
+                if (producer[other] >= p || t == other) continue;
+                residual[p] = static_cast<int32_t>(other);
+                fused_into[i] = p;
+                break;
+            }
+        }
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (fused_into[i] >= 0) continue;
+            step s{&nodes[i], nodes[i].out, residual[i]};
+            for (size_t j = 0; j < nodes.size(); ++j) {
+                if (fused_into[j] == static_cast<int32_t>(i)) s.out = nodes[j].out;
+            }
+            steps_.push_back(s);
+        }
+
+        // Concat inputs become slices of the concat output where possible.
+        views_.assign(tensors.size(), {});
+        std::vector<int32_t> def(tensors.size(), -1);
+        for (size_t i = 0; i < steps_.size(); ++i) def[steps_[i].out] = static_cast<int32_t>(i);
+        def[0] = 0;
+        for (const step& s : steps_) {
+            if (s.n->kind != op::concat) continue;
+            uint32_t channel = 0;
+            for (uint32_t t : s.n->in) {
+                bool once = std::count(s.n->in.begin(), s.n->in.end(), t) == 1;
+                if (t != 0 && def[t] >= 0 && views_[t].parent < 0 && !is_output[t] && once) {
+                    views_[t].parent  = static_cast<int32_t>(s.out);
+                    views_[t].channel = channel;
+                }
+                channel += tensors[t].c;
+            }
+        }
+        auto root = [&](uint32_t t) {
+            while (views_[t].parent >= 0) t = static_cast<uint32_t>(views_[t].parent);
+            return t;
+        };
+
+        // Lifetimes in steps, per root tensor.
+        size_t last = steps_.size();
+        std::vector<size_t> begin(tensors.size(), last), end(tensors.size(), 0);
+        auto touch = [&](uint32_t t, size_t at) {
+            uint32_t r = root(t);
+            begin[r] = std::min(begin[r], at);
+            end[r]   = std::max(end[r], at);
+        };
+        touch(0, 0);
+        for (size_t i = 0; i < steps_.size(); ++i) {
+            touch(steps_[i].out, i);
+            for (uint32_t t : steps_[i].n->in) touch(t, i);
+            if (steps_[i].residual >= 0) touch(static_cast<uint32_t>(steps_[i].residual), i);
+        }
+        for (uint32_t t : m_.outputs()) touch(t, last);
+
+        // First fit, largest tensors first.
+        std::vector<uint32_t> roots;
+        for (uint32_t t = 0; t < tensors.size(); ++t) {
+            if (views_[t].parent < 0 && begin[t] <= end[t]) roots.push_back(t);
+        }
+        std::sort(roots.begin(), roots.end(), [&](uint32_t a, uint32_t b) { return tensors[a].size() > tensors[b].size(); });
+        std::vector<uint32_t> placed;
+        size_t total = 0;
+        for (uint32_t t : roots) {
+            size_t need = (tensors[t].size() + 15) / 16 * 16;
+            size_t at = 0;
+            for (bool moved = true; moved;) {
+                moved = false;
+                for (uint32_t o : placed) {
+                    bool live = begin[o] <= end[t] && begin[t] <= end[o];
+                    size_t ob = views_[o].offset, oe = ob + (tensors[o].size() + 15) / 16 * 16;
+                    if (live && at < oe && ob < at + need) {
+                        at = oe;
+                        moved = true;
+                    }
+                }
+            }
+            views_[t].offset = at;
+            views_[t].stride = tensors[t].c;
+            placed.push_back(t);
+            total = std::max(total, at + need);
+        }
+        for (uint32_t t = 0; t < tensors.size(); ++t) {
+            if (views_[t].parent < 0) continue;
+            uint32_t r = root(t);
+            size_t channel = 0;
+            for (uint32_t u = t; u != r; u = static_cast<uint32_t>(views_[u].parent)) channel += views_[u].channel;
+            views_[t].offset = views_[r].offset + channel;
+            views_[t].stride = tensors[r].c;
+        }
+        arena_.assign(total, 0.0f);
+
+        size_t scratch = 0;
+        for (const step& s : steps_) {
+            if (s.n->kind == op::conv) scratch = std::max(scratch, tensors[s.n->in[0]].pixels() * s.n->cin_padded);
+        }
+        quant_.assign(scratch + lanes, 0);
+
+        for (uint32_t t : m_.outputs()) heads_.emplace_back(tensors[t].size());
+    }
+
+    float* at(uint32_t t) { return arena_.data() + views_[t].offset; }
+
+    void conv(const step& s) {
+        const node& n = *s.n;
+        const shape& is = m_.tensors()[n.in[0]];
+        const shape& os = m_.tensors()[s.out];
+        const view& iv = views_[n.in[0]];
+        const view& ov = views_[s.out];
+        const float* src = at(n.in[0]);
+        float* dst = at(s.out);
+        const float* res = s.residual >= 0 ? at(static_cast<uint32_t>(s.residual)) : nullptr;
+        size_t rstride = s.residual >= 0 ? views_[s.residual].stride : 0;
+
+        float m = abs_max(src, is.pixels(), is.c, iv.stride);
+        float in_scale = m > 0 ? m / 127.0f : 0.0f;
+        float inv = m > 0 ? 127.0f / m : 0.0f;
+        size_t cinp = n.cin_padded;
+        int8_t* q = quant_.data();
+        for (size_t p = 0; p < is.pixels(); ++p) quantize(src + p * iv.stride, is.c, inv, q + p * cinp, cinp);
+
+        size_t taps = size_t(n.k) * n.k, groups = (os.c + 3) / 4;
+        size_t bands = pool_ ? std::min<size_t>(os.h, pool_->workers() + 1) : 1;
+        dispatch::parallel_for(pool_, bands, [&](size_t b) {
+            uint32_t y0 = static_cast<uint32_t>(os.h * b / bands), y1 = static_cast<uint32_t>(os.h * (b + 1) / bands);
+            for (uint32_t oy = y0; oy < y1; ++oy) {
+                for (uint32_t ox = 0; ox < os.w; ++ox) {
+                    int32_t iy0 = int32_t(oy * n.stride) - int32_t(n.pad);
+                    int32_t ix0 = int32_t(ox * n.stride) - int32_t(n.pad);
+                    size_t pixel = size_t(oy) * os.w + ox;
+                    float* out = dst + pixel * ov.stride;
+                    const float* r = res ? res + pixel * rstride : nullptr;
+                    for (size_t g = 0; g < groups; ++g) {
+                        int32_t acc[4] = {};
+                        const int8_t* wg = n.weights.data() + g * taps * 4 * cinp;
+                        for (uint32_t ky = 0; ky < n.k; ++ky) {
+                            int32_t iy = iy0 + int32_t(ky);
+                            if (iy < 0 || iy >= int32_t(is.h)) continue;
+                            for (uint32_t kx = 0; kx < n.k; ++kx) {
+                                int32_t ix = ix0 + int32_t(kx);
+                                if (ix < 0 || ix >= int32_t(is.w)) continue;
+                                const int8_t* x = q + (size_t(iy) * is.w + size_t(ix)) * cinp;
+                                dot4(x, wg + (size_t(ky) * n.k + kx) * 4 * cinp, cinp, acc);
+                            }
+                        }
+                        for (size_t k = 0; k < 4 && g * 4 + k < os.c; ++k) {
+                            size_t c = g * 4 + k;
+                            float v = float(acc[k]) * in_scale * n.scale[c] + n.bias[c];
+                            if (n.act == activation::silu) v = silu(v);
+                            if (r) v += r[c];
+                            out[c] = v;
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    void add(const step& s) {
+        const shape& sh = m_.tensors()[s.out];
+        const view& a = views_[s.n->in[0]];
+        const view& b = views_[s.n->in[1]];
+        const view& o = views_[s.out];
+        const float* pa = at(s.n->in[0]);
+        const float* pb = at(s.n->in[1]);
+        float* po = at(s.out);
+        for (size_t p = 0; p < sh.pixels(); ++p) {
+            for (size_t c = 0; c < sh.c; ++c) po[p * o.stride + c] = pa[p * a.stride + c] + pb[p * b.stride + c];
+        }
+    }
+
+    // Copies only the inputs that could not be written in place.
+    void concat(const step& s) {
+        const shape& sh = m_.tensors()[s.out];
+        const view& o = views_[s.out];
+        float* po = at(s.out);
+        uint32_t channel = 0;
+        for (uint32_t t : s.n->in) {
+            uint32_t c = m_.tensors()[t].c;
+            if (views_[t].parent != static_cast<int32_t>(s.out)) {
+                const float* pi = at(t);
+                size_t is = views_[t].stride;
+                for (size_t p = 0; p < sh.pixels(); ++p) std::memcpy(po + p * o.stride + channel, pi + p * is, c * sizeof(float));
+            }
+            channel += c;
+        }
+    }
+
+    void upsample(const step& s) {
+        const shape& is = m_.tensors()[s.n->in[0]];
+        const shape& os = m_.tensors()[s.out];
+        const view& iv = views_[s.n->in[0]];
+        const view& ov = views_[s.out];
+        const float* pi = at(s.n->in[0]);
+        float* po = at(s.out);
+        uint32_t f = os.h / is.h;
+        for (uint32_t y = 0; y < os.h; ++y) {
+            for (uint32_t x = 0; x < os.w; ++x) {
+                std::memcpy(po + (size_t(y) * os.w + x) * ov.stride, pi + (size_t(y / f) * is.w + x / f) * iv.stride, os.c * sizeof(float));
+            }
+        }
+    }
+
+    void maxpool(const step& s) {
+        const node& n = *s.n;
+        const shape& is = m_.tensors()[n.in[0]];
+        const shape& os = m_.tensors()[s.out];
+        const view& iv = views_[n.in[0]];
+        const view& ov = views_[s.out];
+        const float* pi = at(n.in[0]);
+        float* po = at(s.out);
+        size_t bands = pool_ ? std::min<size_t>(os.h, pool_->workers() + 1) : 1;
+        dispatch::parallel_for(pool_, bands, [&](size_t b) {
+            uint32_t y0 = static_cast<uint32_t>(os.h * b / bands), y1 = static_cast<uint32_t>(os.h * (b + 1) / bands);
+            for (uint32_t oy = y0; oy < y1; ++oy) {
+                for (uint32_t ox = 0; ox < os.w; ++ox) {
+                    float* out = po + (size_t(oy) * os.w + ox) * ov.stride;
+                    std::fill(out, out + os.c, -std::numeric_limits<float>::infinity());
+                    for (uint32_t ky = 0; ky < n.k; ++ky) {
+                        int32_t iy = int32_t(oy * n.stride + ky) - int32_t(n.pad);
+                        if (iy < 0 || iy >= int32_t(is.h)) continue;
+                        for (uint32_t kx = 0; kx < n.k; ++kx) {
+                            int32_t ix = int32_t(ox * n.stride + kx) - int32_t(n.pad);
+                            if (ix < 0 || ix >= int32_t(is.w)) continue;
+                            const float* in = pi + (size_t(iy) * is.w + size_t(ix)) * iv.stride;
+                            for (size_t c = 0; c < os.c; ++c) out[c] = std::max(out[c], in[c]);
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    const model&                    m_;
+    dispatch::dispatch*             pool_;
+    std::vector<step>               steps_;
+    std::vector<view>               views_;
+    std::vector<float>              arena_;
+    std::vector<int8_t>             quant_;
+    std::vector<std::vector<float>> heads_;
+};
+
+// The detector pipeline on the CPU engine: the same letterbox and YOLO
+// decoding the NPU path uses, around engine::run().
+class cpu_detector {
+public:
+    cpu_detector(model m, vision::yolo_options o = {}, dispatch::dispatch* pool = nullptr)
+        : model_(std::move(m)),
+          engine_(model_, pool),
+          letterbox_(spec(model_.input())),
+          decoder_(std::move(o)),
+          pool_(pool) {}
+
+    const std::vector<vision::detection>& detect(const vision::image& img) {
+        vision::geometry g = letterbox_.run(img, engine_.input(), pool_);
+        return finish(g);
+    }
+
+    const std::vector<vision::detection>& detect(const frame::frame& f) {
+        vision::geometry g = letterbox_.run(f, engine_.input(), pool_);
+        return finish(g);
+    }
+
+    engine& runtime() { return engine_; }
+
+private:
+    static vision::tensor_spec spec(const shape& in) {
+        vision::tensor_spec s;
+        s.width  = in.w;
+        s.height = in.h;
+        s.type   = vision::element::f32;
+        return s;
+    }
+
+    const std::vector<vision::detection>& finish(const vision::geometry& g) {
+        if (!g.width) {
+            empty_.clear();
+            return empty_;
+        }
+        engine_.run();
+        vision::head_tensor heads[3];
+        size_t n = std::min<size_t>(engine_.outputs(), 3);
+        for (size_t i = 0; i < n; ++i) heads[i] = engine_.output(i);
+        return decoder_.run(heads, n, g);
+    }
+
+    model                           model_;
+    engine                          engine_;
+    vision::letterbox               letterbox_;
+    vision::yolo_decoder            decoder_;
+    dispatch::dispatch*             pool_;
+    std::vector<vision::detection>  empty_;
+};
+
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace infer {
+
+// Inner kernels for the CPU engine. Activations and weights are symmetric
+// int8 in [-127, 127], so a pair of products always fits in int16 and
+// padding contributes exactly zero. Every vector is a multiple of lanes
+// bytes long (channels are padded when the model is loaded).
+
+constexpr size_t lanes = 16;
+
+inline size_t pad_lanes(size_t n) { return (n + lanes - 1) / lanes * lanes; }
+
+// acc[r] += dot(x, w + r * n) for four weight rows stored back to back.
+// One load of x feeds four output channels.
+inline void dot4(const int8_t* x, const int8_t* w, size_t n, int32_t acc[4]) {
+#if defined(__AVX2__)
+    __m256i s0 = _mm256_setzero_si256(), s1 = s0, s2 = s0, s3 = s0;
+    for (size_t k = 0; k < n; k += 16) {
+        __m256i a = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + k)));
+        auto row = [&](size_t r) {
+            return _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w + r * n + k)));
+        };
+        s0 = _mm256_add_epi32(s0, _mm256_madd_epi16(a, row(0)));
+        s1 = _mm256_add_epi32(s1, _mm256_madd_epi16(a, row(1)));
+        s2 = _mm256_add_epi32(s2, _mm256_madd_epi16(a, row(2)));
+        s3 = _mm256_add_epi32(s3, _mm256_madd_epi16(a, row(3)));
+    }
+    // Horizontal sums of the four accumulators in one pass.
+    __m256i h01 = _mm256_hadd_epi32(s0, s1);
+    __m256i h23 = _mm256_hadd_epi32(s2, s3);
+    __m256i h   = _mm256_hadd_epi32(h01, h23);
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(h), _mm256_extracti128_si256(h, 1));
+    alignas(16) int32_t out[4];
+    _mm_store_si128(reinterpret_cast<__m128i*>(out), sum);
+    for (int r = 0; r < 4; ++r) acc[r] += out[r];
+#elif defined(__ARM_NEON) && defined(__ARM_FEATURE_DOTPROD)
+    int32x4_t s[4] = {vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0)};
+    for (size_t k = 0; k < n; k += 16) {
+        int8x16_t a = vld1q_s8(x + k);
+        for (size_t r = 0; r < 4; ++r) s[r] = vdotq_s32(s[r], a, vld1q_s8(w + r * n + k));
+    }
+    for (int r = 0; r < 4; ++r) acc[r] += vaddvq_s32(s[r]);
+#elif defined(__ARM_NEON)
+    int32x4_t s[4] = {vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0)};
+    for (size_t k = 0; k < n; k += 16) {
+        int8x16_t a = vld1q_s8(x + k);
+        for (size_t r = 0; r < 4; ++r) {
+            int8x16_t b = vld1q_s8(w + r * n + k);
+            int16x8_t p = vmull_s8(vget_low_s8(a), vget_low_s8(b));
+            p = vmlal_s8(p, vget_high_s8(a), vget_high_s8(b));
+            s[r] = vpadalq_s16(s[r], p);
+        }
+    }
+    for (int r = 0; r < 4; ++r) acc[r] += vaddvq_s32(s[r]);
+#else
+    for (size_t r = 0; r < 4; ++r) {
+        const int8_t* wr = w + r * n;
+        int32_t s = 0;
+        for (size_t k = 0; k < n; ++k) s += int32_t(x[k]) * int32_t(wr[k]);
+        acc[r] += s;
+    }
+#endif
+}
+
+// Largest |v| over a strided set of pixels, for the per-tensor scale.
+inline float abs_max(const float* v, size_t pixels, size_t channels, size_t stride) {
+    float m = 0.0f;
+    for (size_t p = 0; p < pixels; ++p) {
+        const float* px = v + p * stride;
+        for (size_t c = 0; c < channels; ++c) m = std::max(m, std::fabs(px[c]));
+    }
+    return m;
+}
+
+// Quantizes channels floats at src into dst (padded to n with zeros).
+inline void quantize(const float* src, size_t channels, float inv_scale, int8_t* dst, size_t n) {
+    for (size_t c = 0; c < channels; ++c) {
+        float q = std::nearbyint(src[c] * inv_scale);
+        dst[c] = static_cast<int8_t>(q < -127.0f ? -127.0f : q > 127.0f ? 127.0f : q);
+    }
+    for (size_t c = channels; c < n; ++c) dst[c] = 0;
+}
+
+inline float silu(float x) { return x / (1.0f + std::exp(-x)); }
+
+};
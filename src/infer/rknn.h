@@ -0,0 +1,180 @@
+#pragma once
+
+// Rockchip NPU backend for infer::scheduler. Built only when CMake finds
+// the RKNN runtime (librknnrt and rknn_api.h), which defines ROBOTS_RKNN.
+#if defined(ROBOTS_RKNN)
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <rknn_api.h>
+
+#include "infer/scheduler.h"
+#include "vision/letterbox.h"
+#include "vision/yolo.h"
+
+namespace infer {
+
+// One RKNN context per NPU core, all duplicated from the first so the
+// weights are loaded once, each pinned to its own core instead of
+// NPU_CORE_AUTO. Heads stay int8 (want_float = 0) in preallocated buffers;
+// vision::yolo_decoder thresholds the quantized values directly.
+class rknn_backend : public backend {
+public:
+    rknn_backend() = default;
+
+    rknn_backend(const rknn_backend&) = delete;
+    rknn_backend& operator=(const rknn_backend&) = delete;
+
+    ~rknn_backend() { close(); }
+
+    // Loads an .rknn model onto cores NPU cores (3 on the RK3588).
+    bool load(const std::string& path, size_t cores = 3) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+        std::vector<uint8_t> blob((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return load(blob, cores);
+    }
+
+    bool load(std::vector<uint8_t>& blob, size_t cores = 3) {
+        close();
+        rknn_context first = 0;
+        if (rknn_init(&first, blob.data(), static_cast<uint32_t>(blob.size()), 0, nullptr) != RKNN_SUCC) return false;
+        contexts_.emplace_back();
+        contexts_.back().handle = first;
+        for (size_t i = 1; i < std::max<size_t>(cores, 1); ++i) {
+            rknn_context dup = 0;
+            if (rknn_dup_context(&first, &dup) != RKNN_SUCC) break;
+            contexts_.emplace_back();
+            contexts_.back().handle = dup;
+        }
+        // Single-core parts refuse a mask; their contexts just share the core.
+        static const rknn_core_mask masks[] = {RKNN_NPU_CORE_0, RKNN_NPU_CORE_1, RKNN_NPU_CORE_2};
+        for (size_t i = 0; i < contexts_.size(); ++i) rknn_set_core_mask(contexts_[i].handle, masks[i % 3]);
+
+        if (!describe()) {
+            close();
+            return false;
+        }
+        for (context& c : contexts_) {
+            c.input.resize(input_bytes());
+            c.heads.resize(heads_.size());
+            for (size_t i = 0; i < heads_.size(); ++i) c.heads[i].resize(heads_[i].size);
+        }
+        return true;
+    }
+
+    void close() {
+        for (context& c : contexts_) rknn_destroy(c.handle);
+        contexts_.clear();
+        heads_.clear();
+    }
+
+    size_t contexts() const override { return contexts_.size(); }
+
+    vision::tensor_spec input_spec() const override {
+        vision::tensor_spec s;
+        s.width   = width_;
+        s.height  = height_;
+        s.type    = vision::element::u8;
+        s.planar  = planar_;
+        return s;
+    }
+
+    void* input(size_t ctx) override { return contexts_[ctx].input.data(); }
+
+    bool infer(size_t ctx) override {
+        context& c = contexts_[ctx];
+        rknn_input in{};
+        in.index = 0;
+        in.buf   = c.input.data();
+        in.size  = static_cast<uint32_t>(c.input.size());
+        in.type  = RKNN_TENSOR_UINT8;
+        in.fmt   = planar_ ? RKNN_TENSOR_NCHW : RKNN_TENSOR_NHWC;
+        if (rknn_inputs_set(c.handle, 1, &in) != RKNN_SUCC) return false;
+        if (rknn_run(c.handle, nullptr) != RKNN_SUCC) return false;
+
+        rknn_output out[3] = {};
+        for (size_t i = 0; i < heads_.size(); ++i) {
+            out[i].index       = static_cast<uint32_t>(i);
+            out[i].want_float  = 0;
+            out[i].is_prealloc = 1;
+            out[i].buf         = c.heads[i].data();
+            out[i].size        = static_cast<uint32_t>(c.heads[i].size());
+        }
+        uint32_t n = static_cast<uint32_t>(heads_.size());
+        if (rknn_outputs_get(c.handle, n, out, nullptr) != RKNN_SUCC) return false;
+        rknn_outputs_release(c.handle, n, out);
+        return true;
+    }
+
+    size_t outputs(size_t) const override { return heads_.size(); }
+
+    vision::head_tensor output(size_t ctx, size_t i) const override {
+        const head& h = heads_[i];
+        return {contexts_[ctx].heads[i].data(), h.channels, h.grid_w, h.grid_h, vision::element::i8, h.scale, h.zero_point};
+    }
+
+private:
+    struct context {
+        rknn_context                        handle = 0;
+        std::vector<uint8_t>                input;
+        std::vector<std::vector<int8_t>>    heads;
+    };
+
+    struct head {
+        uint32_t    channels    = 0;
+        uint32_t    grid_w      = 0;
+        uint32_t    grid_h      = 0;
+        size_t      size        = 0;
+        float       scale       = 1.0f;
+        int32_t     zero_point  = 0;
+    };
+
+    size_t input_bytes() const { return size_t(width_) * height_ * 3; }
+
+    // Input and head layouts from the first context. The decoder wants three
+    // int8 NCHW heads.
+    bool describe() {
+        rknn_context h = contexts_[0].handle;
+        rknn_input_output_num io{};
+        if (rknn_query(h, RKNN_QUERY_IN_OUT_NUM, &io, sizeof(io)) != RKNN_SUCC) return false;
+        if (io.n_input != 1 || io.n_output == 0 || io.n_output > 3) return false;
+
+        rknn_tensor_attr a{};
+        a.index = 0;
+        if (rknn_query(h, RKNN_QUERY_INPUT_ATTR, &a, sizeof(a)) != RKNN_SUCC || a.n_dims != 4) return false;
+        planar_ = a.fmt == RKNN_TENSOR_NCHW;
+        height_ = planar_ ? a.dims[2] : a.dims[1];
+        width_  = planar_ ? a.dims[3] : a.dims[2];
+
+        heads_.resize(io.n_output);
+        for (uint32_t i = 0; i < io.n_output; ++i) {
+            rknn_tensor_attr o{};
+            o.index = i;
+            if (rknn_query(h, RKNN_QUERY_OUTPUT_ATTR, &o, sizeof(o)) != RKNN_SUCC) return false;
+            if (o.n_dims != 4 || o.fmt != RKNN_TENSOR_NCHW || o.type != RKNN_TENSOR_INT8) return false;
+            heads_[i].channels   = o.dims[1];
+            heads_[i].grid_h     = o.dims[2];
+            heads_[i].grid_w     = o.dims[3];
+            heads_[i].size       = o.n_elems;
+            heads_[i].scale      = o.scale;
+            heads_[i].zero_point = o.zp;
+        }
+        return true;
+    }
+
+    std::vector<context>    contexts_;
+    std::vector<head>       heads_;
+    uint32_t                width_  = 0;
+    uint32_t                height_ = 0;
+    bool                    planar_ = false;
+};
+
+};
+
+#endif
@@ -0,0 +1,302 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "dispatch/dispatch.h"
+#include "frame/frame.h"
+#include "infer/cpu.h"
+#include "vision/letterbox.h"
+#include "vision/yolo.h"
+
+namespace infer {
+
+// Keeps every inference context of a backend busy at once.
+//
+// An NPU with several cores (or a CPU with several engines) only reaches
+// its aggregate throughput when each core has its own context and frames
+// are spread across them; one synchronous detect() call per frame uses a
+// single core and stalls capture for the whole of it. The scheduler gives
+// each context a whole frame - letterbox into the context's input, run,
+// decode - as one pool job, so preprocessing and decoding of one frame
+// overlap inference of the others. Contexts are handed out round-robin.
+//
+// Frames finish out of order; results are released strictly in submission
+// order. A frame that arrives while every context is busy waits in a single
+// pending slot, and a newer frame replaces it (counted as dropped), so the
+// detector always works on the freshest image without queueing latency.
+// With block set, submit() waits for the slot instead of replacing.
+
+// One inference runtime with contexts() independent contexts. infer(ctx)
+// blocks until the outputs of ctx are ready; the scheduler never calls into
+// the same context from two threads at once, but different contexts run
+// concurrently.
+class backend {
+public:
+    virtual ~backend() = default;
+
+    virtual size_t              contexts() const = 0;
+    virtual vision::tensor_spec input_spec() const = 0;
+
+    // Where letterbox writes the input of ctx (input_spec() sized).
+    virtual void*               input(size_t ctx) = 0;
+    virtual bool                infer(size_t ctx) = 0;
+
+    // Raw NCHW detection heads of ctx after infer().
+    virtual size_t              outputs(size_t ctx) const = 0;
+    virtual vision::head_tensor output(size_t ctx, size_t i) const = 0;
+};
+
+// The CPU engine as a backend: one engine (and arena) per context over one
+// shared model. pool, if given, also splits each convolution.
+class cpu_backend : public backend {
+public:
+    cpu_backend(model m, size_t contexts, dispatch::dispatch* pool = nullptr) : model_(std::move(m)) {
+        for (size_t i = 0; i < std::max<size_t>(contexts, 1); ++i) {
+            engines_.push_back(std::make_unique<engine>(model_, pool));
+        }
+    }
+
+    size_t contexts() const override { return engines_.size(); }
+
+    vision::tensor_spec input_spec() const override {
+        vision::tensor_spec s;
+        s.width  = model_.input().w;
+        s.height = model_.input().h;
+        s.type   = vision::element::f32;
+        return s;
+    }
+
+    void* input(size_t ctx) override { return engines_[ctx]->input(); }
+
+    bool infer(size_t ctx) override {
+        engines_[ctx]->run();
+        return true;
+    }
+
+    size_t outputs(size_t ctx) const override { return engines_[ctx]->outputs(); }
+
+    vision::head_tensor output(size_t ctx, size_t i) const override { return engines_[ctx]->output(i); }
+
+private:
+    model                                   model_;
+    std::vector<std::unique_ptr<engine>>    engines_;
+};
+
+struct scheduler_options {
+    vision::yolo_options    yolo;
+    bool                    block = false;      // submit() waits instead of dropping
+};
+
+// A finished frame, released in submission order.
+struct result {
+    uint64_t                        seq          = 0;       // as given to submit()
+    uint64_t                        timestamp_ns = 0;       // capture time of the frame
+    uint32_t                        context      = 0;
+    bool                            ok           = false;   // false: unsupported frame or backend failure
+    vision::geometry                geometry;
+    std::vector<vision::detection>  detections;
+};
+
+class scheduler {
+public:
+    using sink_t = std::function<void(const result&)>;
+
+    // The pool runs one job per busy context, so it wants at least
+    // b.contexts() workers and must have one. The sink is called from pool
+    // workers, one result at a time.
+    scheduler(backend& b, dispatch::dispatch& pool, sink_t sink, scheduler_options o = {})
+        : backend_(b), pool_(pool), sink_(std::move(sink)), opt_(std::move(o)) {
+        if (pool.workers() == 0) throw std::invalid_argument("scheduler: dispatch has no worker pool");
+        size_t n = std::max<size_t>(b.contexts(), 1);
+        for (size_t i = 0; i < n; ++i) {
+            contexts_.push_back(std::make_unique<context>(b.input_spec(), opt_.yolo));
+        }
+        // Frames may finish up to one full round ahead of the oldest one.
+        slots_.resize(2 * n);
+    }
+
+    scheduler(const scheduler&) = delete;
+    scheduler& operator=(const scheduler&) = delete;
+
+    ~scheduler() { close(); }
+
+    size_t contexts() const { return contexts_.size(); }
+
+    // Takes the frame for detection. False once closed.
+    bool submit(frame::frame f, uint64_t seq) {
+        std::unique_lock<std::mutex> lock(m_);
+        if (opt_.block) {
+            cv_.wait(lock, [&] { return closed_ || !pending_.f; });
+        }
+        if (closed_) return false;
+        if (pending_.f) ++dropped_;
+        pending_.f   = std::move(f);
+        pending_.seq = seq;
+        ++submitted_;
+        launch();
+        return true;
+    }
+
+    // Waits until every accepted frame that was not dropped is delivered.
+    void drain() {
+        std::unique_lock<std::mutex> lock(m_);
+        cv_.wait(lock, [&] { return !pending_.f && busy_ == 0 && !delivering_; });
+    }
+
+    // Refuses new frames, drops the pending one and waits for the rest.
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            closed_ = true;
+            if (pending_.f) {
+                pending_.f.reset();
+                ++dropped_;
+            }
+        }
+        cv_.notify_all();
+        drain();
+    }
+
+    uint64_t submitted() const { std::lock_guard<std::mutex> lock(m_); return submitted_; }
+    uint64_t dropped()   const { std::lock_guard<std::mutex> lock(m_); return dropped_; }
+    uint64_t delivered() const { std::lock_guard<std::mutex> lock(m_); return next_; }
+
+private:
+    struct context {
+        context(const vision::tensor_spec& spec, const vision::yolo_options& o) : letterbox(spec), decoder(o) {}
+
+        vision::letterbox       letterbox;
+        vision::yolo_decoder    decoder;
+        bool                    busy = false;
+    };
+
+    struct work {
+        frame::frame    f;
+        uint64_t        seq = 0;
+    };
+
+    struct slot {
+        result  r;
+        bool    ready = false;
+    };
+
+    // Starts the pending frame on the next free context, if there is one and
+    // its result would fit the reorder window. If the pool refuses the job
+    // (it has been shut down) the frame is dropped and the context freed, so
+    // drain() still returns. Called with m_ held.
+    void launch() {
+        if (!pending_.f || ticket_ >= next_ + slots_.size()) return;
+        size_t n = contexts_.size();
+        for (size_t k = 0; k < n; ++k) {
+            size_t ctx = (cursor_ + k) % n;
+            if (contexts_[ctx]->busy) continue;
+            cursor_ = (ctx + 1) % n;
+            contexts_[ctx]->busy = true;
+            ++busy_;
+            auto job = std::make_shared<work>(std::move(pending_));
+            pending_ = work{};
+            uint64_t ticket = ticket_++;
+            try {
+                pool_.post([this, ctx, ticket, job] { process(ctx, ticket, *job); });
+            } catch (const std::logic_error&) {
+                contexts_[ctx]->busy = false;
+                --busy_;
+                --ticket_;
+                ++dropped_;
+            }
+            cv_.notify_all();
+            return;
+        }
+    }
+
+    void process(size_t ctx, uint64_t ticket, work& w) {
+        context& c = *contexts_[ctx];
+        // The slot belongs to this ticket until it is delivered.
+        result& r = slots_[ticket % slots_.size()].r;
+        r.seq          = w.seq;
+        r.timestamp_ns = w.f.timestamp_ns();
+        r.context      = static_cast<uint32_t>(ctx);
+        r.detections.clear();
+        // A throwing stage fails this frame only; the ticket must still be
+        // finished or the context and the reorder window stay taken for good.
+        try {
+            r.geometry = c.letterbox.run(w.f, backend_.input(ctx));
+            w.f.reset();
+            r.ok = r.geometry.width && backend_.infer(ctx);
+            if (r.ok) {
+                vision::head_tensor heads[3];
+                size_t n = std::min<size_t>(backend_.outputs(ctx), 3);
+                for (size_t i = 0; i < n; ++i) heads[i] = backend_.output(ctx, i);
+                const std::vector<vision::detection>& d = c.decoder.run(heads, n, r.geometry);
+                r.detections.assign(d.begin(), d.end());
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "infer: context " << ctx << " failed: " << e.what() << "\n";
+            fail(r, w);
+        } catch (...) {
+            std::cerr << "infer: context " << ctx << " failed\n";
+            fail(r, w);
+        }
+        finish(ctx, ticket);
+    }
+
+    static void fail(result& r, work& w) {
+        w.f.reset();
+        r.ok = false;
+        r.detections.clear();
+    }
+
+    void finish(size_t ctx, uint64_t ticket) {
+        std::unique_lock<std::mutex> lock(m_);
+        slots_[ticket % slots_.size()].ready = true;
+        contexts_[ctx]->busy = false;
+        --busy_;
+        launch();
+        // Whoever is already delivering will reach this ticket.
+        if (delivering_) return;
+        delivering_ = true;
+        for (;;) {
+            slot& s = slots_[next_ % slots_.size()];
+            if (!s.ready) break;
+            lock.unlock();
+            if (sink_) sink_(s.r);
+            lock.lock();
+            s.ready = false;
+            ++next_;
+            launch();
+        }
+        delivering_ = false;
+        cv_.notify_all();
+    }
+
+    backend&                                backend_;
+    dispatch::dispatch&                     pool_;
+    sink_t                                  sink_;
+    scheduler_options                       opt_;
+    std::vector<std::unique_ptr<context>>   contexts_;
+    std::vector<slot>                       slots_;
+
+    mutable std::mutex                      m_;
+    std::condition_variable                 cv_;
+    work                                    pending_;
+    size_t                                  cursor_     = 0;
+    size_t                                  busy_       = 0;
+    uint64_t                                ticket_     = 0;        // next frame to start
+    uint64_t                                next_       = 0;        // next frame to deliver
+    uint64_t                                submitted_  = 0;
+    uint64_t                                dropped_    = 0;
+    bool                                    delivering_ = false;
+    bool                                    closed_     = false;
+};
+
+};
@@ -0,0 +1,377 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "bus/bus.h"
+#include "dispatch/dispatch.h"
+
+namespace ipc {
+
+// Shared (not process-private) futex on a 32-bit word inside a mapping.
+inline void futex_wait(std::atomic<uint32_t>& word, uint32_t expected, std::chrono::nanoseconds timeout) {
+    timespec ts;
+    ts.tv_sec  = static_cast<time_t>(timeout.count() / 1000000000);
+    ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+inline void futex_wake(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// A named POSIX shared-memory mapping. The creator unlinks the name when it
+// goes away; openers only unmap. create() fails with EEXIST rather than wipe
+// a segment someone may still be using; after a crash, remove() the stale
+// name first.
+class segment {
+public:
+    static segment create(const std::string& name, size_t bytes) { return segment(name, bytes, true); }
+    static segment open(const std::string& name)                 { return segment(name, 0, false); }
+
+    // Unlinks a name left behind by a creator that died. False if it was not there.
+    static bool remove(const std::string& name) { return shm_unlink(name.c_str()) == 0; }
+
+    segment(segment&& o) noexcept : name_(std::move(o.name_)), base_(o.base_), size_(o.size_), owner_(o.owner_) {
+        o.base_  = nullptr;
+        o.owner_ = false;
+    }
+
+    segment(const segment&) = delete;
+    segment& operator=(const segment&) = delete;
+    segment& operator=(segment&&) = delete;
+
+    ~segment() {
+        if (base_) munmap(base_, size_);
+        if (owner_) shm_unlink(name_.c_str());
+    }
+
+    void*       data()       { return base_; }
+    size_t      size() const { return size_; }
+
+private:
+    segment(const std::string& name, size_t bytes, bool create) : name_(name), owner_(create) {
+        int fd = shm_open(name.c_str(), create ? (O_CREAT | O_EXCL | O_RDWR) : O_RDWR, 0600);
+        if (fd < 0) throw std::system_error(errno, std::generic_category(), "ipc: shm_open " + name);
+        if (create) {
+            if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+                int e = errno;
+                close(fd);
+                shm_unlink(name.c_str());
+                throw std::system_error(e, std::generic_category(), "ipc: ftruncate " + name);
+            }
+            size_ = bytes;
+        } else {
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                int e = errno;
+                close(fd);
+                throw std::system_error(e, std::generic_category(), "ipc: fstat " + name);
+            }
+            size_ = static_cast<size_t>(st.st_size);
+        }
+        base_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int e = errno;
+        close(fd);
+        if (base_ == MAP_FAILED) {
+            base_ = nullptr;
+            throw std::system_error(e, std::generic_category(), "ipc: mmap " + name);
+        }
+    }
+
+    std::string name_;
+    void*       base_  = nullptr;
+    size_t      size_  = 0;
+    bool        owner_ = false;
+};
+
+// Every record in a ring starts with this. schema identifies the payload
+// layout (see schema/schema.h); size excludes the header.
+struct record {
+    uint32_t size;
+    uint16_t schema;
+    uint16_t flags;
+};
+
+static_assert(sizeof(record) == 8, "ipc::record must stay 8 bytes");
+
+// Single-producer/single-consumer byte ring laid out in caller-provided
+// memory, so the same code runs in-process or inside a shared segment.
+// Records are 8-byte aligned and never split; a padding record fills the
+// tail when a record would straddle the wrap. Waiters spin briefly and then
+// sleep on a futex; the other side only issues a wake when someone sleeps.
+class ring {
+public:
+    static constexpr uint32_t magic      = 0x52424e47;     // "RBNG"
+    static constexpr uint16_t pad_schema = 0xFFFF;
+    static constexpr int      spins      = 2000;    // per wait, on multi-core only
+
+    struct view {
+        uint16_t        schema = 0;
+        uint16_t        flags  = 0;
+        const void*     data   = nullptr;
+        uint32_t        size   = 0;
+
+        explicit operator bool() const { return data != nullptr; }
+    };
+
+    static size_t bytes_for(size_t capacity) { return sizeof(header) + capacity; }
+
+    // Formats memory for a ring of capacity bytes (a power of two).
+    static ring create(void* mem, size_t capacity) {
+        if (capacity < 64 || (capacity & (capacity - 1))) throw std::invalid_argument("ipc: ring capacity must be a power of two >= 64");
+        auto* h = new (mem) header();
+        h->capacity = capacity;
+        h->magic.store(magic, std::memory_order_release);
+        return ring(h);
+    }
+
+    // Attaches to a ring formatted in the bytes at mem. The header comes from
+    // another process, so its capacity is checked against the mapping.
+    static ring attach(void* mem, size_t bytes) {
+        if (bytes < sizeof(header)) throw std::runtime_error("ipc: not a ring");
+        auto* h = static_cast<header*>(mem);
+        if (h->magic.load(std::memory_order_acquire) != magic) throw std::runtime_error("ipc: not a ring");
+        uint64_t c = h->capacity;
+        if (c < 64 || (c & (c - 1)) || c > bytes - sizeof(header)) throw std::runtime_error("ipc: ring header does not fit its segment");
+        return ring(h);
+    }
+
+    // Producer: reserves room for a payload of size bytes, waiting up to
+    // timeout for the consumer to free space. Returns null on timeout.
+    void* reserve(uint32_t size, std::chrono::nanoseconds timeout = std::chrono::milliseconds(100)) {
+        uint64_t need = sizeof(record) + align8(size);
+        if (need + sizeof(record) > h_->capacity) throw std::length_error("ipc: record larger than ring");
+        uint64_t head = h_->head.load(std::memory_order_relaxed);
+        uint64_t room_to_end = h_->capacity - (head & mask());
+        uint64_t total = need <= room_to_end ? need : need + room_to_end;
+        if (!wait_space(head, total, timeout)) return nullptr;
+        if (need > room_to_end) {
+            auto* pad = at(head);
+            pad->size   = static_cast<uint32_t>(room_to_end - sizeof(record));
+            pad->schema = pad_schema;
+            pad->flags  = 0;
+            head += room_to_end;
+        }
+        pending_head_ = head;
+        pending_size_ = size;
+        return at(head) + 1;
+    }
+
+    // pad_schema is reserved for the ring's own padding records.
+    void commit(uint16_t schema, uint16_t flags = 0) {
+        if (schema == pad_schema) throw std::invalid_argument("ipc: schema 0xFFFF is reserved");
+        record* r = at(pending_head_);
+        r->size   = pending_size_;
+        r->schema = schema;
+        r->flags  = flags;
+        h_->head.store(pending_head_ + sizeof(record) + align8(pending_size_), std::memory_order_release);
+        wake_if_waiting(h_->consumer_waiting, h_->data_seq);
+    }
+
+    bool write(uint16_t schema, const void* data, uint32_t size, std::chrono::nanoseconds timeout = std::chrono::milliseconds(100)) {
+        if (schema == pad_schema) throw std::invalid_argument("ipc: schema 0xFFFF is reserved");
+        void* p = reserve(size, timeout);
+        if (!p) return false;
+        std::memcpy(p, data, size);
+        commit(schema);
+        return true;
+    }
+
+    // Consumer: the next record, read in place. Valid until release().
+    view peek(std::chrono::nanoseconds timeout = std::chrono::nanoseconds(0)) {
+        for (;;) {
+            uint64_t tail = h_->tail.load(std::memory_order_relaxed);
+            if (!wait_data(tail, timeout)) return {};
+            record* r = at(tail);
+            if (r->schema == pad_schema) {
+                h_->tail.store(tail + sizeof(record) + r->size, std::memory_order_release);
+                wake_if_waiting(h_->producer_waiting, h_->space_seq);
+                continue;
+            }
+            return {r->schema, r->flags, r + 1, r->size};
+        }
+    }
+
+    void release() {
+        uint64_t tail = h_->tail.load(std::memory_order_relaxed);
+        h_->tail.store(tail + sizeof(record) + align8(at(tail)->size), std::memory_order_release);
+        wake_if_waiting(h_->producer_waiting, h_->space_seq);
+    }
+
+    size_t capacity() const { return h_->capacity; }
+    size_t used()     const { return h_->head.load(std::memory_order_acquire) - h_->tail.load(std::memory_order_acquire); }
+
+private:
+    struct header {
+        std::atomic<uint32_t>   magic{0};
+        uint64_t                capacity = 0;
+        alignas(dispatch::cache_line) std::atomic<uint64_t> head{0};
+        std::atomic<uint32_t>   data_seq{0};
+        std::atomic<uint32_t>   producer_waiting{0};
+        alignas(dispatch::cache_line) std::atomic<uint64_t> tail{0};
+        std::atomic<uint32_t>   space_seq{0};
+        std::atomic<uint32_t>   consumer_waiting{0};
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "ipc: rings need address-free 64-bit atomics");
+
+    explicit ring(header* h) : h_(h), data_(reinterpret_cast<std::byte*>(h + 1)) {}
+
+    static uint64_t align8(uint64_t n) { return (n + 7) & ~uint64_t(7); }
+
+    uint64_t mask() const { return h_->capacity - 1; }
+    record*  at(uint64_t pos) { return reinterpret_cast<record*>(data_ + (pos & mask())); }
+
+    static void wake_if_waiting(std::atomic<uint32_t>& waiting, std::atomic<uint32_t>& seq) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed)) {
+            seq.fetch_add(1, std::memory_order_release);
+            futex_wake(seq);
+        }
+    }
+
+    template<typename Ready>
+    bool wait(Ready ready, std::atomic<uint32_t>& waiting, std::atomic<uint32_t>& seq, std::chrono::nanoseconds timeout) {
+        if (ready()) return true;
+        // Spinning only helps when the other side can run at the same time.
+        static const int budget = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? spins : 0;
+        for (int i = 0; i < budget; ++i) {
+            cpu_relax();
+            if (ready()) return true;
+        }
+        if (timeout.count() <= 0) return false;
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        for (;;) {
+            uint32_t s = seq.load(std::memory_order_acquire);
+            waiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ready()) break;
+            auto left = deadline - std::chrono::steady_clock::now();
+            if (left <= std::chrono::nanoseconds(0)) break;
+            futex_wait(seq, s, left);
+        }
+        waiting.store(0, std::memory_order_relaxed);
+        return ready();
+    }
+
+    bool wait_space(uint64_t head, uint64_t total, std::chrono::nanoseconds timeout) {
+        return wait([&] { return head + total - h_->tail.load(std::memory_order_acquire) <= h_->capacity; },
+                    h_->producer_waiting, h_->space_seq, timeout);
+    }
+
+    bool wait_data(uint64_t tail, std::chrono::nanoseconds timeout) {
+        return wait([&] { return h_->head.load(std::memory_order_acquire) != tail; },
+                    h_->consumer_waiting, h_->data_seq, timeout);
+    }
+
+    header*     h_;
+    std::byte*  data_;
+    uint64_t    pending_head_ = 0;
+    uint32_t    pending_size_ = 0;
+};
+
+// A ring living in its own named shared-memory segment.
+class shm_ring {
+public:
+    static shm_ring create(const std::string& name, size_t capacity) {
+        segment seg = segment::create(name, ring::bytes_for(capacity));
+        ring r = ring::create(seg.data(), capacity);
+        return shm_ring(std::move(seg), r);
+    }
+
+    static shm_ring open(const std::string& name) {
+        segment seg = segment::open(name);
+        ring r = ring::attach(seg.data(), seg.size());
+        return shm_ring(std::move(seg), r);
+    }
+
+    ring& operator*()  { return ring_; }
+    ring* operator->() { return &ring_; }
+
+private:
+    shm_ring(segment seg, ring r) : seg_(std::move(seg)), ring_(r) {}
+
+    segment seg_;
+    ring    ring_;
+};
+
+// Forwards a bus channel of trivially copyable messages into a ring. The
+// mailbox drains on the pool, so a full ring stalls only this forwarder.
+template<typename T>
+class export_channel {
+public:
+    static_assert(std::is_trivially_copyable_v<T>, "ipc: only trivially copyable messages cross processes");
+
+    export_channel(bus::channel<T>& ch, ring& out, uint16_t schema, dispatch::dispatch& pool, bus::policy p = {})
+        : channel_(ch), sink_(std::make_shared<sink>(out, schema)) {
+        box_ = ch.subscribe(pool, [s = sink_](const bus::message<T>& m) {
+            if (!s->out.write(s->schema, m.get(), sizeof(T))) s->dropped.fetch_add(1, std::memory_order_relaxed);
+        }, p);
+    }
+
+    ~export_channel() { channel_.unsubscribe(box_); }
+
+    uint64_t dropped() const { return sink_->dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct sink {
+        sink(ring& r, uint16_t id) : out(r), schema(id) {}
+
+        ring&                   out;
+        uint16_t                schema;
+        std::atomic<uint64_t>   dropped{0};
+    };
+
+    bus::channel<T>&                    channel_;
+    std::shared_ptr<sink>               sink_;
+    std::shared_ptr<bus::mailbox<T>>    box_;
+};
+
+// Reads records of one schema from a ring and republishes them on a local
+// bus channel; records of other schemas are skipped. Run it as a dispatch task.
+template<typename T>
+void import_channel(ring& in, uint16_t schema, bus::channel<T>& ch, const dispatch::cancel_token& tok) {
+    static_assert(std::is_trivially_copyable_v<T>, "ipc: only trivially copyable messages cross processes");
+    while (!tok.cancelled()) {
+        ring::view v = in.peek(std::chrono::milliseconds(50));
+        if (!v) continue;
+        if (v.schema == schema && v.size == sizeof(T)) {
+            auto m = std::make_shared<T>();
+            std::memcpy(m.get(), v.data, sizeof(T));
+            in.release();
+            ch.publish(bus::message<T>(std::move(m)));
+        } else {
+            in.release();
+        }
+    }
+}
+
+};
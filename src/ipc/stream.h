@@ -0,0 +1,489 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "bus/bus.h"
+#include "dispatch/dispatch.h"
+#include "ipc/ipc.h"
+
+namespace ipc {
+
+// Stream framing over Unix-domain sockets. Every frame is an ipc::record
+// header followed by the payload, padded to 8 bytes, so a frame read off a
+// socket looks exactly like a ring record and schema::read() works on both.
+//
+// A client may send a subscribe frame (schema = subscribe_schema) whose
+// payload is the list of uint16 schema ids it wants; an empty list (or none
+// at all) means everything.
+
+constexpr uint16_t subscribe_schema = 0xFFFE;
+
+inline uint32_t frame_bytes(uint32_t size) { return static_cast<uint32_t>(sizeof(record) + ((size + 7) & ~uint32_t(7))); }
+
+// Reusable receive buffer. Bytes are read straight into it and frames are
+// handed out in place; the remainder is moved to the front only when the
+// tail runs out, and the buffer grows only for a frame larger than itself,
+// up to max_frame. The frame size comes from the peer, so a larger one
+// breaks the stream instead of the allocator.
+class recv_ring {
+public:
+    explicit recv_ring(size_t capacity = 64 << 10, size_t max_frame = 16 << 20)
+        : words_((capacity + 7) / 8), max_frame_(max_frame) {}
+
+    // Reads what the socket has; call parse() in between. 0 on orderly
+    // shutdown, -1 on error (errno set; EAGAIN means nothing to read,
+    // EMSGSIZE that the peer announced a frame over max_frame).
+    ssize_t fill(int fd) {
+        if (broken_) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        if (end_ == size()) compact();
+        if (end_ == size()) {
+            // Only reachable without parse() between fills.
+            errno = ENOBUFS;
+            return -1;
+        }
+        ssize_t n = ::recv(fd, data() + end_, size() - end_, MSG_DONTWAIT);
+        if (n > 0) end_ += static_cast<size_t>(n);
+        return n;
+    }
+
+    // Calls f(ring::view) for every complete frame buffered. Views are valid
+    // only inside f.
+    template<typename F>
+    size_t parse(F&& f) {
+        size_t frames = 0;
+        while (end_ - begin_ >= sizeof(record)) {
+            const auto* r = reinterpret_cast<const record*>(data() + begin_);
+            size_t whole = frame_bytes(r->size);
+            if (end_ - begin_ < whole) {
+                if (whole > max_frame_) broken_ = true;
+                else if (whole > size()) grow(whole);
+                break;
+            }
+            f(ring::view{r->schema, r->flags, r + 1, r->size});
+            begin_ += whole;
+            ++frames;
+        }
+        if (begin_ == end_) begin_ = end_ = 0;
+        return frames;
+    }
+
+    size_t buffered() const { return end_ - begin_; }
+
+private:
+    // Word storage keeps every frame, and so every payload, 8-byte aligned.
+    char*   data()       { return reinterpret_cast<char*>(words_.data()); }
+    size_t  size() const { return words_.size() * sizeof(uint64_t); }
+
+    void compact() {
+        std::memmove(data(), data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+    }
+
+    void grow(size_t need) {
+        compact();
+        words_.resize((need + 7) / 8);
+    }
+
+    std::vector<uint64_t>   words_;
+    size_t                  max_frame_;
+    size_t                  begin_  = 0;
+    size_t                  end_    = 0;
+    bool                    broken_ = false;
+};
+
+namespace detail {
+
+inline sockaddr_un unix_address(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::invalid_argument("ipc: socket path too long: " + path);
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+inline void append_frame(std::vector<char>& out, uint16_t schema, uint16_t flags, const void* data, uint32_t size) {
+    size_t at = out.size();
+    out.resize(at + frame_bytes(size));
+    record r{size, schema, flags};
+    std::memcpy(out.data() + at, &r, sizeof(r));
+    if (size) std::memcpy(out.data() + at + sizeof(r), data, size);
+    std::memset(out.data() + at + sizeof(r) + size, 0, frame_bytes(size) - sizeof(r) - size);
+}
+
+};
+
+// Fan-out side of the stream transport. publish() only appends the frame to
+// each subscriber's pending batch; the server's epoll loop (run() on a
+// dispatch task) flushes every batch accumulated since its last wakeup with
+// one sendmsg gather per client. A client that falls more than max_backlog
+// behind loses frames instead of stalling publishers.
+class stream_server {
+public:
+    static constexpr size_t default_backlog = 4 << 20;
+    static constexpr int    max_events      = 64;
+    // Largest control frame: a subscribe list naming every schema id.
+    static constexpr size_t max_control     = sizeof(record) + 65536 * sizeof(uint16_t);
+
+    explicit stream_server(std::string path, size_t max_backlog = default_backlog)
+        : path_(std::move(path)), max_backlog_(max_backlog) {
+        listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) throw std::system_error(errno, std::generic_category(), "ipc: socket");
+        ::unlink(path_.c_str());
+        sockaddr_un addr = detail::unix_address(path_);
+        if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listen_fd_, 16) != 0) {
+            int e = errno;
+            ::close(listen_fd_);
+            throw std::system_error(e, std::generic_category(), "ipc: bind " + path_);
+        }
+        wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd_ < 0) fail("ipc: eventfd");
+        epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ < 0) fail("ipc: epoll_create1");
+        try {
+            watch(listen_fd_, EPOLLIN, &listen_fd_);
+            watch(wake_fd_, EPOLLIN, &wake_fd_);
+        } catch (...) {
+            release();
+            throw;
+        }
+    }
+
+    stream_server(const stream_server&) = delete;
+    stream_server& operator=(const stream_server&) = delete;
+
+    ~stream_server() {
+        for (auto& c : clients_) ::close(c->fd);
+        release();
+    }
+
+    // Queues one frame for every client subscribed to schema. Never blocks
+    // on a socket.
+    void publish(uint16_t schema, const void* data, uint32_t size, uint16_t flags = 0) {
+        bool kick = false;
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            for (auto& c : clients_) {
+                if (c->closed || !c->wants(schema)) continue;
+                if (c->backlog + c->queued.size() + frame_bytes(size) > max_backlog_) {
+                    c->dropped++;
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                detail::append_frame(c->queued, schema, flags, data, size);
+                kick = true;
+            }
+            if (kick && !wake_pending_) wake_pending_ = true;
+            else kick = false;
+        }
+        if (kick) {
+            uint64_t one = 1;
+            [[maybe_unused]] ssize_t n = ::write(wake_fd_, &one, sizeof(one));
+        }
+    }
+
+    // The event loop; returns once tok is cancelled.
+    void run(const dispatch::cancel_token& tok) {
+        epoll_event events[max_events];
+        while (!tok.cancelled()) {
+            int n = ::epoll_wait(epoll_fd_, events, max_events, 50);
+            for (int i = 0; i < n; ++i) {
+                void* tag = events[i].data.ptr;
+                if (tag == &listen_fd_) {
+                    accept_all();
+                } else if (tag == &wake_fd_) {
+                    uint64_t count;
+                    [[maybe_unused]] ssize_t r = ::read(wake_fd_, &count, sizeof(count));
+                    {
+                        std::lock_guard<std::mutex> lock(m_);
+                        wake_pending_ = false;
+                    }
+                    for (auto& c : clients_) flush(*c);
+                } else {
+                    auto* c = static_cast<client*>(tag);
+                    if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) c->closed = true;
+                    if (!c->closed && (events[i].events & EPOLLIN)) read_control(*c);
+                    if (!c->closed && (events[i].events & EPOLLOUT)) flush(*c);
+                }
+            }
+            reap();
+        }
+    }
+
+    size_t clients() const {
+        std::lock_guard<std::mutex> lock(m_);
+        return clients_.size();
+    }
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct client {
+        int                             fd;
+        std::atomic<bool>               closed{false};      // set by the loop, read by publish()
+        bool                            want_out = false;
+        std::vector<uint64_t>           filter;             // empty: everything
+        std::vector<char>               queued;             // appended by publishers, under m_
+        std::vector<std::vector<char>>  inflight;           // loop thread only
+        std::vector<std::vector<char>>  spare;
+        size_t                          sent = 0;           // into inflight.front()
+        size_t                          backlog = 0;        // bytes in inflight, under m_
+        uint64_t                        dropped = 0;
+        recv_ring                       control{4096, max_control};
+
+        bool wants(uint16_t schema) const {
+            return filter.empty() || (filter[schema >> 6] >> (schema & 63) & 1);
+        }
+    };
+
+    void release() {
+        if (epoll_fd_ >= 0) ::close(epoll_fd_);
+        if (wake_fd_ >= 0) ::close(wake_fd_);
+        ::close(listen_fd_);
+        ::unlink(path_.c_str());
+    }
+
+    [[noreturn]] void fail(const char* what) {
+        int e = errno;
+        release();
+        throw std::system_error(e, std::generic_category(), what);
+    }
+
+    void watch(int fd, uint32_t events, void* tag) {
+        epoll_event ev{};
+        ev.events   = events;
+        ev.data.ptr = tag;
+        if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            throw std::system_error(errno, std::generic_category(), "ipc: epoll_ctl");
+        }
+    }
+
+    void accept_all() {
+        for (;;) {
+            int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;
+            auto c = std::make_unique<client>();
+            c->fd = fd;
+            watch(fd, EPOLLIN | EPOLLRDHUP, c.get());
+            std::lock_guard<std::mutex> lock(m_);
+            clients_.push_back(std::move(c));
+        }
+    }
+
+    // Parses after every read, so the control buffer never fills up with
+    // complete frames. A client that errors, hangs up or announces a frame
+    // over max_control is dropped.
+    void read_control(client& c) {
+        for (;;) {
+            ssize_t n = c.control.fill(c.fd);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                c.closed = true;
+                return;
+            }
+            if (n < 0) break;
+            c.control.parse([&](const ring::view& v) {
+                if (v.schema != subscribe_schema) return;
+                std::vector<uint64_t> filter;
+                const auto* ids = static_cast<const uint16_t*>(v.data);
+                if (v.size >= sizeof(uint16_t)) filter.assign(1024, 0);
+                for (uint32_t i = 0; i < v.size / sizeof(uint16_t); ++i) filter[ids[i] >> 6] |= uint64_t(1) << (ids[i] & 63);
+                std::lock_guard<std::mutex> lock(m_);
+                c.filter = std::move(filter);
+            });
+        }
+    }
+
+    // Moves the client's pending batch into flight and writes as much of
+    // everything in flight as the socket takes, in one gather call.
+    void flush(client& c) {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            if (!c.queued.empty()) {
+                c.backlog += c.queued.size();
+                c.inflight.push_back(std::move(c.queued));
+                if (!c.spare.empty()) {
+                    c.queued = std::move(c.spare.back());
+                    c.spare.pop_back();
+                } else {
+                    c.queued = std::vector<char>();
+                }
+                c.queued.clear();
+            }
+        }
+        while (!c.inflight.empty()) {
+            iovec iov[64];
+            size_t count = 0;
+            for (size_t i = 0; i < c.inflight.size() && count < sizeof(iov) / sizeof(iov[0]); ++i, ++count) {
+                size_t skip = i == 0 ? c.sent : 0;
+                iov[count].iov_base = c.inflight[i].data() + skip;
+                iov[count].iov_len  = c.inflight[i].size() - skip;
+            }
+            msghdr msg{};
+            msg.msg_iov    = iov;
+            msg.msg_iovlen = count;
+            ssize_t n = ::sendmsg(c.fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                c.closed = true;
+                return;
+            }
+            size_t left = static_cast<size_t>(n);
+            size_t done = 0;
+            while (!c.inflight.empty() && left > 0) {
+                size_t rest = c.inflight.front().size() - c.sent;
+                if (left < rest) {
+                    c.sent += left;
+                    done   += left;
+                    break;
+                }
+                left -= rest;
+                done += rest;
+                c.sent = 0;
+                c.inflight.front().clear();
+                c.spare.push_back(std::move(c.inflight.front()));
+                c.inflight.erase(c.inflight.begin());
+            }
+            std::lock_guard<std::mutex> lock(m_);
+            c.backlog -= done;
+        }
+        // Only ask for EPOLLOUT while the socket is actually full.
+        bool want = !c.inflight.empty();
+        if (want != c.want_out) {
+            epoll_event ev{};
+            ev.events   = EPOLLIN | EPOLLRDHUP | (want ? uint32_t(EPOLLOUT) : 0u);
+            ev.data.ptr = &c;
+            ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, c.fd, &ev);
+            c.want_out = want;
+        }
+    }
+
+    void reap() {
+        std::lock_guard<std::mutex> lock(m_);
+        for (auto it = clients_.begin(); it != clients_.end();) {
+            if ((*it)->closed) {
+                ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, (*it)->fd, nullptr);
+                ::close((*it)->fd);
+                it = clients_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    std::string                             path_;
+    size_t                                  max_backlog_;
+    int                                     listen_fd_ = -1;
+    int                                     wake_fd_   = -1;
+    int                                     epoll_fd_  = -1;
+
+    mutable std::mutex                      m_;
+    std::vector<std::unique_ptr<client>>    clients_;
+    bool                                    wake_pending_ = false;
+    std::atomic<uint64_t>                   dropped_{0};
+};
+
+// Receiving side, for native tools. Frames are parsed out of one reusable
+// buffer; nothing is allocated per message.
+class stream_client {
+public:
+    // Frames over max_frame end the stream (poll() returns -1).
+    explicit stream_client(const std::string& path, size_t buffer = 64 << 10, size_t max_frame = 16 << 20) : rx_(buffer, max_frame) {
+        fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd_ < 0) throw std::system_error(errno, std::generic_category(), "ipc: socket");
+        sockaddr_un addr = detail::unix_address(path);
+        if (::connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            int e = errno;
+            ::close(fd_);
+            throw std::system_error(e, std::generic_category(), "ipc: connect " + path);
+        }
+    }
+
+    stream_client(const stream_client&) = delete;
+    stream_client& operator=(const stream_client&) = delete;
+
+    ~stream_client() { ::close(fd_); }
+
+    // Restricts the stream to these schema ids; an empty list means all.
+    void subscribe(const std::vector<uint16_t>& schemas) {
+        std::vector<char> out;
+        detail::append_frame(out, subscribe_schema, 0, schemas.data(), static_cast<uint32_t>(schemas.size() * sizeof(uint16_t)));
+        for (size_t off = 0; off < out.size();) {
+            ssize_t n = ::send(fd_, out.data() + off, out.size() - off, MSG_NOSIGNAL);
+            if (n <= 0) throw std::system_error(errno, std::generic_category(), "ipc: subscribe");
+            off += static_cast<size_t>(n);
+        }
+    }
+
+    // Waits up to timeout for data, then calls f(ring::view) for every
+    // complete frame. Returns the number of frames, or -1 once the server
+    // has gone away.
+    template<typename F>
+    long poll(std::chrono::milliseconds timeout, F&& f) {
+        pollfd p{fd_, POLLIN, 0};
+        if (::poll(&p, 1, static_cast<int>(timeout.count())) <= 0) return 0;
+        size_t frames = 0;
+        for (;;) {
+            ssize_t n = rx_.fill(fd_);
+            if (n == 0) return -1;
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                return -1;
+            }
+            frames += rx_.parse(f);
+        }
+        return static_cast<long>(frames);
+    }
+
+    int fd() const { return fd_; }
+
+private:
+    int         fd_ = -1;
+    recv_ring   rx_;
+};
+
+// Streams a bus channel of trivially copyable messages to every subscribed
+// client of a server.
+template<typename T>
+class export_stream {
+public:
+    static_assert(std::is_trivially_copyable_v<T>, "ipc: only trivially copyable messages cross processes");
+
+    export_stream(bus::channel<T>& ch, stream_server& out, uint16_t schema, dispatch::dispatch& pool, bus::policy p = {})
+        : channel_(ch) {
+        box_ = ch.subscribe(pool, [&out, schema](const bus::message<T>& m) {
+            out.publish(schema, m.get(), sizeof(T));
+        }, p);
+    }
+
+    ~export_stream() { channel_.unsubscribe(box_); }
+
+private:
+    bus::channel<T>&                    channel_;
+    std::shared_ptr<bus::mailbox<T>>    box_;
+};
+
+};
@@ -0,0 +1,608 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <vector>
+
+#include "dispatch/dispatch.h"
+#include "frame/frame.h"
+
+namespace jpeg {
+
+// Baseline (sequential Huffman) JPEG decoding for camera MJPEG, with three
+// ways to do less work than a full decode:
+//
+//  - scale 2, 4 or 8 runs a reduced IDCT on the low-frequency corner of each
+//    block (1/8 is the DC term alone), so a 1080p frame comes out at 960x540,
+//    480x270 or 240x135 without ever existing at full size;
+//  - a region of interest skips the IDCT and colour conversion of every MCU
+//    outside it, and stops reading the scan after its last MCU row (or skips
+//    whole restart intervals when the stream has them);
+//  - grey output never reconstructs the chroma planes.
+//
+// Streams with restart markers are split at the markers and the intervals
+// are decoded in parallel on a dispatch pool. MJPEG frames that leave out
+// their Huffman tables get the standard ones (ITU T.81 Annex K).
+
+enum class pixel { bgr, rgb, grey };
+
+struct region {
+    uint32_t x = 0, y = 0, width = 0, height = 0;   // full-resolution pixels; width 0 = whole frame
+};
+
+struct options {
+    uint32_t    scale = 1;      // 1, 2, 4 or 8
+    region      roi;
+    pixel       out   = pixel::bgr;
+};
+
+struct info {
+    uint32_t width      = 0;
+    uint32_t height     = 0;
+    uint32_t components = 0;
+    uint32_t restart    = 0;    // MCUs per restart interval, 0 if none
+};
+
+namespace detail {
+
+constexpr uint8_t zigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+struct huffman {
+    static constexpr int lookahead = 9;
+
+    uint16_t    fast[1 << lookahead];       // (length << 8) | symbol, 0 = slow path
+    int32_t     maxcode[18];
+    int32_t     valoffset[18];
+    uint8_t     values[256];
+    bool        defined = false;
+
+    // False if the lengths over-subscribe the code space (Kraft inequality),
+    // which would index past fast[] and make decode ambiguous.
+    bool build(const uint8_t counts[16], const uint8_t* symbols, size_t n) {
+        defined = false;
+        std::memcpy(values, symbols, std::min<size_t>(n, 256));
+        std::memset(fast, 0, sizeof(fast));
+        int32_t code = 0;
+        size_t  k    = 0;
+        for (int len = 1; len <= 16; ++len) {
+            valoffset[len] = static_cast<int32_t>(k) - code;
+            if (code + counts[len - 1] > (1 << len)) return false;
+            for (int i = 0; i < counts[len - 1]; ++i, ++k, ++code) {
+                if (len <= lookahead) {
+                    int shift = lookahead - len;
+                    for (int f = 0; f < (1 << shift); ++f) {
+                        fast[(code << shift) | f] = static_cast<uint16_t>(len << 8 | values[k]);
+                    }
+                }
+            }
+            maxcode[len] = counts[len - 1] ? code - 1 : -1;
+            code <<= 1;
+        }
+        maxcode[17] = INT32_MAX;
+        defined = true;
+        return true;
+    }
+};
+
+// Standard tables from ITU T.81 K.3, for streams that omit DHT.
+inline void default_tables(huffman dc[4], huffman ac[4]) {
+    static const uint8_t dc_luma_counts[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+    static const uint8_t dc_chroma_counts[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+    static const uint8_t dc_values[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+    static const uint8_t ac_luma_counts[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+    static const uint8_t ac_luma_values[162] = {
+        0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+        0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+        0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+        0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+        0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+        0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+        0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+        0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+        0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+        0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa,
+    };
+    static const uint8_t ac_chroma_counts[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+    static const uint8_t ac_chroma_values[162] = {
+        0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+        0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+        0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+        0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+        0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+        0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+        0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+        0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+        0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+        0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+        0xf9, 0xfa,
+    };
+    if (!dc[0].defined) dc[0].build(dc_luma_counts, dc_values, 12);
+    if (!dc[1].defined) dc[1].build(dc_chroma_counts, dc_values, 12);
+    if (!ac[0].defined) ac[0].build(ac_luma_counts, ac_luma_values, 162);
+    if (!ac[1].defined) ac[1].build(ac_chroma_counts, ac_chroma_values, 162);
+}
+
+// Reads one entropy-coded segment (between restart markers), undoing byte
+// stuffing. Past the end it feeds zeros, which decode harmlessly.
+class bit_reader {
+public:
+    bit_reader(const uint8_t* p, const uint8_t* end) : p_(p), end_(end) {}
+
+    uint32_t peek(int n) {
+        if (bits_ < n) fill();
+        return static_cast<uint32_t>(buf_ >> (64 - n));
+    }
+
+    void skip(int n) {
+        buf_ <<= n;
+        bits_ -= n;
+    }
+
+    uint32_t get(int n) {
+        uint32_t v = peek(n);
+        skip(n);
+        return v;
+    }
+
+    // Value of an s-bit magnitude category (T.81 F.2.2.1 EXTEND).
+    int32_t receive(int s) {
+        if (s == 0) return 0;
+        int32_t v = static_cast<int32_t>(get(s));
+        return v < (1 << (s - 1)) ? v - (1 << s) + 1 : v;
+    }
+
+    int decode(const huffman& h) {
+        uint32_t look = peek(huffman::lookahead);
+        if (uint16_t e = h.fast[look]) {
+            skip(e >> 8);
+            return e & 0xFF;
+        }
+        uint32_t code = peek(16);
+        for (int len = huffman::lookahead + 1; len <= 16; ++len) {
+            int32_t c = static_cast<int32_t>(code >> (16 - len));
+            if (c <= h.maxcode[len]) {
+                skip(len);
+                return h.values[(c + h.valoffset[len]) & 0xFF];
+            }
+        }
+        skip(16);
+        return 0;   // corrupt code; keep going with a zero
+    }
+
+private:
+    void fill() {
+        while (bits_ <= 56) {
+            uint32_t b = 0;
+            if (p_ < end_) {
+                b = *p_++;
+                if (b == 0xFF && p_ < end_ && *p_ == 0x00) ++p_;
+            }
+            buf_ |= uint64_t(b) << (56 - bits_);
+            bits_ += 8;
+        }
+    }
+
+    const uint8_t*  p_;
+    const uint8_t*  end_;
+    uint64_t        buf_  = 0;
+    int             bits_ = 0;
+};
+
+// Reduced IDCT basis: an n-point inverse transform of the low n coefficients
+// of an 8-point DCT, which is the block downsampled by 8/n. Scaled so that
+// n = 8 is the ordinary JPEG IDCT and n = 1 is DC / 8.
+struct basis {
+    float m[8][8];      // m[x][u]
+
+    explicit basis(int n) {
+        const double pi = 3.14159265358979323846;
+        for (int x = 0; x < 8; ++x) {
+            for (int u = 0; u < 8; ++u) {
+                double c = u == 0 ? std::sqrt(0.125) : 0.5;
+                m[x][u] = (x < n && u < n) ? static_cast<float>(c * std::cos((2 * x + 1) * u * pi / (2 * n))) : 0.0f;
+            }
+        }
+    }
+
+    static const basis& get(int n) {
+        static const basis b1(1), b2(2), b4(4), b8(8);
+        return n == 8 ? b8 : n == 4 ? b4 : n == 2 ? b2 : b1;
+    }
+};
+
+// out (n x n) = M * coef * M^T, written with stride. Both passes are eight
+// independent lanes wide, which the compiler turns into vector code.
+inline void idct(const float coef[64], int n, uint8_t* out, size_t stride) {
+    const basis& b = basis::get(n);
+    float tmp[8][8];    // tmp[v][x]: rows transformed
+    for (int v = 0; v < n; ++v) {
+        const float* row = coef + v * 8;
+        float acc[8] = {};
+        for (int u = 0; u < n; ++u) {
+            float c = row[u];
+            if (c == 0.0f) continue;
+            for (int x = 0; x < 8; ++x) acc[x] += b.m[x][u] * c;
+        }
+        std::memcpy(tmp[v], acc, sizeof(acc));
+    }
+    for (int y = 0; y < n; ++y) {
+        float acc[8] = {};
+        for (int v = 0; v < n; ++v) {
+            float c = b.m[y][v];
+            for (int x = 0; x < 8; ++x) acc[x] += c * tmp[v][x];
+        }
+        uint8_t* dst = out + y * stride;
+        for (int x = 0; x < n; ++x) {
+            float p = acc[x] + 128.5f;
+            dst[x] = static_cast<uint8_t>(p < 0.0f ? 0.0f : p > 255.0f ? 255.0f : p);
+        }
+    }
+}
+
+};
+
+class decoder {
+public:
+    // Parses the headers; false if this is not a baseline JPEG we can decode.
+    bool parse(const uint8_t* data, size_t size) {
+        info_  = {};
+        scan_  = nullptr;
+        scan_end_ = nullptr;
+        for (auto& h : dc_) h.defined = false;
+        for (auto& h : ac_) h.defined = false;
+        if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) return false;
+        const uint8_t* p   = data + 2;
+        const uint8_t* end = data + size;
+        bool frame = false;
+        while (p + 4 <= end) {
+            if (p[0] != 0xFF) return false;
+            uint8_t marker = p[1];
+            if (marker == 0xFF) {
+                ++p;
+                continue;
+            }
+            size_t len = size_t(p[2]) << 8 | p[3];
+            const uint8_t* seg = p + 4;
+            if (p + 2 + len > end || len < 2) return false;
+            switch (marker) {
+            case 0xDB:
+                if (!parse_dqt(seg, len - 2)) return false;
+                break;
+            case 0xC4:
+                if (!parse_dht(seg, len - 2)) return false;
+                break;
+            case 0xC0:
+            case 0xC1:
+                if (!parse_sof(seg, len - 2)) return false;
+                frame = true;
+                break;
+            case 0xDD:
+                info_.restart = uint32_t(seg[0]) << 8 | seg[1];
+                break;
+            case 0xDA:
+                detail::default_tables(dc_, ac_);
+                if (!frame || !parse_sos(seg, len - 2)) return false;
+                scan_ = p + 2 + len;
+                find_intervals(end);
+                return true;
+            default:
+                if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+                    return false;   // progressive, lossless, arithmetic
+                }
+                break;
+            }
+            p += 2 + len;
+        }
+        return false;
+    }
+
+    const info& header() const { return info_; }
+
+    // Size of the image decode() produces for these options.
+    void output_size(const options& o, uint32_t& w, uint32_t& h) const {
+        uint32_t x0, y0;
+        crop(o, x0, y0, w, h);
+    }
+
+    // Decodes the last parsed image into out (rows stride bytes apart).
+    bool decode(const options& o, uint8_t* out, size_t stride, dispatch::dispatch* pool = nullptr) {
+        if (!scan_) return false;
+        int n = o.scale == 8 ? 1 : o.scale == 4 ? 2 : o.scale == 2 ? 4 : 8;
+
+        uint32_t x0, y0, w, h;
+        crop(o, x0, y0, w, h);
+        if (!w || !h) return false;
+
+        // MCUs that touch the region, in scaled pixels.
+        uint32_t mcu_w = uint32_t(n) * hmax_, mcu_h = uint32_t(n) * vmax_;
+        uint32_t mx0 = x0 / mcu_w, mx1 = (x0 + w + mcu_w - 1) / mcu_w;
+        uint32_t my0 = y0 / mcu_h, my1 = (y0 + h + mcu_h - 1) / mcu_h;
+
+        size_t used = o.out == pixel::grey ? 1 : comps_.size();
+        for (size_t c = 0; c < comps_.size(); ++c) {
+            auto& comp = comps_[c];
+            comp.needed = c < used;
+            comp.stride = size_t(mcux_) * comp.h * n;
+            if (comp.needed) comp.plane.resize(comp.stride * size_t(mcuy_) * comp.v * n);
+        }
+
+        job j{n, mx0, mx1, my0, my1};
+        if (intervals_.size() > 1) {
+            uint32_t first = my0 * mcux_ + mx0, last = (my1 - 1) * mcux_ + mx1 - 1;
+            uint32_t i0 = first / info_.restart, i1 = last / info_.restart + 1;
+            // A truncated frame has fewer markers than MCUs call for.
+            i1 = std::min<uint32_t>(i1, static_cast<uint32_t>(intervals_.size()));
+            i0 = std::min(i0, i1);
+            dispatch::parallel_for(pool, i1 - i0, [&](size_t k) { decode_interval(j, i0 + static_cast<uint32_t>(k)); });
+        } else {
+            decode_interval(j, 0);
+        }
+
+        size_t bands = pool ? std::min<size_t>(h / 16 + 1, pool->workers() + 1) : 1;
+        dispatch::parallel_for(pool, bands, [&](size_t b) {
+            uint32_t r0 = static_cast<uint32_t>(h * b / bands), r1 = static_cast<uint32_t>(h * (b + 1) / bands);
+            convert(o, x0, y0, w, r0, r1, out, stride);
+        });
+        return true;
+    }
+
+    // Decodes a captured MJPEG frame into a fresh frame from pool.
+    frame::frame decode(const frame::frame& in, frame::pool& pool, const options& o, dispatch::dispatch* workers = nullptr) {
+        if (!in || !parse(in.data(), in.layout().bytes ? in.layout().bytes : in.capacity())) return {};
+        uint32_t w, h;
+        output_size(o, w, h);
+        uint32_t ch = o.out == pixel::grey ? 1 : 3;
+        frame::frame f = pool.acquire();
+        if (!f || f.capacity() < size_t(w) * h * ch) return {};
+        if (!decode(o, f.data(), size_t(w) * ch, workers)) return {};
+        uint32_t fcc = o.out == pixel::grey ? frame::grey : o.out == pixel::rgb ? frame::rgb24 : frame::bgr24;
+        f.set({w, h, w * ch, fcc, w * h * ch}, in.timestamp_ns());
+        return f;
+    }
+
+private:
+    struct component {
+        uint8_t                 id = 0, h = 1, v = 1, tq = 0, td = 0, ta = 0;
+        bool                    needed = false;
+        size_t                  stride = 0;
+        std::vector<uint8_t>    plane;
+    };
+
+    struct job {
+        int         n;
+        uint32_t    mx0, mx1, my0, my1;
+    };
+
+    bool parse_dqt(const uint8_t* p, size_t len) {
+        while (len >= 65) {
+            int pq = p[0] >> 4, tq = p[0] & 3;
+            size_t bytes = pq ? 129 : 65;
+            if (len < bytes) return false;
+            for (int k = 0; k < 64; ++k) {
+                uint16_t q = pq ? uint16_t(p[1 + 2 * k] << 8 | p[2 + 2 * k]) : p[1 + k];
+                quant_[tq][detail::zigzag[k]] = q;
+            }
+            p += bytes;
+            len -= bytes;
+        }
+        return true;
+    }
+
+    bool parse_dht(const uint8_t* p, size_t len) {
+        while (len >= 17) {
+            int tc = p[0] >> 4, th = p[0] & 3;
+            size_t n = 0;
+            for (int i = 0; i < 16; ++i) n += p[1 + i];
+            if (len < 17 + n || n > 256) return false;
+            // DC symbols are magnitude categories; receive() takes at most 11.
+            if (!tc && std::any_of(p + 17, p + 17 + n, [](uint8_t s) { return s > 11; })) return false;
+            if (!(tc ? ac_ : dc_)[th].build(p + 1, p + 17, n)) return false;
+            p += 17 + n;
+            len -= 17 + n;
+        }
+        return true;
+    }
+
+    bool parse_sof(const uint8_t* p, size_t len) {
+        if (len < 6 || p[0] != 8) return false;
+        info_.height     = uint32_t(p[1]) << 8 | p[2];
+        info_.width      = uint32_t(p[3]) << 8 | p[4];
+        info_.components = p[5];
+        if (!info_.width || !info_.height || (p[5] != 1 && p[5] != 3) || len < 6 + 3 * size_t(p[5])) return false;
+        comps_.resize(p[5]);
+        hmax_ = vmax_ = 1;
+        for (size_t c = 0; c < comps_.size(); ++c) {
+            comps_[c].id = p[6 + 3 * c];
+            comps_[c].h  = p[7 + 3 * c] >> 4;
+            comps_[c].v  = p[7 + 3 * c] & 15;
+            comps_[c].tq = p[8 + 3 * c] & 3;
+            if (comps_[c].h < 1 || comps_[c].h > 2 || comps_[c].v < 1 || comps_[c].v > 2) return false;
+            hmax_ = std::max<uint32_t>(hmax_, comps_[c].h);
+            vmax_ = std::max<uint32_t>(vmax_, comps_[c].v);
+        }
+        if (comps_.size() == 1) comps_[0].h = comps_[0].v = 1, hmax_ = vmax_ = 1;
+        mcux_ = (info_.width + 8 * hmax_ - 1) / (8 * hmax_);
+        mcuy_ = (info_.height + 8 * vmax_ - 1) / (8 * vmax_);
+        return true;
+    }
+
+    bool parse_sos(const uint8_t* p, size_t len) {
+        // Only single-scan interleaved images: every component in this scan.
+        if (len < 1 || p[0] != comps_.size() || len < 4 + 2 * size_t(p[0])) return false;
+        for (size_t i = 0; i < comps_.size(); ++i) {
+            uint8_t id = p[1 + 2 * i];
+            auto it = std::find_if(comps_.begin(), comps_.end(), [id](const component& c) { return c.id == id; });
+            if (it == comps_.end()) return false;
+            it->td = p[2 + 2 * i] >> 4 & 3;
+            it->ta = p[2 + 2 * i] & 3;
+            if (!dc_[it->td].defined || !ac_[it->ta].defined) return false;
+        }
+        return true;
+    }
+
+    // One pass over the entropy-coded data: where it ends and where each
+    // restart interval begins.
+    void find_intervals(const uint8_t* end) {
+        intervals_.clear();
+        intervals_.push_back(scan_);
+        const uint8_t* p = scan_;
+        for (;;) {
+            p = static_cast<const uint8_t*>(std::memchr(p, 0xFF, static_cast<size_t>(end - p)));
+            if (!p || p + 1 >= end) {
+                scan_end_ = end;
+                break;
+            }
+            uint8_t m = p[1];
+            if (m == 0x00 || m == 0xFF) {
+                p += m == 0x00 ? 2 : 1;
+            } else if (m >= 0xD0 && m <= 0xD7) {
+                intervals_.push_back(p + 2);
+                p += 2;
+            } else {
+                scan_end_ = p;
+                break;
+            }
+        }
+        if (!info_.restart) intervals_.resize(1);
+    }
+
+    void decode_interval(const job& j, uint32_t index) {
+        const uint8_t* begin = intervals_[index];
+        const uint8_t* end   = index + 1 < intervals_.size() ? intervals_[index + 1] - 2 : scan_end_;
+        uint32_t total = mcux_ * mcuy_;
+        uint32_t first = info_.restart ? index * info_.restart : 0;
+        uint32_t last  = info_.restart ? std::min(total, first + info_.restart) : total;
+        // Nothing after the region's last MCU row matters.
+        last = std::min(last, j.my1 * mcux_);
+
+        detail::bit_reader bits(begin, end);
+        int32_t pred[4] = {};
+        alignas(32) float coef[64];
+        for (uint32_t m = first; m < last; ++m) {
+            uint32_t mx = m % mcux_, my = m / mcux_;
+            bool inside = mx >= j.mx0 && mx < j.mx1 && my >= j.my0;
+            for (size_t c = 0; c < comps_.size(); ++c) {
+                component& comp = comps_[c];
+                bool keep = inside && comp.needed;
+                for (uint32_t by = 0; by < comp.v; ++by) {
+                    for (uint32_t bx = 0; bx < comp.h; ++bx) {
+                        decode_block(bits, comp, pred[c], keep ? coef : nullptr, j.n);
+                        if (!keep) continue;
+                        size_t px = (size_t(mx) * comp.h + bx) * j.n;
+                        size_t py = (size_t(my) * comp.v + by) * j.n;
+                        detail::idct(coef, j.n, comp.plane.data() + py * comp.stride + px, comp.stride);
+                    }
+                }
+            }
+        }
+    }
+
+    // Always consumes the block's bits; dequantizes only the n x n corner
+    // the reduced IDCT reads, and only when coef is wanted.
+    void decode_block(detail::bit_reader& bits, const component& comp, int32_t& pred, float* coef, int n) {
+        const detail::huffman& dc = dc_[comp.td];
+        const detail::huffman& ac = ac_[comp.ta];
+        const uint16_t* q = quant_[comp.tq];
+        pred += bits.receive(bits.decode(dc));
+        if (coef) {
+            std::memset(coef, 0, 64 * sizeof(float));
+            coef[0] = float(pred * q[0]);
+        }
+        for (int k = 1; k < 64;) {
+            int rs = bits.decode(ac);
+            int r = rs >> 4, s = rs & 15;
+            if (s == 0) {
+                if (r != 15) break;
+                k += 16;
+                continue;
+            }
+            k += r;
+            if (k > 63) break;
+            int32_t v = bits.receive(s);
+            if (coef) {
+                int z = detail::zigzag[k];
+                if ((z & 7) < n && (z >> 3) < n) coef[z] = float(v * q[z]);
+            }
+            ++k;
+        }
+    }
+
+    void crop(const options& o, uint32_t& x0, uint32_t& y0, uint32_t& w, uint32_t& h) const {
+        uint32_t s  = o.scale == 8 || o.scale == 4 || o.scale == 2 ? o.scale : 1;
+        uint32_t sw = (info_.width + s - 1) / s, sh = (info_.height + s - 1) / s;
+        region r = o.roi.width && o.roi.height ? o.roi : region{0, 0, info_.width, info_.height};
+        x0 = std::min(r.x / s, sw);
+        y0 = std::min(r.y / s, sh);
+        w  = std::min((r.x + r.width + s - 1) / s, sw) - x0;
+        h  = std::min((r.y + r.height + s - 1) / s, sh) - y0;
+    }
+
+    // Upsamples chroma (nearest) and converts rows [r0, r1) of the output.
+    void convert(const options& o, uint32_t x0, uint32_t y0, uint32_t w, uint32_t r0, uint32_t r1, uint8_t* out, size_t stride) const {
+        const component& Y = comps_[0];
+        if (o.out == pixel::grey || comps_.size() == 1) {
+            for (uint32_t r = r0; r < r1; ++r) {
+                const uint8_t* src = Y.plane.data() + size_t(y0 + r) * Y.stride + x0;
+                uint8_t* dst = out + r * stride;
+                if (o.out == pixel::grey) {
+                    std::memcpy(dst, src, w);
+                } else {
+                    for (uint32_t x = 0; x < w; ++x) dst[3 * x] = dst[3 * x + 1] = dst[3 * x + 2] = src[x];
+                }
+            }
+            return;
+        }
+        const component& Cb = comps_[1];
+        const component& Cr = comps_[2];
+        dispatch::scratch tmp;
+        std::pmr::vector<int32_t> cb(w, &tmp.resource()), cr(w, &tmp.resource());
+        bool bgr = o.out == pixel::bgr;
+        for (uint32_t r = r0; r < r1; ++r) {
+            uint32_t sy = y0 + r;
+            const uint8_t* yrow  = Y.plane.data() + size_t(sy) * Y.stride + x0;
+            const uint8_t* cbrow = Cb.plane.data() + size_t(sy * Cb.v / vmax_) * Cb.stride;
+            const uint8_t* crrow = Cr.plane.data() + size_t(sy * Cr.v / vmax_) * Cr.stride;
+            for (uint32_t x = 0; x < w; ++x) {
+                cb[x] = int32_t(cbrow[(x0 + x) * Cb.h / hmax_]) - 128;
+                cr[x] = int32_t(crrow[(x0 + x) * Cr.h / hmax_]) - 128;
+            }
+            uint8_t* dst = out + r * stride;
+            // 16.16 fixed point BT.601 (JFIF) conversion.
+            for (uint32_t x = 0; x < w; ++x) {
+                int32_t yy = int32_t(yrow[x]) << 16;
+                int32_t rr = (yy + 91881 * cr[x] + 32768) >> 16;
+                int32_t gg = (yy - 22554 * cb[x] - 46802 * cr[x] + 32768) >> 16;
+                int32_t bb = (yy + 116130 * cb[x] + 32768) >> 16;
+                rr = rr < 0 ? 0 : rr > 255 ? 255 : rr;
+                gg = gg < 0 ? 0 : gg > 255 ? 255 : gg;
+                bb = bb < 0 ? 0 : bb > 255 ? 255 : bb;
+                dst[3 * x]     = static_cast<uint8_t>(bgr ? bb : rr);
+                dst[3 * x + 1] = static_cast<uint8_t>(gg);
+                dst[3 * x + 2] = static_cast<uint8_t>(bgr ? rr : bb);
+            }
+        }
+    }
+
+    info                            info_;
+    uint16_t                        quant_[4][64] = {};
+    detail::huffman                 dc_[4];
+    detail::huffman                 ac_[4];
+    std::vector<component>          comps_;
+    uint32_t                        hmax_ = 1, vmax_ = 1;
+    uint32_t                        mcux_ = 0, mcuy_ = 0;
+    const uint8_t*                  scan_     = nullptr;
+    const uint8_t*                  scan_end_ = nullptr;
+    std::vector<const uint8_t*>     intervals_;
+};
+
+};
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "laser/spot.h"
+
+namespace laser {
+
+// Temporal consensus over per-frame spot candidates: the laser dot is the
+// candidate that keeps showing up at the same pixel while glints and
+// reflections come and go.
+//
+// Candidates join the nearest cluster whose mean is within radius, found
+// through a spatial hash with radius-sized cells (so only the 3x3 cells
+// around a candidate are searched), or start a new one. Each cluster keeps
+// the samples of the last window frames in a ring, at most one per frame,
+// and Welford mean and variance over exactly those samples: a sample is
+// added when it arrives and removed again when its frame leaves the window,
+// so nothing is recomputed. After every frame the best cluster present in
+// enough of the window is the fix, ranked like detect_laser_multiframe:
+//
+//   frames * 100 + 50 / (1 + var_x + var_y) + mean score
+//
+// A fix is therefore available from the frame that completes the evidence,
+// and follows the camera frame by frame after that.
+
+struct consensus_options {
+    uint32_t    window      = 8;        // frames of evidence, at most max_window
+    float       min_ratio   = 0.7f;     // of the window a cluster must appear in
+    uint32_t    min_frames  = 2;
+    float       radius      = 15.0f;    // pixels
+};
+
+struct fix {
+    float       x = 0, y = 0;           // cluster mean, pixels
+    float       variance = 0;           // var x + var y, pixels^2
+    float       score    = 0;           // mean peak score
+    uint32_t    frames   = 0;           // frames of the window present
+    uint32_t    cluster  = 0;           // id, stable while the cluster lives
+};
+
+template<size_t Capacity = 64>
+class consensus {
+    static_assert(Capacity > 0 && Capacity < 32768, "consensus: cluster links are int16");
+
+public:
+    static constexpr size_t capacity   = Capacity;
+    static constexpr size_t max_window = 32;
+
+    explicit consensus(consensus_options o = {}) : opt_(o) {
+        opt_.window = std::clamp<uint32_t>(opt_.window, 1, max_window);
+        opt_.radius = std::max(opt_.radius, 1.0f);
+        need_ = std::max(opt_.min_frames, static_cast<uint32_t>(float(opt_.window) * opt_.min_ratio));
+        need_ = std::min(need_, opt_.window);
+        clear();
+    }
+
+    const consensus_options& options() const { return opt_; }
+
+    // Frames a cluster needs before it can be the fix.
+    uint32_t evidence() const { return need_; }
+
+    void clear() {
+        heads_.fill(none);
+        for (cluster& c : clusters_) c.live = false;
+        frame_ = 0;
+    }
+
+    // Feeds one frame's candidates (spot_detector order: best first). True,
+    // with out filled, when a cluster has enough evidence.
+    bool update(const spot* spots, size_t n, fix& out) {
+        ++frame_;
+        expire();
+        for (size_t i = 0; i < n; ++i) {
+            float x = spots[i].x, y = spots[i].y;
+            int32_t k = nearest(x, y);
+            if (k < 0) {
+                k = allocate(x, y);
+                if (k < 0) continue;
+            }
+            cluster& c = clusters_[k];
+            // A second candidate in the same frame is a neighbour, not more
+            // evidence; the first one was the brighter.
+            if (c.count && c.ring[(c.first + c.count - 1) % max_window].frame == frame_) continue;
+            add(c, {x, y, float(spots[i].peak), frame_});
+            rehash(static_cast<uint32_t>(k));
+        }
+        return best(out);
+    }
+
+    bool update(const std::vector<spot>& spots, fix& out) { return update(spots.data(), spots.size(), out); }
+
+private:
+    static constexpr int16_t    none    = -1;
+    static constexpr size_t     buckets = [] {
+        size_t b = 16;
+        while (b < 2 * Capacity) b *= 2;
+        return b;
+    }();
+
+    struct sample {
+        float       x, y, score;
+        uint64_t    frame;
+    };
+
+    struct cluster {
+        bool                            live = false;
+        uint32_t                        id = 0;
+        int32_t                         cx = 0, cy = 0;     // hash cell
+        int16_t                         next = none;        // bucket chain
+        std::array<sample, max_window>  ring;
+        uint32_t                        first = 0, count = 0;
+        double                          mx = 0, my = 0;     // Welford means
+        double                          sx = 0, sy = 0;     // and sums of squares
+        double                          score = 0;          // sum of sample scores
+    };
+
+    static void add(cluster& c, const sample& s) {
+        c.ring[(c.first + c.count) % max_window] = s;
+        ++c.count;
+        double n = double(c.count);
+        double dx = s.x - c.mx, dy = s.y - c.my;
+        c.mx += dx / n;
+        c.my += dy / n;
+        c.sx += dx * (s.x - c.mx);
+        c.sy += dy * (s.y - c.my);
+        c.score += s.score;
+    }
+
+    static void remove_oldest(cluster& c) {
+        const sample& s = c.ring[c.first];
+        c.first = (c.first + 1) % max_window;
+        --c.count;
+        if (c.count == 0) {
+            c.mx = c.my = c.sx = c.sy = c.score = 0;
+            return;
+        }
+        double n = double(c.count);
+        double ox = c.mx, oy = c.my;
+        c.mx = (ox * (n + 1) - s.x) / n;
+        c.my = (oy * (n + 1) - s.y) / n;
+        c.sx = std::max(0.0, c.sx - (s.x - ox) * (s.x - c.mx));
+        c.sy = std::max(0.0, c.sy - (s.y - oy) * (s.y - c.my));
+        c.score -= s.score;
+    }
+
+    // Drops samples whose frame has left the window, and empty clusters.
+    void expire() {
+        for (uint32_t k = 0; k < Capacity; ++k) {
+            cluster& c = clusters_[k];
+            if (!c.live) continue;
+            bool moved = false;
+            while (c.count && c.ring[c.first].frame + opt_.window <= frame_) {
+                remove_oldest(c);
+                moved = true;
+            }
+            if (c.count == 0) {
+                unlink(k);
+                c.live = false;
+            } else if (moved) {
+                rehash(k);
+            }
+        }
+    }
+
+    int32_t cell(float v) const { return static_cast<int32_t>(std::floor(v / opt_.radius)); }
+
+    static size_t bucket(int32_t cx, int32_t cy) {
+        return (uint32_t(cx) * 73856093u ^ uint32_t(cy) * 19349663u) & (buckets - 1);
+    }
+
+    int32_t nearest(float x, float y) const {
+        int32_t cx = cell(x), cy = cell(y);
+        float best = opt_.radius * opt_.radius;
+        int32_t found = -1;
+        for (int32_t dy = -1; dy <= 1; ++dy) {
+            for (int32_t dx = -1; dx <= 1; ++dx) {
+                for (int16_t k = heads_[bucket(cx + dx, cy + dy)]; k != none; k = clusters_[k].next) {
+                    const cluster& c = clusters_[k];
+                    if (c.cx != cx + dx || c.cy != cy + dy) continue;
+                    float ex = x - float(c.mx), ey = y - float(c.my);
+                    float d = ex * ex + ey * ey;
+                    if (d < best) best = d, found = k;
+                }
+            }
+        }
+        return found;
+    }
+
+    void link(uint32_t k) {
+        cluster& c = clusters_[k];
+        size_t b = bucket(c.cx, c.cy);
+        c.next = heads_[b];
+        heads_[b] = static_cast<int16_t>(k);
+    }
+
+    void unlink(uint32_t k) {
+        cluster& c = clusters_[k];
+        int16_t* p = &heads_[bucket(c.cx, c.cy)];
+        while (*p != none && *p != int16_t(k)) p = &clusters_[*p].next;
+        if (*p != none) *p = c.next;
+        c.next = none;
+    }
+
+    // Moves a cluster to the cell its mean is in now.
+    void rehash(uint32_t k) {
+        cluster& c = clusters_[k];
+        int32_t cx = cell(float(c.mx)), cy = cell(float(c.my));
+        if (cx == c.cx && cy == c.cy) return;
+        unlink(k);
+        c.cx = cx;
+        c.cy = cy;
+        link(k);
+    }
+
+    // A free slot, or the one with the least evidence when full.
+    int32_t allocate(float x, float y) {
+        int32_t slot = -1;
+        for (uint32_t k = 0; k < Capacity; ++k) {
+            if (!clusters_[k].live) {
+                slot = int32_t(k);
+                break;
+            }
+            if (slot < 0 || clusters_[k].count < clusters_[slot].count) slot = int32_t(k);
+        }
+        if (slot < 0) return -1;
+        cluster& c = clusters_[slot];
+        if (c.live) {
+            // Never displace a cluster with more than one frame of evidence.
+            if (c.count > 1) return -1;
+            unlink(uint32_t(slot));
+        }
+        c.live  = true;
+        c.id    = ++ids_;
+        c.first = c.count = 0;
+        c.mx = c.my = c.sx = c.sy = c.score = 0;
+        c.cx = cell(x);
+        c.cy = cell(y);
+        link(uint32_t(slot));
+        return slot;
+    }
+
+    bool best(fix& out) const {
+        double top = -1;
+        for (const cluster& c : clusters_) {
+            if (!c.live || c.count < need_) continue;
+            double n = double(c.count);
+            double var = (c.sx + c.sy) / n;
+            double mean = c.score / n;
+            double rank = n * 100.0 + 50.0 / (1.0 + var) + mean;
+            if (rank <= top) continue;
+            top = rank;
+            out.x        = float(c.mx);
+            out.y        = float(c.my);
+            out.variance = float(var);
+            out.score    = float(mean);
+            out.frames   = c.count;
+            out.cluster  = c.id;
+        }
+        return top >= 0;
+    }
+
+    consensus_options                   opt_;
+    uint32_t                            need_  = 2;
+    uint64_t                            frame_ = 0;
+    uint32_t                            ids_   = 0;
+    std::array<cluster, Capacity>       clusters_;
+    std::array<int16_t, buckets>        heads_;
+};
+
+};
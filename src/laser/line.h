@@ -0,0 +1,295 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "bus/bus.h"
+#include "dispatch/dispatch.h"
+#include "frame/frame.h"
+#include "laser/range.h"
+#include "schema/messages.h"
+#include "vision/letterbox.h"
+
+namespace laser {
+
+// Structured-light line scanning: with the dot optics swapped for a line
+// generator, every image column sees the laser at some row, and the same
+// z = a / (v - v0) + b triangulation turns each column's row into a range.
+// One frame gives a depth scanline of width samples instead of one dot.
+//
+// The signal is the red excess max(R - max(G, B), 0) for colour frames and
+// luma for grey and YUYV ones (an IR line behind a filter). The first pass
+// streams the rows of the search band once, keeping a running per-column
+// maximum and its row in two width-sized arrays; that update is a
+// branch-free select the compiler vectorizes, and the colour signal has
+// NEON and SSSE3 kernels. The second pass visits only a few rows around
+// each column's peak to place it to a fraction of a pixel, either by the
+// centre of mass of the samples above half the peak or by a three-point
+// Gaussian (log-parabola) fit, and reads the range from a per-row table
+// interpolated at that row.
+
+enum class peak_fit { centroid, gaussian };
+
+struct line_options {
+    peak_fit    fit         = peak_fit::centroid;
+    uint8_t     min_peak    = 40;       // weaker columns have no reading
+    uint32_t    half_width  = 3;        // centroid window: rows either side of the peak
+    uint32_t    top         = 0;        // search band, rows [top, bottom)
+    uint32_t    bottom      = 0;        // 0: to the last row
+};
+
+namespace detail {
+
+// max(R - max(G, B), 0) for n packed pixels; B, G, R order unless rgb.
+inline void red_excess_row(const uint8_t* px, uint32_t n, bool rgb, uint8_t* out) {
+    const int rc = rgb ? 0 : 2, bc = rgb ? 2 : 0;
+    uint32_t x = 0;
+#if defined(__SSSE3__)
+    constexpr char z = -1;
+    const __m128i take[3][3] = {
+        {_mm_setr_epi8(0, 3, 6, 9, 12, 15, z, z, z, z, z, z, z, z, z, z),
+         _mm_setr_epi8(z, z, z, z, z, z, 2, 5, 8, 11, 14, z, z, z, z, z),
+         _mm_setr_epi8(z, z, z, z, z, z, z, z, z, z, z, 1, 4, 7, 10, 13)},
+        {_mm_setr_epi8(1, 4, 7, 10, 13, z, z, z, z, z, z, z, z, z, z, z),
+         _mm_setr_epi8(z, z, z, z, z, 0, 3, 6, 9, 12, 15, z, z, z, z, z),
+         _mm_setr_epi8(z, z, z, z, z, z, z, z, z, z, z, 2, 5, 8, 11, 14)},
+        {_mm_setr_epi8(2, 5, 8, 11, 14, z, z, z, z, z, z, z, z, z, z, z),
+         _mm_setr_epi8(z, z, z, z, z, 1, 4, 7, 10, 13, z, z, z, z, z, z),
+         _mm_setr_epi8(z, z, z, z, z, z, z, z, z, z, 0, 3, 6, 9, 12, 15)},
+    };
+    for (; x + 16 <= n; x += 16) {
+        const __m128i* src = reinterpret_cast<const __m128i*>(px + size_t(x) * 3);
+        __m128i a0 = _mm_loadu_si128(src), a1 = _mm_loadu_si128(src + 1), a2 = _mm_loadu_si128(src + 2);
+        auto channel = [&](int c) {
+            return _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, take[c][0]), _mm_shuffle_epi8(a1, take[c][1])),
+                                _mm_shuffle_epi8(a2, take[c][2]));
+        };
+        __m128i v = _mm_subs_epu8(channel(rc), _mm_max_epu8(channel(1), channel(bc)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), v);
+    }
+#elif defined(__ARM_NEON)
+    for (; x + 16 <= n; x += 16) {
+        uint8x16x3_t p = vld3q_u8(px + size_t(x) * 3);
+        vst1q_u8(out + x, vqsubq_u8(p.val[rc], vmaxq_u8(p.val[1], p.val[bc])));
+    }
+#endif
+    for (; x < n; ++x) {
+        const uint8_t* p = px + size_t(x) * 3;
+        uint8_t mx = std::max(p[1], p[bc]);
+        out[x] = p[rc] > mx ? uint8_t(p[rc] - mx) : 0;
+    }
+}
+
+// Running per-column maximum; ties keep the upper row.
+inline void track_peak(const uint8_t* s, uint32_t n, uint16_t y, uint8_t* best, uint16_t* row) {
+    for (uint32_t x = 0; x < n; ++x) {
+        bool up = s[x] > best[x];
+        best[x] = up ? s[x] : best[x];
+        row[x]  = up ? y : row[x];
+    }
+}
+
+};
+
+class line_scanner {
+public:
+    explicit line_scanner(range_model m = {}, line_options o = {}) : model_(m), opt_(o) {}
+
+    const line_options& options() const { return opt_; }
+    const range_model&  model() const { return model_; }
+
+    void calibrate(const range_model& m) {
+        model_ = m;
+        lut_rows_ = 0;
+    }
+
+    // Depth per column in metres, NaN where there is no reading. The result
+    // is reused by the next call.
+    const std::vector<float>& run(const frame::frame& f) {
+        depth_.clear();
+        if (!f) return depth_;
+        const frame::format& l = f.layout();
+        kind k;
+        if (l.fourcc == frame::bgr24) k = kind::bgr;
+        else if (l.fourcc == frame::rgb24) k = kind::rgb;
+        else if (l.fourcc == frame::grey) k = kind::grey;
+        else if (l.fourcc == frame::yuyv) k = kind::yuyv;
+        else return depth_;
+        return run(f.data(), l.width, l.height, l.stride, k);
+    }
+
+    const std::vector<float>& run(const vision::image& img) {
+        depth_.clear();
+        if (!img.data) return depth_;
+        size_t stride = img.stride ? img.stride : size_t(img.width) * 3;
+        return run(img.data, img.width, img.height, stride, img.in == vision::order::rgb ? kind::rgb : kind::bgr);
+    }
+
+    // Subpixel laser row per column (NaN where none) and peak signal, for
+    // calibration and debugging.
+    const std::vector<float>&   rows() const { return rows_; }
+    const std::vector<uint8_t>& peaks() const { return best_; }
+
+    // Columns with a reading in the last frame.
+    uint32_t valid() const { return valid_; }
+
+private:
+    enum class kind { bgr, rgb, grey, yuyv };
+
+    const std::vector<float>& run(const uint8_t* data, uint32_t w, uint32_t h, size_t stride, kind k) {
+        uint32_t top = std::min(opt_.top, h);
+        uint32_t bottom = opt_.bottom ? std::min(opt_.bottom, h) : h;
+        constexpr float nan = std::numeric_limits<float>::quiet_NaN();
+        depth_.assign(w, nan);
+        rows_.assign(w, nan);
+        best_.assign(w, 0);
+        row_.assign(w, 0);
+        signal_.resize(w);
+        valid_ = 0;
+        if (!w || top >= bottom || h > 65535) return depth_;
+        table(h);
+
+        // Pass 1: per-column maximum over the band.
+        for (uint32_t y = top; y < bottom; ++y) {
+            const uint8_t* line = data + size_t(y) * stride;
+            const uint8_t* s = signal(line, w, k);
+            detail::track_peak(s, w, static_cast<uint16_t>(y), best_.data(), row_.data());
+        }
+
+        // Pass 2: subpixel row and range for columns with a peak.
+        for (uint32_t x = 0; x < w; ++x) {
+            if (best_[x] < opt_.min_peak) continue;
+            auto at = [&](int64_t y) -> float {
+                if (y < int64_t(top) || y >= int64_t(bottom)) return 0.0f;
+                return float(sample(data + size_t(y) * stride, x, k));
+            };
+            float v = opt_.fit == peak_fit::gaussian ? gaussian(at, row_[x]) : centroid(at, row_[x], best_[x]);
+            rows_[x] = v;
+            depth_[x] = lookup(v);
+            if (!std::isnan(depth_[x])) ++valid_;
+        }
+        return depth_;
+    }
+
+    // One row of signal: a view of the frame for grey, otherwise computed.
+    const uint8_t* signal(const uint8_t* line, uint32_t w, kind k) {
+        switch (k) {
+        case kind::grey:
+            return line;
+        case kind::yuyv:
+            for (uint32_t x = 0; x < w; ++x) signal_[x] = line[size_t(x) * 2];
+            return signal_.data();
+        default:
+            detail::red_excess_row(line, w, k == kind::rgb, signal_.data());
+            return signal_.data();
+        }
+    }
+
+    static uint8_t sample(const uint8_t* line, uint32_t x, kind k) {
+        switch (k) {
+        case kind::grey: return line[x];
+        case kind::yuyv: return line[size_t(x) * 2];
+        default: {
+            const uint8_t* p = line + size_t(x) * 3;
+            int rc = k == kind::rgb ? 0 : 2, bc = k == kind::rgb ? 2 : 0;
+            uint8_t mx = std::max(p[1], p[bc]);
+            return p[rc] > mx ? uint8_t(p[rc] - mx) : 0;
+        }
+        }
+    }
+
+    // Centre of mass of what rises above half the peak within half_width
+    // rows; stops at the first sample below it on each side, so a second
+    // reflection nearby does not pull the centre.
+    template<typename F>
+    float centroid(F&& at, uint16_t peak_row, uint8_t peak) const {
+        float floor = float(peak) * 0.5f;
+        float m0 = 0, m1 = 0;
+        for (int dir = -1; dir <= 1; dir += 2) {
+            for (uint32_t d = dir < 0 ? 0 : 1; d <= opt_.half_width; ++d) {
+                int64_t y = int64_t(peak_row) + dir * int64_t(d);
+                float wgt = at(y) - floor;
+                if (wgt <= 0) break;
+                m0 += wgt;
+                m1 += wgt * float(y);
+            }
+        }
+        return m0 > 0 ? m1 / m0 : float(peak_row);
+    }
+
+    // Vertex of the parabola through the logs of the peak and its two
+    // neighbours. Falls back to the peak row at the band edge and to the
+    // centroid on a clipped (flat-topped) peak.
+    template<typename F>
+    float gaussian(F&& at, uint16_t peak_row) const {
+        float a = at(int64_t(peak_row) - 1), b = at(peak_row), c = at(int64_t(peak_row) + 1);
+        if (a <= 0 || c <= 0) return float(peak_row);
+        if (b >= 255.0f || (a >= b && c >= b)) return centroid(at, peak_row, uint8_t(b));
+        float la = std::log(a), lb = std::log(b), lc = std::log(c);
+        float den = la - 2 * lb + lc;
+        if (den >= 0) return float(peak_row);
+        return float(peak_row) + 0.5f * (la - lc) / den;
+    }
+
+    // Range at every integer row, rebuilt when the image height changes.
+    void table(uint32_t h) {
+        if (lut_rows_ == h) return;
+        lut_.resize(h + 1);
+        for (uint32_t y = 0; y <= h; ++y) lut_[y] = static_cast<float>(model_.depth(double(y)));
+        lut_rows_ = h;
+    }
+
+    float lookup(float v) const {
+        if (!(v >= 0)) return std::numeric_limits<float>::quiet_NaN();
+        uint32_t i = static_cast<uint32_t>(v);
+        if (i >= lut_rows_) return lut_[lut_rows_];
+        float t = v - float(i);
+        // NaN at either end stays NaN.
+        return lut_[i] + (lut_[i + 1] - lut_[i]) * t;
+    }
+
+    range_model             model_;
+    line_options            opt_;
+    std::vector<float>      lut_;
+    uint32_t                lut_rows_ = 0;
+    std::vector<uint8_t>    signal_;
+    std::vector<uint8_t>    best_;
+    std::vector<uint16_t>   row_;
+    std::vector<float>      rows_;
+    std::vector<float>      depth_;
+    uint32_t                valid_ = 0;
+};
+
+// Line-scanning loop for a dispatch task: one schema::depth_scan per frame,
+// published even when no column has a reading so consumers see the rate.
+// Frames wider than depth_scan::capacity publish their leftmost columns.
+inline void pump(bus::mailbox<frame::frame>& in, bus::channel<schema::depth_scan>& out, line_scanner& scanner,
+                 const dispatch::cancel_token& tok) {
+    while (!tok.cancelled()) {
+        bus::message<frame::frame> f = in.pop(tok);
+        if (!f) return;
+        const std::vector<float>& depth = scanner.run(*f);
+        schema::depth_scan m;
+        m.seq          = f->seq();
+        m.timestamp_ns = f->timestamp_ns();
+        m.count        = static_cast<uint32_t>(std::min(depth.size(), schema::depth_scan::capacity));
+        m.valid        = scanner.valid();
+        std::copy(depth.begin(), depth.begin() + m.count, m.depth_m);
+        if (m.count < depth.size()) {
+            // Wider than the message: valid counts only the columns sent.
+            m.valid = static_cast<uint32_t>(std::count_if(m.depth_m, m.depth_m + m.count, [](float d) { return !std::isnan(d); }));
+        }
+        out.publish(m);
+    }
+}
+
+};
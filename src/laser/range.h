@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "bus/bus.h"
+#include "dispatch/dispatch.h"
+#include "frame/frame.h"
+#include "laser/consensus.h"
+#include "laser/spot.h"
+#include "schema/messages.h"
+
+namespace laser {
+
+// Triangulation calibration from calibrateLaser.py: a dot on image row v is
+// at z = a / (v - v0) + b metres.
+struct range_model {
+    double  a         = 0;
+    double  v0        = 0;
+    double  b         = 0;
+    double  min_depth = 0.01;       // metres; outside is no reading
+    double  max_depth = 20.0;
+
+    bool calibrated() const { return a != 0; }
+
+    // NaN when uncalibrated, too close to the horizon row or out of range.
+    double depth(double v) const {
+        double d = v - v0;
+        if (!calibrated() || std::fabs(d) < 0.5) return std::numeric_limits<double>::quiet_NaN();
+        double z = a / d + b;
+        return z >= min_depth && z <= max_depth ? z : std::numeric_limits<double>::quiet_NaN();
+    }
+};
+
+// Ranging loop for a dispatch task: every frame from in goes through the
+// spot detector and the consensus, and each frame with a fix publishes it
+// with its depth. Latency is one frame's detection; there is no capture
+// burst. Returns when tok is cancelled or in is closed.
+template<size_t Capacity>
+void pump(bus::mailbox<frame::frame>& in, bus::channel<schema::laser_fix>& out, spot_detector& det,
+          consensus<Capacity>& votes, const range_model& model, const dispatch::cancel_token& tok) {
+    while (!tok.cancelled()) {
+        bus::message<frame::frame> f = in.pop(tok);
+        if (!f) return;
+        fix x;
+        if (!votes.update(det.run(*f), x)) continue;
+        schema::laser_fix m;
+        m.seq          = f->seq();
+        m.timestamp_ns = f->timestamp_ns();
+        m.x            = x.x;
+        m.y            = x.y;
+        m.variance     = x.variance;
+        m.score        = x.score;
+        m.depth_m      = static_cast<float>(model.depth(x.y));
+        m.frames       = x.frames;
+        m.cluster      = x.cluster;
+        out.publish(m);
+    }
+}
+
+};
@@ -0,0 +1,440 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "frame/frame.h"
+#include "stats/quantile.h"
+#include "vision/letterbox.h"
+
+namespace laser {
+
+// Laser-dot candidates straight from a BGR/RGB frame.
+//
+// Per pixel, with gray = (77 R + 150 G + 29 B) / 256:
+//
+//   score = max(R - max(G, B), 0) + 0.3 gray
+//         + 0.5 gray   where gray > bright and R >= max(G, B) - tolerance
+//
+// Pixels at or above a percentile of the non-zero scores (at least
+// min_threshold) form a mask that is opened and then dilated with a 3x3
+// cross, and every 8-connected component of the result is a candidate with
+// its area, centroid and peak score.
+//
+// Scores are computed into one row buffer, never a frame. The first pass
+// only histograms them for the threshold. The second pass recomputes each
+// row, thresholds it, and pushes it through a short pipeline of row rings
+// (mask, eroded, opened), so the final mask row y is ready while row y + 3
+// is being scored. Finished rows go straight into run-based labeling with
+// union-find, accumulating moments per component. Rows that are empty at
+// any stage are flagged rather than written, so the usual frame with a few
+// small dots costs little more than the two scoring passes. With
+// single_pass set, the threshold comes from the previous frame's histogram
+// and the frame is read once. With decay set, the percentile is taken over
+// a decayed histogram of recent frames, which steadies the threshold.
+
+struct spot {
+    float       x = 0, y = 0;           // centroid, pixels
+    uint32_t    area = 0;               // pixels
+    uint16_t    peak = 0;               // highest score inside
+    uint16_t    x0 = 0, y0 = 0;         // bounding box, inclusive
+    uint16_t    x1 = 0, y1 = 0;
+};
+
+struct spot_options {
+    uint32_t    min_area        = 2;
+    uint32_t    max_area        = 800;
+    float       percentile      = 97.0f;    // of the non-zero scores
+    uint16_t    min_threshold   = 15;
+    uint32_t    min_pixels      = 100;      // fewer non-zero scores: no candidates
+    uint8_t     bright          = 180;      // gray level for the brightness bonus
+    uint8_t     tolerance       = 10;       // R may trail max(G, B) by this much
+    bool        single_pass     = false;    // threshold from the previous frame
+    float       decay           = 0.0f;     // > 0: percentile over frames fading by 1 - decay
+};
+
+namespace detail {
+
+constexpr uint32_t score_bins = 512;        // scores are at most 459
+
+// Scores n packed pixels. Channel order is B, G, R unless rgb.
+inline void score_row(const uint8_t* px, uint32_t n, bool rgb, uint8_t bright, uint8_t tolerance, uint16_t* out) {
+    const int rc = rgb ? 0 : 2, bc = rgb ? 2 : 0;
+    uint32_t x = 0;
+#if defined(__SSSE3__)
+    // Deinterleave 16 pixels with three shuffles per channel, then score in
+    // 16-bit lanes.
+    constexpr char z = -1;
+    const __m128i take[3][3] = {
+        {_mm_setr_epi8(0, 3, 6, 9, 12, 15, z, z, z, z, z, z, z, z, z, z),
+         _mm_setr_epi8(z, z, z, z, z, z, 2, 5, 8, 11, 14, z, z, z, z, z),
+         _mm_setr_epi8(z, z, z, z, z, z, z, z, z, z, z, 1, 4, 7, 10, 13)},
+        {_mm_setr_epi8(1, 4, 7, 10, 13, z, z, z, z, z, z, z, z, z, z, z),
+         _mm_setr_epi8(z, z, z, z, z, 0, 3, 6, 9, 12, 15, z, z, z, z, z),
+         _mm_setr_epi8(z, z, z, z, z, z, z, z, z, z, z, 2, 5, 8, 11, 14)},
+        {_mm_setr_epi8(2, 5, 8, 11, 14, z, z, z, z, z, z, z, z, z, z, z),
+         _mm_setr_epi8(z, z, z, z, z, 1, 4, 7, 10, 13, z, z, z, z, z, z),
+         _mm_setr_epi8(z, z, z, z, z, z, z, z, z, z, 0, 3, 6, 9, 12, 15)},
+    };
+    const __m128i zero = _mm_setzero_si128(), round = _mm_set1_epi16(128);
+    const __m128i w_r = _mm_set1_epi16(77), w_g = _mm_set1_epi16(150), w_b = _mm_set1_epi16(29);
+    const __m128i v_bright = _mm_set1_epi16(bright), v_tol = _mm_set1_epi16(int16_t(tolerance + 1));
+    for (; x + 16 <= n; x += 16) {
+        const __m128i* src = reinterpret_cast<const __m128i*>(px + size_t(x) * 3);
+        __m128i a0 = _mm_loadu_si128(src), a1 = _mm_loadu_si128(src + 1), a2 = _mm_loadu_si128(src + 2);
+        auto channel = [&](int c) {
+            return _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, take[c][0]), _mm_shuffle_epi8(a1, take[c][1])),
+                                _mm_shuffle_epi8(a2, take[c][2]));
+        };
+        __m128i r8 = channel(rc), g8 = channel(1), b8 = channel(bc);
+        __m128i mx8 = _mm_max_epu8(g8, b8);
+        __m128i excess8 = _mm_subs_epu8(r8, mx8);
+        for (int half = 0; half < 2; ++half) {
+            auto widen = [&](__m128i v) { return half ? _mm_unpackhi_epi8(v, zero) : _mm_unpacklo_epi8(v, zero); };
+            __m128i r = widen(r8), g = widen(g8), b = widen(b8), mx = widen(mx8);
+            __m128i gray = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, w_r), _mm_mullo_epi16(g, w_g)),
+                                         _mm_add_epi16(_mm_mullo_epi16(b, w_b), round));
+            gray = _mm_srli_epi16(gray, 8);
+            __m128i part = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(gray, w_r), round), 8);
+            __m128i lit = _mm_and_si128(_mm_cmpgt_epi16(gray, v_bright), _mm_cmpgt_epi16(_mm_add_epi16(r, v_tol), mx));
+            __m128i sum = _mm_add_epi16(_mm_add_epi16(widen(excess8), part), _mm_and_si128(_mm_srli_epi16(gray, 1), lit));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + 8 * half), sum);
+        }
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t v_bright = vdupq_n_u8(bright), v_tol = vdupq_n_u8(tolerance);
+    const uint8x8_t w_r = vdup_n_u8(77), w_g = vdup_n_u8(150), w_b = vdup_n_u8(29);
+    for (; x + 16 <= n; x += 16) {
+        uint8x16x3_t p = vld3q_u8(px + size_t(x) * 3);
+        uint8x16_t r = p.val[rc], g = p.val[1], b = p.val[bc];
+        uint8x16_t mx = vmaxq_u8(g, b);
+        uint8x16_t excess = vqsubq_u8(r, mx);
+        uint16x8_t glo = vmlal_u8(vmlal_u8(vmull_u8(vget_low_u8(r), w_r), vget_low_u8(g), w_g), vget_low_u8(b), w_b);
+        uint16x8_t ghi = vmlal_u8(vmlal_u8(vmull_u8(vget_high_u8(r), w_r), vget_high_u8(g), w_g), vget_high_u8(b), w_b);
+        uint8x16_t gray = vcombine_u8(vrshrn_n_u16(glo, 8), vrshrn_n_u16(ghi, 8));
+        uint8x16_t part = vcombine_u8(vrshrn_n_u16(vmull_u8(vget_low_u8(gray), w_r), 8),
+                                      vrshrn_n_u16(vmull_u8(vget_high_u8(gray), w_r), 8));
+        uint8x16_t lit = vandq_u8(vcgtq_u8(gray, v_bright), vcgeq_u8(vqaddq_u8(r, v_tol), mx));
+        uint8x16_t half = vandq_u8(vshrq_n_u8(gray, 1), lit);
+        vst1q_u16(out + x,     vaddw_u8(vaddl_u8(vget_low_u8(excess), vget_low_u8(part)), vget_low_u8(half)));
+        vst1q_u16(out + x + 8, vaddw_u8(vaddl_u8(vget_high_u8(excess), vget_high_u8(part)), vget_high_u8(half)));
+    }
+#endif
+    // Plain integer code the compiler vectorizes on other targets.
+    for (; x < n; ++x) {
+        const uint8_t* p = px + size_t(x) * 3;
+        uint32_t r = p[rc], g = p[1], b = p[bc];
+        uint32_t mx = g > b ? g : b;
+        uint32_t excess = r > mx ? r - mx : 0;
+        uint32_t gray = (77 * r + 150 * g + 29 * b + 128) >> 8;
+        uint32_t part = (gray * 77 + 128) >> 8;
+        uint32_t half = gray > bright && r + tolerance >= mx ? gray >> 1 : 0;
+        out[x] = static_cast<uint16_t>(excess + part + half);
+    }
+}
+
+// mask[x] = 0xff where score >= threshold; true if any.
+inline bool threshold_row(const uint16_t* s, uint32_t n, uint16_t threshold, uint8_t* mask) {
+    uint8_t any = 0;
+    for (uint32_t x = 0; x < n; ++x) {
+        uint8_t m = s[x] >= threshold ? 0xff : 0;
+        mask[x] = m;
+        any |= m;
+    }
+    return any != 0;
+}
+
+// out = a & b & c & (b shifted left and right); outside the row counts as set.
+inline bool erode_row(const uint8_t* a, const uint8_t* b, const uint8_t* c, uint32_t n, uint8_t* out) {
+    uint8_t any = 0;
+    for (uint32_t x = 0; x < n; ++x) {
+        uint8_t l = x > 0 ? b[x - 1] : 0xff;
+        uint8_t r = x + 1 < n ? b[x + 1] : 0xff;
+        uint8_t v = a[x] & b[x] & c[x] & l & r;
+        out[x] = v;
+        any |= v;
+    }
+    return any != 0;
+}
+
+// out = a | b | c | (b shifted left and right); outside the row counts as clear.
+inline bool dilate_row(const uint8_t* a, const uint8_t* b, const uint8_t* c, uint32_t n, uint8_t* out) {
+    uint8_t any = 0;
+    for (uint32_t x = 0; x < n; ++x) {
+        uint8_t l = x > 0 ? b[x - 1] : 0;
+        uint8_t r = x + 1 < n ? b[x + 1] : 0;
+        uint8_t v = a[x] | b[x] | c[x] | l | r;
+        out[x] = v;
+        any |= v;
+    }
+    return any != 0;
+}
+
+};
+
+class spot_detector {
+public:
+    explicit spot_detector(spot_options o = {})
+        : opt_(o), hist_(o.decay > 0 ? stats::window::decayed : stats::window::frame, o.decay) {}
+
+    const spot_options& options() const { return opt_; }
+
+    // Score threshold used for the last frame (0: no candidates possible).
+    uint16_t threshold() const { return threshold_; }
+
+    // Candidates, highest peak first. The result is reused by the next call.
+    const std::vector<spot>& run(const vision::image& img) {
+        spots_.clear();
+        if (!img.data || !img.width || !img.height) return spots_;
+        size_t stride = img.stride ? img.stride : size_t(img.width) * 3;
+        bool rgb = img.in == vision::order::rgb;
+        prepare(img.width);
+
+        if (!opt_.single_pass || !primed_) {
+            hist_.clear();
+            for (uint32_t y = 0; y < img.height; ++y) {
+                detail::score_row(img.data + y * stride, img.width, rgb, opt_.bright, opt_.tolerance, score_[0].data());
+                hist_.add(score_[0].data(), img.width);
+            }
+            threshold_ = pick();
+            next_ = threshold_;
+            primed_ = true;
+            label(img, stride, rgb, false);
+        } else {
+            threshold_ = next_;
+            hist_.clear();
+            label(img, stride, rgb, true);
+            next_ = pick();
+        }
+
+        std::sort(spots_.begin(), spots_.end(), [](const spot& a, const spot& b) { return a.peak > b.peak; });
+        return spots_;
+    }
+
+    // Runs on a BGR/RGB frame from the frame pool.
+    const std::vector<spot>& run(const frame::frame& f) {
+        spots_.clear();
+        if (!f) return spots_;
+        const frame::format& l = f.layout();
+        if (l.fourcc != frame::bgr24 && l.fourcc != frame::rgb24) return spots_;
+        return run(vision::image{f.data(), l.width, l.height, l.stride, l.fourcc == frame::rgb24 ? vision::order::rgb : vision::order::bgr});
+    }
+
+private:
+    struct run_t {
+        uint32_t    x0, x1;         // [x0, x1)
+        uint32_t    label;
+    };
+
+    struct moments {
+        double      m00, m10, m01;
+        uint16_t    peak;
+        uint16_t    x0, y0, x1, y1;
+    };
+
+    void prepare(uint32_t width) {
+        if (width == width_) return;
+        width_ = width;
+        for (auto& r : score_) r.assign(width, 0);
+        for (auto& r : mask_) r.assign(width, 0);
+        for (auto& r : eroded_) r.assign(width, 0);
+        for (auto& r : opened_) r.assign(width, 0);
+        final_.assign(width, 0);
+        ones_.assign(width, 0xff);
+        zeros_.assign(width, 0);
+    }
+
+    // Commits the frame's histogram and takes the percentile of the
+    // non-zero scores.
+    uint16_t pick() {
+        bool enough = hist_.pending(1) >= std::max<uint32_t>(opt_.min_pixels, 1);
+        hist_.commit();
+        if (!enough) return 0;
+        double v = hist_.quantile(double(opt_.percentile) / 100.0, 1);
+        return static_cast<uint16_t>(std::ceil(std::max(v, double(opt_.min_threshold))));
+    }
+
+    // Second pass: score, threshold, open, dilate and label row by row.
+    void label(const vision::image& img, size_t stride, bool rgb, bool histogram) {
+        const uint32_t w = img.width, h = img.height;
+        prev_.clear();
+        parent_.clear();
+        stats_.clear();
+        if (threshold_ == 0 && !histogram) return;
+
+        bool any_mask[3] = {}, any_eroded[3] = {}, any_opened[3] = {};
+        auto mask_row = [&](int64_t y) -> const uint8_t* {
+            if (y < 0 || y >= int64_t(h)) return ones_.data();
+            return any_mask[y % 3] ? mask_[y % 3].data() : zeros_.data();
+        };
+        auto eroded_row = [&](int64_t y) -> const uint8_t* {
+            if (y < 0 || y >= int64_t(h) || !any_eroded[y % 3]) return zeros_.data();
+            return eroded_[y % 3].data();
+        };
+        auto opened_row = [&](int64_t y) -> const uint8_t* {
+            if (y < 0 || y >= int64_t(h) || !any_opened[y % 3]) return zeros_.data();
+            return opened_[y % 3].data();
+        };
+        auto empty = [&](const uint8_t* a, const uint8_t* b, const uint8_t* c) {
+            return a == zeros_.data() && b == zeros_.data() && c == zeros_.data();
+        };
+
+        for (int64_t t = 0; t < int64_t(h) + 3; ++t) {
+            if (t < int64_t(h)) {
+                uint16_t* s = score_[t % 4].data();
+                detail::score_row(img.data + size_t(t) * stride, w, rgb, opt_.bright, opt_.tolerance, s);
+                if (histogram) hist_.add(s, w);
+                any_mask[t % 3] = threshold_ && detail::threshold_row(s, w, threshold_, mask_[t % 3].data());
+            }
+            int64_t r = t - 1;
+            if (r >= 0 && r < int64_t(h)) {
+                any_eroded[r % 3] = any_mask[r % 3] &&
+                    detail::erode_row(mask_row(r - 1), mask_row(r), mask_row(r + 1), w, eroded_[r % 3].data());
+            }
+            r = t - 2;
+            if (r >= 0 && r < int64_t(h)) {
+                const uint8_t *a = eroded_row(r - 1), *b = eroded_row(r), *c = eroded_row(r + 1);
+                any_opened[r % 3] = !empty(a, b, c) && detail::dilate_row(a, b, c, w, opened_[r % 3].data());
+            }
+            r = t - 3;
+            if (r >= 0 && r < int64_t(h)) {
+                const uint8_t *a = opened_row(r - 1), *b = opened_row(r), *c = opened_row(r + 1);
+                if (!empty(a, b, c) && detail::dilate_row(a, b, c, w, final_.data())) {
+                    runs(final_.data(), score_[r % 4].data(), static_cast<uint32_t>(r));
+                } else {
+                    prev_.clear();
+                }
+            }
+        }
+        collect();
+    }
+
+    uint32_t find(uint32_t l) {
+        while (parent_[l] != l) {
+            parent_[l] = parent_[parent_[l]];
+            l = parent_[l];
+        }
+        return l;
+    }
+
+    void unite(uint32_t a, uint32_t b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) return;
+        if (b < a) std::swap(a, b);
+        parent_[b] = a;
+        moments& s = stats_[a];
+        const moments& o = stats_[b];
+        s.m00 += o.m00;
+        s.m10 += o.m10;
+        s.m01 += o.m01;
+        s.peak = std::max(s.peak, o.peak);
+        s.x0 = std::min(s.x0, o.x0);
+        s.y0 = std::min(s.y0, o.y0);
+        s.x1 = std::max(s.x1, o.x1);
+        s.y1 = std::max(s.y1, o.y1);
+    }
+
+    // Labels the runs of one finished mask row against the previous row's
+    // runs (8-connected: runs touching diagonally join).
+    void runs(const uint8_t* m, const uint16_t* s, uint32_t y) {
+        cur_.clear();
+        const uint32_t w = width_;
+        uint32_t x = 0;
+        while (x < w) {
+            // Skip background eight bytes at a time.
+            while (x + 8 <= w) {
+                uint64_t word;
+                std::memcpy(&word, m + x, 8);
+                if (word) break;
+                x += 8;
+            }
+            while (x < w && !m[x]) ++x;
+            if (x >= w) break;
+            uint32_t x0 = x;
+            while (x < w && m[x]) ++x;
+            cur_.push_back({x0, x, 0});
+        }
+
+        size_t p = 0;
+        for (run_t& c : cur_) {
+            uint32_t label = UINT32_MAX;
+            while (p < prev_.size() && prev_[p].x1 < c.x0) ++p;
+            for (size_t k = p; k < prev_.size() && prev_[k].x0 <= c.x1; ++k) {
+                if (label == UINT32_MAX) {
+                    label = find(prev_[k].label);
+                } else {
+                    unite(label, prev_[k].label);
+                    label = find(label);
+                }
+            }
+            uint16_t peak = 0;
+            for (uint32_t i = c.x0; i < c.x1; ++i) peak = std::max(peak, s[i]);
+            double n = double(c.x1 - c.x0);
+            moments add{n, (double(c.x0) + double(c.x1 - 1)) * 0.5 * n, double(y) * n, peak,
+                        uint16_t(c.x0), uint16_t(y), uint16_t(c.x1 - 1), uint16_t(y)};
+            if (label == UINT32_MAX) {
+                label = static_cast<uint32_t>(parent_.size());
+                parent_.push_back(label);
+                stats_.push_back(add);
+            } else {
+                moments& a = stats_[label];
+                a.m00 += add.m00;
+                a.m10 += add.m10;
+                a.m01 += add.m01;
+                a.peak = std::max(a.peak, peak);
+                a.x0 = std::min(a.x0, add.x0);
+                a.x1 = std::max(a.x1, add.x1);
+                a.y1 = add.y1;
+            }
+            c.label = label;
+        }
+        prev_.swap(cur_);
+    }
+
+    void collect() {
+        for (uint32_t l = 0; l < parent_.size(); ++l) {
+            if (parent_[l] != l) continue;
+            const moments& m = stats_[l];
+            uint32_t area = static_cast<uint32_t>(m.m00);
+            if (area < opt_.min_area || area > opt_.max_area) continue;
+            spot s;
+            s.x    = float(m.m10 / m.m00);
+            s.y    = float(m.m01 / m.m00);
+            s.area = area;
+            s.peak = m.peak;
+            s.x0 = m.x0, s.y0 = m.y0, s.x1 = m.x1, s.y1 = m.y1;
+            spots_.push_back(s);
+        }
+    }
+
+    spot_options                    opt_;
+    uint32_t                        width_      = 0;
+    uint16_t                        threshold_  = 0;
+    uint16_t                        next_       = 0;    // from this frame's histogram
+    bool                            primed_     = false;
+    stats::histogram<detail::score_bins>    hist_;
+    std::vector<uint16_t>           score_[4];
+    std::vector<uint8_t>            mask_[3];
+    std::vector<uint8_t>            eroded_[3];
+    std::vector<uint8_t>            opened_[3];
+    std::vector<uint8_t>            final_;
+    std::vector<uint8_t>            ones_;
+    std::vector<uint8_t>            zeros_;
+    std::vector<run_t>              prev_;
+    std::vector<run_t>              cur_;
+    std::vector<uint32_t>           parent_;
+    std::vector<moments>            stats_;
+    std::vector<spot>               spots_;
+};
+
+};
@@ -4,12 +4,51 @@
 
 #include "crtp/crtp.h"
 #include "plex/plex.h"
+#include "fsm/fsm.h"
 #include "dispatch/dispatch.h"
+#include "timer/timer.h"
+#include "supervisor/supervisor.h"
+#include "statechart/statechart.h"
+#include "bus/bus.h"
+#include "bus/recorder.h"
+#include "ipc/ipc.h"
+#include "ipc/stream.h"
+#include "schema/messages.h"
+#include "frame/frame.h"
+#include "capture/capture.h"
+#include "jpeg/jpeg.h"
+#include "vision/letterbox.h"
+#include "vision/yolo.h"
+#include "vision/tracker.h"
+#include "infer/cpu.h"
+#include "infer/scheduler.h"
+#include "infer/rknn.h"
+#include "stats/quantile.h"
+#include "laser/spot.h"
+#include "laser/consensus.h"
+#include "laser/range.h"
+#include "laser/line.h"
 
 size_t func_0(size_t v) { std::cout << "func_0\n"; return 0; }
 size_t func_1(size_t v) { std::cout << "func_1\n"; return 0; }
 size_t func_2(size_t v) { std::cout << "func_2\n"; return 0; }
 
+struct servo_spec {
+    enum class state : uint8_t { normal, fast, dance, count };
+
+    static constexpr state initial = state::normal;
+
+    static constexpr auto transitions = fsm::table<state>()
+        .allow(state::normal,   {state::normal, state::fast, state::dance})
+        .allow(state::fast,     {state::normal, state::fast, state::dance})
+        .allow(state::dance,    {state::normal, state::dance});
+};
+
+struct servo_fsm : fsm::machine<servo_fsm, servo_spec> {
+    template<state_t S> void on_enter() { std::cout << "servo: enter " << int(S) << "\n"; }
+    void on_failed(state_t from, state_t to) { std::cout << "servo: refused " << int(from) << " -> " << int(to) << "\n"; }
+};
+
 int main() {
 
     using Input_t = size_t;
@@ -40,5 +79,10 @@ int main() {
     mPlex.run(1,0);
     mPlex.run(2,0);
 
+    servo_fsm servo;
+    servo.request(servo_spec::state::dance);
+    servo.request(servo_spec::state::fast);
+    servo.request(servo_spec::state::normal);
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,371 @@
+// Python bindings for the native bus and frame pool.
+//
+//   import numpy as np, robots_native as rn
+//   b      = rn.Bus(workers=2)
+//   frames = b.add_frames("camera", rn.Delivery.latest)
+//   pool   = rn.FramePool.create("/robots-frames", 4, 640 * 480 * 3)
+//   f = pool.acquire(); np.asarray(f)[:] = img; f.set(640, 480, 640 * 3, rn.BGR24)
+//   frames.publish(f)
+//   frames.subscribe(lambda f: yolo.run(np.asarray(f)), rn.Delivery.latest)
+//
+// Frames and schema messages expose their memory through the buffer
+// protocol, so np.asarray() is a view, never a copy. publish() and pop()
+// release the GIL; handlers run on the bus pool and take the GIL only around
+// the Python call. Frames delivered from the bus are shared by every
+// subscriber and come out read-only; schema messages are small and are
+// copied on their way into Python, so each consumer owns the one it gets.
+
+#include <pybind11/pybind11.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "bus/bus.h"
+#include "dispatch/dispatch.h"
+#include "frame/frame.h"
+#include "schema/messages.h"
+
+namespace py = pybind11;
+
+namespace {
+
+// A bus plus the pool its push subscribers run on.
+class native_bus {
+public:
+    explicit native_bus(size_t workers) : pool_(dispatch::pool_options{workers}) {}
+
+    ~native_bus() {
+        // Workers may be waiting for the GIL inside a handler.
+        py::gil_scoped_release nogil;
+        pool_.shutdown(dispatch::clock::now() + dispatch::dispatch::default_grace);
+    }
+
+    dispatch::dispatch& pool() { return pool_; }
+    bus::bus&           channels() { return bus_; }
+
+private:
+    dispatch::dispatch  pool_;
+    bus::bus            bus_;
+};
+
+// Python's handle on a frame. Frames from acquire() are writable until
+// published; frames that came off the bus are read-only views.
+struct py_frame {
+    std::shared_ptr<frame::frame>   ref;
+    bool                            writable = false;
+
+    frame::frame& get() const {
+        if (!ref || !*ref) throw py::value_error("frame: empty");
+        return *ref;
+    }
+};
+
+py::buffer_info frame_buffer(py_frame& pf) {
+    const frame::frame& f = pf.get();
+    const frame::format& l = f.layout();
+    uint32_t ch = frame::channels_of(l.fourcc);
+    if (ch && l.width && l.height) {
+        size_t stride = l.stride ? l.stride : size_t(l.width) * ch;
+        if (ch == 1) {
+            return py::buffer_info(f.data(), 1, py::format_descriptor<uint8_t>::format(), 2,
+                                   {size_t(l.height), size_t(l.width)}, {stride, size_t(1)}, !pf.writable);
+        }
+        return py::buffer_info(f.data(), 1, py::format_descriptor<uint8_t>::format(), 3,
+                               {size_t(l.height), size_t(l.width), size_t(ch)}, {stride, size_t(ch), size_t(1)}, !pf.writable);
+    }
+    size_t n = l.bytes ? l.bytes : f.capacity();
+    return py::buffer_info(f.data(), 1, py::format_descriptor<uint8_t>::format(), 1, {n}, {size_t(1)}, !pf.writable);
+}
+
+// The bus hands every subscriber the same const message; Python objects are
+// mutable, so each one gets its own copy.
+template<typename T>
+py::object to_python(const bus::message<T>& m) {
+    return py::cast(std::make_shared<T>(*m));
+}
+
+py::object to_python(const bus::message<frame::frame>& m) {
+    return py::cast(py_frame{std::const_pointer_cast<frame::frame>(m), false});
+}
+
+// What Python holds for a channel: the channel and the bus whose pool runs
+// its push subscribers. keep_alive ties the Bus to it.
+template<typename T>
+struct channel_ref {
+    bus::channel<T>*    ch;
+    native_bus*         owner;
+};
+
+// Keeps a Python callable alive from C++ and makes sure it is destroyed with
+// the GIL held, whichever thread drops the last reference.
+inline std::shared_ptr<py::function> hold(py::function f) {
+    return std::shared_ptr<py::function>(new py::function(std::move(f)), [](py::function* p) {
+        py::gil_scoped_acquire gil;
+        delete p;
+    });
+}
+
+bus::policy make_policy(bus::delivery mode, size_t depth, double timeout_s) {
+    return {mode, depth, std::chrono::milliseconds(static_cast<long long>(timeout_s * 1000))};
+}
+
+template<typename T, typename Publish>
+void bind_channel(py::module_& m, const char* name, Publish publish) {
+    using box_t = bus::mailbox<T>;
+
+    py::class_<box_t, std::shared_ptr<box_t>>(m, (std::string(name) + "Mailbox").c_str())
+        .def("try_pop", [](box_t& b) -> py::object {
+            bus::message<T> msg = b.try_pop();
+            return msg ? to_python(msg) : py::none();
+        })
+        .def("pop", [](box_t& b, double timeout_s) -> py::object {
+            bus::message<T> msg;
+            {
+                py::gil_scoped_release nogil;
+                msg = b.pop_for(std::chrono::milliseconds(static_cast<long long>(timeout_s * 1000)));
+            }
+            return msg ? to_python(msg) : py::none();
+        }, py::arg("timeout") = 0.1)
+        .def("grant", &box_t::grant, py::arg("n") = 1)
+        .def_property_readonly("dropped", &box_t::dropped);
+
+    using ref_t = channel_ref<T>;
+
+    py::class_<ref_t>(m, name)
+        .def_property_readonly("name", [](const ref_t& r) { return r.ch->name(); })
+        .def_property_readonly("published", [](const ref_t& r) { return r.ch->published(); })
+        .def("publish", [publish](ref_t& r, py::object v) { publish(*r.ch, v); })
+        .def("subscribe", [](ref_t& r, py::function handler, bus::delivery mode, size_t depth, double timeout_s) {
+            auto fn = hold(std::move(handler));
+            return r.ch->subscribe(r.owner->pool(), [fn](const bus::message<T>& msg) {
+                py::gil_scoped_acquire gil;
+                try {
+                    (*fn)(to_python(msg));
+                } catch (py::error_already_set& e) {
+                    e.discard_as_unraisable(__func__);
+                }
+            }, make_policy(mode, depth, timeout_s));
+        }, py::arg("handler"), py::arg("mode") = bus::delivery::drop_oldest, py::arg("depth") = 8, py::arg("timeout") = 0.02)
+        .def("mailbox", [](ref_t& r, bus::delivery mode, size_t depth, double timeout_s) {
+            return r.ch->subscribe(make_policy(mode, depth, timeout_s));
+        }, py::arg("mode") = bus::delivery::drop_oldest, py::arg("depth") = 8, py::arg("timeout") = 0.02)
+        .def("unsubscribe", [](ref_t& r, const std::shared_ptr<box_t>& b) { r.ch->unsubscribe(b); })
+        .def("stats", [](const ref_t& r) {
+            bus::channel_stats s = r.ch->stats();
+            py::dict d;
+            d["published"]   = s.published;
+            d["subscribers"] = s.subscribers;
+            d["delivered"]   = s.flow.delivered;
+            d["dropped"]     = s.flow.dropped;
+            d["stalls"]      = s.flow.stalls;
+            d["stalled"]     = std::chrono::duration<double>(s.flow.stalled).count();
+            return d;
+        });
+}
+
+template<typename T>
+py::class_<T, std::shared_ptr<T>> bind_message(py::module_& m, const char* name) {
+    return py::class_<T, std::shared_ptr<T>>(m, name, py::buffer_protocol())
+        .def(py::init<>())
+        .def_buffer([](T& v) {
+            return py::buffer_info(&v, 1, py::format_descriptor<uint8_t>::format(), 1,
+                                   {schema::wire_size<T>::of(v)}, {size_t(1)});
+        })
+        .def_property_readonly_static("layout", [](py::object) { return schema::describe<T>(); })
+        .def_readonly_static("id", &T::id)
+        .def_readonly_static("version", &T::version);
+}
+
+// add_* creates a channel, get_* looks one up.
+template<typename T>
+void bind_bus_channel(py::class_<native_bus>& cls, const std::string& what) {
+    cls.def(("add_" + what).c_str(), [](native_bus& b, const std::string& name, bus::delivery mode, size_t depth, double timeout_s) {
+        return channel_ref<T>{&b.channels().add<T>(name, make_policy(mode, depth, timeout_s)), &b};
+    }, py::arg("name"), py::arg("mode") = bus::delivery::drop_oldest, py::arg("depth") = 8, py::arg("timeout") = 0.02,
+       py::keep_alive<0, 1>());
+    cls.def(("get_" + what).c_str(), [](native_bus& b, const std::string& name) {
+        return channel_ref<T>{&b.channels().get<T>(name), &b};
+    }, py::arg("name"), py::keep_alive<0, 1>());
+}
+
+};
+
+PYBIND11_MODULE(robots_native, m) {
+    m.doc() = "Native bus and shared-memory frame pool";
+
+    py::enum_<bus::delivery>(m, "Delivery")
+        .value("latest", bus::delivery::latest)
+        .value("drop_oldest", bus::delivery::drop_oldest)
+        .value("drop_newest", bus::delivery::drop_newest)
+        .value("blocking", bus::delivery::blocking)
+        .value("credit", bus::delivery::credit);
+
+    m.attr("BGR24") = frame::bgr24;
+    m.attr("RGB24") = frame::rgb24;
+    m.attr("GREY")  = frame::grey;
+    m.attr("YUYV")  = frame::yuyv;
+    m.attr("MJPEG") = frame::mjpeg;
+
+    bind_message<schema::frame_descriptor>(m, "FrameDescriptor")
+        .def_readonly("seq", &schema::frame_descriptor::seq)
+        .def_readonly("timestamp_ns", &schema::frame_descriptor::timestamp_ns)
+        .def_readonly("slot", &schema::frame_descriptor::slot)
+        .def_readonly("width", &schema::frame_descriptor::width)
+        .def_readonly("height", &schema::frame_descriptor::height)
+        .def_readonly("stride", &schema::frame_descriptor::stride)
+        .def_readonly("fourcc", &schema::frame_descriptor::fourcc);
+
+    bind_message<schema::servo_command>(m, "ServoCommand")
+        .def_readwrite("seq", &schema::servo_command::seq)
+        .def_readwrite("channel", &schema::servo_command::channel)
+        .def_readwrite("mode", &schema::servo_command::mode)
+        .def_readwrite("angle_cdeg", &schema::servo_command::angle_cdeg)
+        .def_readwrite("speed", &schema::servo_command::speed);
+
+    bind_message<schema::detection_list>(m, "DetectionList")
+        .def_readwrite("seq", &schema::detection_list::seq)
+        .def_readwrite("timestamp_ns", &schema::detection_list::timestamp_ns)
+        .def_readonly("count", &schema::detection_list::count)
+        .def("push", [](schema::detection_list& l, float x0, float y0, float x1, float y1, float score, int32_t cls) {
+            return l.push({{x0, y0, x1, y1}, score, cls});
+        })
+        .def("__len__", [](const schema::detection_list& l) { return l.count; })
+        .def("__getitem__", [](const schema::detection_list& l, size_t i) {
+            if (i >= l.count) throw py::index_error();
+            const schema::detection& d = l.items[i];
+            return py::make_tuple(d.bbox.x0, d.bbox.y0, d.bbox.x1, d.bbox.y1, d.score, d.class_id);
+        });
+
+    bind_message<schema::track_list>(m, "TrackList")
+        .def_readonly("seq", &schema::track_list::seq)
+        .def_readonly("timestamp_ns", &schema::track_list::timestamp_ns)
+        .def_readonly("count", &schema::track_list::count)
+        .def("__len__", [](const schema::track_list& l) { return l.count; })
+        .def("__getitem__", [](const schema::track_list& l, size_t i) {
+            if (i >= l.count) throw py::index_error();
+            const schema::track& t = l.items[i];
+            return py::make_tuple(t.id, t.class_id, t.bbox.x0, t.bbox.y0, t.bbox.x1, t.bbox.y1, t.vx, t.vy, t.score);
+        });
+
+    bind_message<schema::laser_fix>(m, "LaserFix")
+        .def_readonly("seq", &schema::laser_fix::seq)
+        .def_readonly("timestamp_ns", &schema::laser_fix::timestamp_ns)
+        .def_readonly("x", &schema::laser_fix::x)
+        .def_readonly("y", &schema::laser_fix::y)
+        .def_readonly("variance", &schema::laser_fix::variance)
+        .def_readonly("score", &schema::laser_fix::score)
+        .def_readonly("depth_m", &schema::laser_fix::depth_m)
+        .def_readonly("frames", &schema::laser_fix::frames)
+        .def_readonly("cluster", &schema::laser_fix::cluster);
+
+    bind_message<schema::depth_scan>(m, "DepthScan")
+        .def_readonly("seq", &schema::depth_scan::seq)
+        .def_readonly("timestamp_ns", &schema::depth_scan::timestamp_ns)
+        .def_readonly("count", &schema::depth_scan::count)
+        .def_readonly("valid", &schema::depth_scan::valid)
+        .def("__len__", [](const schema::depth_scan& s) { return s.count; })
+        .def("__getitem__", [](const schema::depth_scan& s, size_t i) {
+            if (i >= s.count) throw py::index_error();
+            return s.depth_m[i];
+        });
+
+    py::class_<py_frame>(m, "Frame", py::buffer_protocol())
+        .def_buffer(&frame_buffer)
+        .def("set", [](py_frame& pf, uint32_t width, uint32_t height, uint32_t stride, uint32_t fourcc, uint32_t bytes, uint64_t ts) {
+            if (!pf.writable) throw py::value_error("frame: already published");
+            frame::frame& f = pf.get();
+            if (!ts) ts = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now().time_since_epoch()).count());
+            if (!bytes) bytes = stride * height;
+            f.set({width, height, stride, fourcc, bytes}, ts);
+        }, py::arg("width"), py::arg("height"), py::arg("stride"), py::arg("fourcc"), py::arg("bytes") = 0, py::arg("timestamp_ns") = 0)
+        .def("descriptor", [](const py_frame& pf) { return std::make_shared<schema::frame_descriptor>(pf.get().descriptor()); })
+        .def_property_readonly("seq", [](const py_frame& pf) { return pf.get().seq(); })
+        .def_property_readonly("slot", [](const py_frame& pf) { return pf.get().slot(); })
+        .def_property_readonly("timestamp_ns", [](const py_frame& pf) { return pf.get().timestamp_ns(); })
+        .def_property_readonly("width", [](const py_frame& pf) { return pf.get().layout().width; })
+        .def_property_readonly("height", [](const py_frame& pf) { return pf.get().layout().height; })
+        .def_property_readonly("fourcc", [](const py_frame& pf) { return pf.get().layout().fourcc; });
+
+    py::class_<frame::pool, std::shared_ptr<frame::pool>>(m, "FramePool")
+        .def_static("create", &frame::pool::create, py::arg("name"), py::arg("slots"), py::arg("slot_bytes"))
+        .def_static("open", &frame::pool::open, py::arg("name"))
+        .def_static("local", &frame::pool::local, py::arg("slots"), py::arg("slot_bytes"))
+        .def("acquire", [](frame::pool& p) -> py::object {
+            frame::frame f = p.acquire();
+            if (!f) return py::none();
+            return py::cast(py_frame{std::make_shared<frame::frame>(std::move(f)), true});
+        })
+        .def("open_frame", [](frame::pool& p, const schema::frame_descriptor& d) -> py::object {
+            frame::frame f = p.open(d);
+            if (!f) return py::none();
+            return py::cast(py_frame{std::make_shared<frame::frame>(std::move(f)), false});
+        })
+        .def_property_readonly("slots", &frame::pool::slots)
+        .def_property_readonly("slot_bytes", &frame::pool::slot_bytes)
+        .def_property_readonly("in_use", &frame::pool::in_use)
+        .def_property_readonly("exhausted", &frame::pool::exhausted);
+
+    bind_channel<frame::frame>(m, "FrameChannel", [](bus::channel<frame::frame>& ch, py::object v) {
+        py_frame& pf = v.cast<py_frame&>();
+        bus::message<frame::frame> msg = pf.ref;
+        if (!msg || !*msg) throw py::value_error("frame: empty");
+        pf.writable = false;
+        py::gil_scoped_release nogil;
+        ch.publish(std::move(msg));
+    });
+    bind_channel<schema::detection_list>(m, "DetectionChannel", [](bus::channel<schema::detection_list>& ch, py::object v) {
+        auto msg = v.cast<std::shared_ptr<schema::detection_list>>();
+        py::gil_scoped_release nogil;
+        ch.publish(*msg);
+    });
+    bind_channel<schema::servo_command>(m, "ServoChannel", [](bus::channel<schema::servo_command>& ch, py::object v) {
+        auto msg = v.cast<std::shared_ptr<schema::servo_command>>();
+        py::gil_scoped_release nogil;
+        ch.publish(*msg);
+    });
+    bind_channel<schema::track_list>(m, "TrackChannel", [](bus::channel<schema::track_list>& ch, py::object v) {
+        auto msg = v.cast<std::shared_ptr<schema::track_list>>();
+        py::gil_scoped_release nogil;
+        ch.publish(*msg);
+    });
+    bind_channel<schema::laser_fix>(m, "LaserChannel", [](bus::channel<schema::laser_fix>& ch, py::object v) {
+        auto msg = v.cast<std::shared_ptr<schema::laser_fix>>();
+        py::gil_scoped_release nogil;
+        ch.publish(*msg);
+    });
+    bind_channel<schema::depth_scan>(m, "DepthScanChannel", [](bus::channel<schema::depth_scan>& ch, py::object v) {
+        auto msg = v.cast<std::shared_ptr<schema::depth_scan>>();
+        py::gil_scoped_release nogil;
+        ch.publish(*msg);
+    });
+    bind_channel<schema::frame_descriptor>(m, "FrameDescriptorChannel", [](bus::channel<schema::frame_descriptor>& ch, py::object v) {
+        auto msg = v.cast<std::shared_ptr<schema::frame_descriptor>>();
+        py::gil_scoped_release nogil;
+        ch.publish(*msg);
+    });
+
+    py::class_<native_bus> cls(m, "Bus");
+    cls.def(py::init<size_t>(), py::arg("workers") = 2);
+    bind_bus_channel<frame::frame>(cls, "frames");
+    bind_bus_channel<schema::detection_list>(cls, "detections");
+    bind_bus_channel<schema::servo_command>(cls, "servo_commands");
+    bind_bus_channel<schema::frame_descriptor>(cls, "frame_descriptors");
+    bind_bus_channel<schema::track_list>(cls, "tracks");
+    bind_bus_channel<schema::laser_fix>(cls, "laser_fixes");
+    bind_bus_channel<schema::depth_scan>(cls, "depth_scans");
+    cls.def("stats", [](native_bus& b) {
+        py::list out;
+        for (auto& s : b.channels().stats()) {
+            py::dict d;
+            d["name"]      = s.name;
+            d["published"] = s.published;
+            d["delivered"] = s.flow.delivered;
+            d["dropped"]   = s.flow.dropped;
+            d["stalls"]    = s.flow.stalls;
+            out.append(d);
+        }
+        return out;
+    });
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+
+#include "schema/schema.h"
+
+namespace schema {
+
+// Ids are stable across processes; bump version when a layout changes.
+
+struct box {
+    float x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+
+    static constexpr auto fields = std::make_tuple(
+        field("x0", &box::x0), field("y0", &box::y0),
+        field("x1", &box::x1), field("y1", &box::y1));
+};
+
+struct detection {
+    box      bbox;
+    float    score    = 0;
+    int32_t  class_id = -1;
+
+    static constexpr auto fields = std::make_tuple(
+        field("bbox", &detection::bbox),
+        field("score", &detection::score),
+        field("class_id", &detection::class_id));
+};
+
+// One frame's detections. Only count items go on the wire.
+struct detection_list {
+    static constexpr uint16_t    id       = 1;
+    static constexpr uint16_t    version  = 1;
+    static constexpr const char* name     = "detection_list";
+    static constexpr size_t      capacity = 64;
+
+    uint64_t    seq          = 0;
+    uint64_t    timestamp_ns = 0;
+    uint32_t    count        = 0;
+    uint32_t    reserved     = 0;
+    detection   items[capacity];
+
+    static constexpr size_t header_bytes() { return offsetof(detection_list, items); }
+    size_t used_bytes() const { return header_bytes() + count * sizeof(detection); }
+    bool in_bounds() const { return count <= capacity; }
+
+    bool push(const detection& d) {
+        if (count == capacity) return false;
+        items[count++] = d;
+        return true;
+    }
+
+    const detection* begin() const { return items; }
+    const detection* end()   const { return items + count; }
+
+    static constexpr auto fields = std::make_tuple(
+        field("seq", &detection_list::seq),
+        field("timestamp_ns", &detection_list::timestamp_ns),
+        field("count", &detection_list::count),
+        field("reserved", &detection_list::reserved),
+        field("items", &detection_list::items));
+};
+
+struct servo_command {
+    static constexpr uint16_t    id      = 2;
+    static constexpr uint16_t    version = 1;
+    static constexpr const char* name    = "servo_command";
+
+    uint64_t    seq          = 0;
+    uint8_t     channel      = 0;
+    uint8_t     mode         = 0;
+    int16_t     angle_cdeg   = 0;     // centidegrees
+    uint16_t    speed        = 0;
+    uint16_t    reserved     = 0;
+
+    static constexpr auto fields = std::make_tuple(
+        field("seq", &servo_command::seq),
+        field("channel", &servo_command::channel),
+        field("mode", &servo_command::mode),
+        field("angle_cdeg", &servo_command::angle_cdeg),
+        field("speed", &servo_command::speed),
+        field("reserved", &servo_command::reserved));
+};
+
+// Points at a frame living in shared memory; the pixels never travel.
+struct frame_descriptor {
+    static constexpr uint16_t    id      = 3;
+    static constexpr uint16_t    version = 1;
+    static constexpr const char* name    = "frame_descriptor";
+
+    uint64_t    seq          = 0;
+    uint64_t    timestamp_ns = 0;
+    uint32_t    slot         = 0;
+    uint32_t    fourcc       = 0;
+    uint32_t    width        = 0;
+    uint32_t    height       = 0;
+    uint32_t    stride       = 0;
+    uint32_t    bytes        = 0;
+
+    static constexpr auto fields = std::make_tuple(
+        field("seq", &frame_descriptor::seq),
+        field("timestamp_ns", &frame_descriptor::timestamp_ns),
+        field("slot", &frame_descriptor::slot),
+        field("fourcc", &frame_descriptor::fourcc),
+        field("width", &frame_descriptor::width),
+        field("height", &frame_descriptor::height),
+        field("stride", &frame_descriptor::stride),
+        field("bytes", &frame_descriptor::bytes));
+};
+
+// Tracker output: confirmed tracks predicted to timestamp_ns.
+struct track {
+    box      bbox;
+    float    vx       = 0;      // pixels / s
+    float    vy       = 0;
+    float    score    = 0;
+    uint32_t id       = 0;
+    int32_t  class_id = -1;
+
+    static constexpr auto fields = std::make_tuple(
+        field("bbox", &track::bbox),
+        field("vx", &track::vx),
+        field("vy", &track::vy),
+        field("score", &track::score),
+        field("id", &track::id),
+        field("class_id", &track::class_id));
+};
+
+struct track_list {
+    static constexpr uint16_t    id       = 4;
+    static constexpr uint16_t    version  = 1;
+    static constexpr const char* name     = "track_list";
+    static constexpr size_t      capacity = 64;
+
+    uint64_t    seq          = 0;
+    uint64_t    timestamp_ns = 0;
+    uint32_t    count        = 0;
+    uint32_t    reserved     = 0;
+    track       items[capacity];
+
+    static constexpr size_t header_bytes() { return offsetof(track_list, items); }
+    size_t used_bytes() const { return header_bytes() + count * sizeof(track); }
+    bool in_bounds() const { return count <= capacity; }
+
+    bool push(const track& t) {
+        if (count == capacity) return false;
+        items[count++] = t;
+        return true;
+    }
+
+    const track* begin() const { return items; }
+    const track* end()   const { return items + count; }
+
+    static constexpr auto fields = std::make_tuple(
+        field("seq", &track_list::seq),
+        field("timestamp_ns", &track_list::timestamp_ns),
+        field("count", &track_list::count),
+        field("reserved", &track_list::reserved),
+        field("items", &track_list::items));
+};
+
+// A laser dot seen at the same place over enough recent frames, and the
+// range it gives; depth_m is NaN without a calibration or out of range.
+struct laser_fix {
+    static constexpr uint16_t    id      = 5;
+    static constexpr uint16_t    version = 1;
+    static constexpr const char* name    = "laser_fix";
+
+    uint64_t    seq          = 0;
+    uint64_t    timestamp_ns = 0;
+    float       x            = 0;       // pixels
+    float       y            = 0;
+    float       variance     = 0;       // pixels^2, x and y summed
+    float       score        = 0;
+    float       depth_m      = 0;
+    uint32_t    frames       = 0;       // frames of the window the dot was in
+    uint32_t    cluster      = 0;       // stable while the dot stays put
+    uint32_t    reserved     = 0;
+
+    static constexpr auto fields = std::make_tuple(
+        field("seq", &laser_fix::seq),
+        field("timestamp_ns", &laser_fix::timestamp_ns),
+        field("x", &laser_fix::x),
+        field("y", &laser_fix::y),
+        field("variance", &laser_fix::variance),
+        field("score", &laser_fix::score),
+        field("depth_m", &laser_fix::depth_m),
+        field("frames", &laser_fix::frames),
+        field("cluster", &laser_fix::cluster),
+        field("reserved", &laser_fix::reserved));
+};
+
+// One frame of the laser line scanner: a range per image column, NaN where
+// the column had no reading. Only count samples go on the wire; a wider
+// frame is cut to capacity columns and valid counts only those.
+struct depth_scan {
+    static constexpr uint16_t    id       = 6;
+    static constexpr uint16_t    version  = 1;
+    static constexpr const char* name     = "depth_scan";
+    static constexpr size_t      capacity = 2048;
+
+    uint64_t    seq          = 0;
+    uint64_t    timestamp_ns = 0;
+    uint32_t    count        = 0;       // columns
+    uint32_t    valid        = 0;       // columns with a reading
+    float       depth_m[capacity];
+
+    static constexpr size_t header_bytes() { return offsetof(depth_scan, depth_m); }
+    size_t used_bytes() const { return header_bytes() + count * sizeof(float); }
+    bool in_bounds() const { return count <= capacity; }
+
+    static constexpr auto fields = std::make_tuple(
+        field("seq", &depth_scan::seq),
+        field("timestamp_ns", &depth_scan::timestamp_ns),
+        field("count", &depth_scan::count),
+        field("valid", &depth_scan::valid),
+        field("depth_m", &depth_scan::depth_m));
+};
+
+inline std::string builtin_catalog() {
+    return catalog<detection_list, servo_command, frame_descriptor, track_list, laser_fix, depth_scan>();
+}
+
+};
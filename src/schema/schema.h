@@ -0,0 +1,163 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "ipc/ipc.h"
+
+namespace schema {
+
+// A message type is a trivially copyable, standard-layout struct that
+// describes itself once:
+//
+//   struct servo_command {
+//       static constexpr uint16_t    id      = 3;
+//       static constexpr uint16_t    version = 1;
+//       static constexpr const char* name    = "servo_command";
+//       int16_t yaw; ...
+//       static constexpr auto fields = std::make_tuple(schema::field("yaw", &servo_command::yaw), ...);
+//   };
+//
+// The bytes on the wire are the struct itself; readers cast in place.
+
+template<typename T, typename M>
+struct field_t {
+    const char* name;
+    M T::*      member;
+};
+
+template<typename T, typename M>
+constexpr field_t<T, M> field(const char* name, M T::* member) { return {name, member}; }
+
+template<typename T>
+constexpr bool is_message_v = std::is_trivially_copyable_v<T> && std::is_standard_layout_v<T>;
+
+template<typename T>
+struct checked {
+    static_assert(is_message_v<T>, "schema: messages must be trivially copyable and standard layout");
+    static_assert(alignof(T) <= 8, "schema: ring records are only 8-byte aligned");
+    static constexpr bool value = true;
+};
+
+// Messages with a trailing variable-length part report how many bytes of the
+// struct are in use, and whether their count fits; everything else is sent
+// whole.
+template<typename T, typename = void>
+struct wire_size {
+    static size_t of(const T&)        { return sizeof(T); }
+    static size_t min()               { return sizeof(T); }
+    static bool   in_bounds(const T&) { return true; }
+};
+
+template<typename T>
+struct wire_size<T, std::void_t<decltype(std::declval<const T&>().used_bytes())>> {
+    static size_t of(const T& v)        { return v.used_bytes(); }
+    static size_t min()                 { return T::header_bytes(); }
+    static bool   in_bounds(const T& v) { return v.in_bounds(); }     // count <= capacity
+};
+
+// Writes m into the ring with its schema id and version in the record header.
+template<typename T>
+bool write(ipc::ring& r, const T& m, std::chrono::nanoseconds timeout = std::chrono::milliseconds(100)) {
+    static_assert(checked<T>::value);
+    uint32_t n = static_cast<uint32_t>(wire_size<T>::of(m));
+    void* p = r.reserve(n, timeout);
+    if (!p) return false;
+    std::memcpy(p, &m, n);
+    r.commit(T::id, T::version);
+    return true;
+}
+
+// Zero-copy read: the record reinterpreted in place, or null if it is not a
+// T of the expected version, is truncated or claims more entries than T
+// holds. Valid until ring::release().
+template<typename T>
+const T* read(const ipc::ring::view& v) {
+    static_assert(checked<T>::value);
+    if (!v || v.schema != T::id || v.flags != T::version || v.size < wire_size<T>::min()) return nullptr;
+    const T* p = static_cast<const T*>(v.data);
+    if (!wire_size<T>::in_bounds(*p) || wire_size<T>::of(*p) > v.size) return nullptr;
+    return p;
+}
+
+namespace detail {
+
+template<typename F> struct dtype          { static constexpr const char* str = nullptr; };
+template<> struct dtype<int8_t>            { static constexpr const char* str = "<i1"; };
+template<> struct dtype<uint8_t>           { static constexpr const char* str = "<u1"; };
+template<> struct dtype<int16_t>           { static constexpr const char* str = "<i2"; };
+template<> struct dtype<uint16_t>          { static constexpr const char* str = "<u2"; };
+template<> struct dtype<int32_t>           { static constexpr const char* str = "<i4"; };
+template<> struct dtype<uint32_t>          { static constexpr const char* str = "<u4"; };
+template<> struct dtype<int64_t>           { static constexpr const char* str = "<i8"; };
+template<> struct dtype<uint64_t>          { static constexpr const char* str = "<u8"; };
+template<> struct dtype<float>             { static constexpr const char* str = "<f4"; };
+template<> struct dtype<double>            { static constexpr const char* str = "<f8"; };
+template<> struct dtype<char>              { static constexpr const char* str = "|S1"; };
+
+template<typename T, typename M>
+size_t offset_of(M T::* member) {
+    static const T probe{};
+    return static_cast<size_t>(reinterpret_cast<const char*>(&(probe.*member)) - reinterpret_cast<const char*>(&probe));
+}
+
+template<typename T>
+void describe_fields(std::ostream& os);
+
+template<typename M>
+void describe_type(std::ostream& os) {
+    using E = std::remove_all_extents_t<M>;
+    size_t count = sizeof(M) / sizeof(E);
+    if constexpr (dtype<E>::str != nullptr) {
+        os << "\"dtype\": \"" << dtype<E>::str << "\"";
+    } else {
+        os << "\"itemsize\": " << sizeof(E) << ", \"fields\": ";
+        describe_fields<E>(os);
+    }
+    os << ", \"count\": " << count;
+}
+
+template<typename T>
+void describe_fields(std::ostream& os) {
+    os << "[";
+    bool first = true;
+    std::apply([&](const auto&... f) {
+        ((os << (first ? "" : ", ") << "{\"name\": \"" << f.name << "\", \"offset\": " << offset_of(f.member) << ", ",
+          describe_type<std::remove_reference_t<decltype(std::declval<T&>().*(f.member))>>(os),
+          os << "}", first = false), ...);
+    }, T::fields);
+    os << "]";
+}
+
+};
+
+// JSON layout of T for non-C++ readers: name, id, version, itemsize and the
+// offset/dtype of every field (numpy dtype strings, nested for sub-structs).
+// playground/common/nativeSchema.py turns it into a numpy dtype.
+template<typename T>
+std::string describe() {
+    static_assert(checked<T>::value);
+    std::ostringstream os;
+    os << "{\"name\": \"" << T::name << "\", \"id\": " << T::id << ", \"version\": " << T::version
+       << ", \"itemsize\": " << sizeof(T) << ", \"fields\": ";
+    detail::describe_fields<T>(os);
+    os << "}";
+    return os.str();
+}
+
+template<typename... Ts>
+std::string catalog() {
+    std::string out = "[";
+    bool first = true;
+    ((out += (first ? "" : ",\n "), out += describe<Ts>(), first = false), ...);
+    return out + "]";
+}
+
+};
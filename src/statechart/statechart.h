@@ -0,0 +1,356 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dispatch/dispatch.h"
+#include "timer/timer.h"
+
+namespace statechart {
+
+using clock    = std::chrono::steady_clock;
+using state_id = uint16_t;
+
+constexpr state_id none = UINT16_MAX;
+
+struct event {
+    uint32_t id  = 0;
+    uint64_t arg = 0;
+};
+
+enum class kind { atomic, compound, parallel };
+
+using action_t = std::function<void(const event&)>;
+using guard_t  = std::function<bool(const event&)>;
+using hook_t   = std::function<void()>;
+
+// Static description of a chart. States are added parent-first, so index
+// order is document order and every descendant has a larger id than its
+// ancestors. State 0 is the implicit compound root.
+class definition {
+public:
+    // Ids at or above this are reserved for timed transitions.
+    static constexpr uint32_t timeout_event = 0x80000000u;
+    // Enters the initial configuration; user events stay below it.
+    static constexpr uint32_t start_event = timeout_event - 1;
+
+    definition() { states_.push_back({"root", none, kind::compound, none, nullptr, nullptr, {}}); }
+
+    state_id root() const { return 0; }
+
+    state_id add(std::string name, state_id parent, kind k = kind::atomic) {
+        if (parent >= states_.size() || states_[parent].type == kind::atomic) {
+            throw std::invalid_argument("statechart: parent must be a compound or parallel state");
+        }
+        states_.push_back({std::move(name), parent, k, none, nullptr, nullptr, {}});
+        state_id id = static_cast<state_id>(states_.size() - 1);
+        if (states_[parent].initial == none) states_[parent].initial = id;
+        return id;
+    }
+
+    // Defaults to the first child added.
+    definition& initial(state_id compound, state_id child) {
+        states_[compound].initial = child;
+        return *this;
+    }
+
+    definition& on_entry(state_id s, hook_t f) {
+        states_[s].entry = std::move(f);
+        return *this;
+    }
+
+    definition& on_exit(state_id s, hook_t f) {
+        states_[s].exit = std::move(f);
+        return *this;
+    }
+
+    // to == none makes an internal transition: the action runs, nothing is
+    // exited or entered.
+    definition& transition(state_id from, uint32_t ev, state_id to, action_t action = nullptr, guard_t guard = nullptr) {
+        if (ev >= start_event) throw std::invalid_argument("statechart: event id collides with reserved ids");
+        transitions_.push_back({from, ev, to, std::move(guard), std::move(action), {}});
+        return *this;
+    }
+
+    // Taken after `from` has been continuously active for d; driven by the
+    // timer service instead of sleeping in a handler.
+    definition& after(state_id from, clock::duration d, state_id to, action_t action = nullptr) {
+        uint32_t id = timeout_event | static_cast<uint32_t>(transitions_.size());
+        transitions_.push_back({from, id, to, nullptr, std::move(action), d});
+        states_[from].timed.push_back(static_cast<uint32_t>(transitions_.size() - 1));
+        return *this;
+    }
+
+    size_t size() const { return states_.size(); }
+    const std::string& name(state_id s) const { return states_[s].name; }
+
+private:
+    friend class chart;
+
+    struct state {
+        std::string             name;
+        state_id                parent;
+        kind                    type;
+        state_id                initial = none;
+        hook_t                  entry;
+        hook_t                  exit;
+        std::vector<uint32_t>   timed;
+    };
+
+    struct edge {
+        state_id            from;
+        uint32_t            event;
+        state_id            to;
+        guard_t             guard;
+        action_t            action;
+        clock::duration     delay;
+    };
+
+    std::vector<state>  states_;
+    std::vector<edge>   transitions_;
+};
+
+// One running instance of a definition. Events are queued and processed
+// run-to-completion on the dispatch pool, at most one drain at a time and in
+// bounded batches, so a chart never parks a worker thread.
+class chart : public std::enable_shared_from_this<chart> {
+public:
+    static constexpr size_t batch = 64;
+
+    static std::shared_ptr<chart> create(std::shared_ptr<const definition> def, dispatch::dispatch& pool, timer::service& timers) {
+        return std::shared_ptr<chart>(new chart(std::move(def), pool, timers));
+    }
+
+    ~chart() {
+        for (auto& hs : timers_) {
+            for (auto h : hs) timers_svc_.cancel(h);
+        }
+    }
+
+    // Enters the initial configuration (asynchronously, like any event).
+    void start() { enqueue({start_event, 0}); }
+
+    void post(event e) {
+        if (e.id >= definition::start_event) throw std::invalid_argument("statechart: event id collides with reserved ids");
+        enqueue(e);
+    }
+
+    bool active(state_id s) const { return active_[s].load(std::memory_order_acquire); }
+
+    std::vector<state_id> configuration() const {
+        std::vector<state_id> out;
+        for (state_id s = 0; s < def_->size(); ++s) {
+            if (active(s)) out.push_back(s);
+        }
+        return out;
+    }
+
+private:
+    static constexpr uint32_t start_event = definition::start_event;
+
+    using edge = definition::edge;
+
+    chart(std::shared_ptr<const definition> def, dispatch::dispatch& pool, timer::service& timers)
+        : def_(std::move(def)), pool_(pool), timers_svc_(timers),
+          active_(new std::atomic<bool>[def_->size()]),
+          entries_(def_->size(), 0), timers_(def_->size()), outgoing_(def_->size()) {
+        for (size_t i = 0; i < def_->size(); ++i) active_[i].store(false, std::memory_order_relaxed);
+        for (size_t t = 0; t < def_->transitions_.size(); ++t) {
+            outgoing_[def_->transitions_[t].from].push_back(static_cast<uint32_t>(t));
+        }
+    }
+
+    const definition::state& st(state_id s) const { return def_->states_[s]; }
+
+    void enqueue(event e) {
+        bool claim = false;
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            queue_.push_back(e);
+            if (!draining_) {
+                draining_ = true;
+                claim = true;
+            }
+        }
+        if (claim) schedule();
+    }
+
+    void schedule() {
+        try {
+            pool_.post([self = shared_from_this()] { self->drain(); });
+        } catch (const std::logic_error&) {
+            // Pool already shut down: nothing will ever run the queue again,
+            // so drop it rather than let it grow.
+            std::lock_guard<std::mutex> lock(m_);
+            queue_.clear();
+            draining_ = false;
+        }
+    }
+
+    void drain() {
+        for (size_t n = 0; n < batch; ++n) {
+            event e;
+            {
+                std::lock_guard<std::mutex> lock(m_);
+                if (queue_.empty()) {
+                    draining_ = false;
+                    return;
+                }
+                e = queue_.front();
+                queue_.pop_front();
+            }
+            step(e);
+        }
+        schedule();
+    }
+
+    bool is_descendant(state_id s, state_id ancestor) const {
+        for (s = st(s).parent; s != none; s = st(s).parent) {
+            if (s == ancestor) return true;
+        }
+        return false;
+    }
+
+    // Least compound ancestor strictly containing both; exits and entries of
+    // a transition stay below it.
+    state_id domain(state_id from, state_id to) const {
+        for (state_id a = st(from).parent; a != none; a = st(a).parent) {
+            if (st(a).type == kind::compound && is_descendant(to, a)) return a;
+        }
+        return def_->root();
+    }
+
+    void step(const event& e) {
+        if (e.id == start_event) {
+            if (!active(def_->root())) enter_default(def_->root());
+            return;
+        }
+        if (e.id >= definition::timeout_event) {
+            const edge& t = def_->transitions_[e.id & ~definition::timeout_event];
+            if (active(t.from) && entries_[t.from] == e.arg) fire({&t}, e);
+            return;
+        }
+
+        // Innermost-first, document-order selection; a transition whose exit
+        // set overlaps one already chosen loses (orthogonal regions each get
+        // their own).
+        std::vector<const edge*> chosen;
+        std::vector<state_id>    domains;
+        for (state_id leaf = 0; leaf < def_->size(); ++leaf) {
+            if (!active(leaf) || st(leaf).type != kind::atomic) continue;
+            const edge* pick = nullptr;
+            for (state_id s = leaf; s != none && !pick; s = st(s).parent) {
+                for (uint32_t i : outgoing_[s]) {
+                    const edge& t = def_->transitions_[i];
+                    if (t.event == e.id && (!t.guard || t.guard(e))) {
+                        pick = &t;
+                        break;
+                    }
+                }
+            }
+            if (!pick) continue;
+            state_id d = pick->to == none ? none : domain(pick->from, pick->to);
+            bool clash = false;
+            for (size_t i = 0; i < chosen.size() && !clash; ++i) {
+                if (chosen[i] == pick) clash = true;
+                else if (d != none && domains[i] != none
+                      && (d == domains[i] || is_descendant(d, domains[i]) || is_descendant(domains[i], d))) clash = true;
+            }
+            if (!clash) {
+                chosen.push_back(pick);
+                domains.push_back(d);
+            }
+        }
+        if (!chosen.empty()) fire(chosen, e);
+    }
+
+    void fire(const std::vector<const edge*>& ts, const event& e) {
+        for (const edge* t : ts) {
+            if (t->to == none) continue;
+            state_id d = domain(t->from, t->to);
+            for (state_id s = static_cast<state_id>(def_->size() - 1); s > d; --s) {
+                if (active(s) && is_descendant(s, d)) exit(s);
+            }
+        }
+        for (const edge* t : ts) {
+            if (t->action) t->action(e);
+        }
+        for (const edge* t : ts) {
+            if (t->to == none) continue;
+            enter_path(domain(t->from, t->to), t->to);
+        }
+    }
+
+    // Enters every state from just below d down to target, then target's
+    // default descendants. Parallel states on the way get all their other
+    // regions default-entered too.
+    void enter_path(state_id d, state_id target) {
+        std::vector<state_id> path;
+        for (state_id s = target; s != d; s = st(s).parent) path.push_back(s);
+        for (size_t i = path.size(); i-- > 0;) {
+            state_id s = path[i];
+            if (i == 0) {
+                enter_default(s);
+                break;
+            }
+            if (!active(s)) enter(s);
+            if (st(s).type == kind::parallel) {
+                for (state_id c = s + 1; c < def_->size(); ++c) {
+                    if (st(c).parent == s && c != path[i - 1] && !active(c)) enter_default(c);
+                }
+            }
+        }
+    }
+
+    void enter_default(state_id s) {
+        if (!active(s)) enter(s);
+        if (st(s).type == kind::compound && st(s).initial != none) {
+            enter_default(st(s).initial);
+        } else if (st(s).type == kind::parallel) {
+            for (state_id c = s + 1; c < def_->size(); ++c) {
+                if (st(c).parent == s) enter_default(c);
+            }
+        }
+    }
+
+    void enter(state_id s) {
+        active_[s].store(true, std::memory_order_release);
+        uint64_t gen = ++entries_[s];
+        if (st(s).entry) st(s).entry();
+        for (uint32_t t : st(s).timed) {
+            std::weak_ptr<chart> w = weak_from_this();
+            timers_[s].push_back(timers_svc_.after(def_->transitions_[t].delay, [w, t, gen] {
+                if (auto c = w.lock()) c->enqueue({definition::timeout_event | t, gen});
+            }));
+        }
+    }
+
+    void exit(state_id s) {
+        for (auto h : timers_[s]) timers_svc_.cancel(h);
+        timers_[s].clear();
+        if (st(s).exit) st(s).exit();
+        active_[s].store(false, std::memory_order_release);
+    }
+
+    std::shared_ptr<const definition>           def_;
+    dispatch::dispatch&                         pool_;
+    timer::service&                             timers_svc_;
+    std::unique_ptr<std::atomic<bool>[]>        active_;
+    std::vector<uint64_t>                       entries_;
+    std::vector<std::vector<timer::handle>>     timers_;
+    std::vector<std::vector<uint32_t>>          outgoing_;
+
+    std::mutex          m_;
+    std::deque<event>   queue_;
+    bool                draining_ = false;
+};
+
+};
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace stats {
+
+// Streaming quantiles for per-pixel thresholds and other running
+// statistics, none of which allocate after construction.
+//
+//  - histogram: exact quantiles of small integer values (8-bit pixels,
+//    detector scores) in O(n + bins) per frame instead of a sort.
+//  - p2_quantile: one quantile of arbitrary values in five markers.
+//  - tdigest: any quantile of arbitrary values in a fixed number of
+//    centroids, accurate in the tails where thresholds usually sit.
+//
+// All three work per frame (clear between frames). histogram and tdigest
+// also keep an exponentially decayed window, where older frames fade out
+// by 1 - alpha per frame, so a threshold follows slow lighting changes
+// without jumping on a single frame.
+
+enum class window { frame, decayed };
+
+// Counts of integer values in [0, Bins); larger values land in the last bin.
+// Values are counted into four interleaved banks so consecutive equal values
+// (flat image regions) do not serialise on one counter's store-to-load
+// dependency; the banks are summed once per frame in commit().
+template<size_t Bins>
+class histogram {
+public:
+    static constexpr size_t bins = Bins;
+
+    explicit histogram(window w = window::frame, double alpha = 0.1) : window_(w), alpha_(alpha) { reset(); }
+
+    // Forgets everything, including decayed history.
+    void reset() {
+        for (auto& b : banks_) b.fill(0);
+        weight_.fill(0.0);
+        frames_ = 0;
+    }
+
+    // Starts a new frame of samples.
+    void clear() {
+        for (auto& b : banks_) b.fill(0);
+    }
+
+    void add(uint32_t v) { ++banks_[0][v < Bins ? v : Bins - 1]; }
+
+    template<typename T>
+    void add(const T* v, size_t n) {
+        auto bin = [](T x) { return size_t(x) < Bins ? size_t(x) : Bins - 1; };
+        uint32_t* b0 = banks_[0].data();
+        uint32_t* b1 = banks_[1].data();
+        uint32_t* b2 = banks_[2].data();
+        uint32_t* b3 = banks_[3].data();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            ++b0[bin(v[i])];
+            ++b1[bin(v[i + 1])];
+            ++b2[bin(v[i + 2])];
+            ++b3[bin(v[i + 3])];
+        }
+        for (; i < n; ++i) ++b0[bin(v[i])];
+    }
+
+    // Ends the frame: folds the banks into the window the quantiles read.
+    void commit() {
+        double keep = window_ == window::decayed && frames_ ? 1.0 - alpha_ : 0.0;
+        for (size_t b = 0; b < Bins; ++b) {
+            double c = double(banks_[0][b]) + double(banks_[1][b]) + double(banks_[2][b]) + double(banks_[3][b]);
+            weight_[b] = weight_[b] * keep + c;
+        }
+        ++frames_;
+    }
+
+    // Samples in bins first and up added since clear().
+    uint64_t pending(size_t first = 0) const {
+        uint64_t t = 0;
+        for (const auto& bank : banks_) {
+            for (size_t b = first; b < Bins; ++b) t += bank[b];
+        }
+        return t;
+    }
+
+    // Committed weight of bin b (a count in per-frame mode).
+    double count(size_t b) const { return weight_[b]; }
+
+    // Total weight of bins first and up.
+    double total(size_t first = 0) const {
+        double t = 0;
+        for (size_t b = first; b < Bins; ++b) t += weight_[b];
+        return t;
+    }
+
+    // Quantile q in [0, 1] of the committed values >= first, interpolated
+    // between neighbouring ranks like np.percentile; -1 if there are none.
+    double quantile(double q, size_t first = 0) const {
+        double t = total(first);
+        if (t <= 0) return -1.0;
+        double pos = std::clamp(q, 0.0, 1.0) * std::max(t - 1.0, 0.0);
+        double lo = std::floor(pos);
+        double v0 = value_at(lo, first), v1 = v0;
+        if (lo + 1.0 < t) v1 = value_at(lo + 1.0, first);
+        return v0 + (v1 - v0) * (pos - lo);
+    }
+
+private:
+    // Smallest bin whose cumulative weight exceeds rank.
+    double value_at(double rank, size_t first) const {
+        double seen = 0;
+        for (size_t b = first; b < Bins; ++b) {
+            seen += weight_[b];
+            if (seen > rank) return double(b);
+        }
+        return double(Bins - 1);
+    }
+
+    window                                  window_;
+    double                                  alpha_;
+    std::array<std::array<uint32_t, Bins>, 4>   banks_;
+    std::array<double, Bins>                weight_;
+    uint64_t                                frames_ = 0;
+};
+
+// The P-square estimator (Jain and Chlamtac): five markers whose heights
+// track the minimum, q/2, q, (1+q)/2 and the maximum, adjusted with a
+// piecewise-parabolic fit as samples arrive. O(1) per sample.
+class p2_quantile {
+public:
+    explicit p2_quantile(double q = 0.5) : q_(std::clamp(q, 0.0, 1.0)) { clear(); }
+
+    void clear() {
+        count_ = 0;
+        for (int i = 0; i < 5; ++i) n_[i] = i;
+        want_[0] = 0;
+        want_[1] = 2 * q_;
+        want_[2] = 4 * q_;
+        want_[3] = 2 + 2 * q_;
+        want_[4] = 4;
+        step_[0] = 0;
+        step_[1] = q_ / 2;
+        step_[2] = q_;
+        step_[3] = (1 + q_) / 2;
+        step_[4] = 1;
+    }
+
+    uint64_t count() const { return count_; }
+
+    void add(double x) {
+        if (count_ < 5) {
+            h_[count_++] = x;
+            if (count_ == 5) std::sort(h_, h_ + 5);
+            return;
+        }
+        ++count_;
+        int k;
+        if (x < h_[0]) {
+            h_[0] = x;
+            k = 0;
+        } else if (x >= h_[4]) {
+            h_[4] = std::max(h_[4], x);
+            k = 3;
+        } else {
+            k = 0;
+            while (k < 3 && x >= h_[k + 1]) ++k;
+        }
+        for (int i = k + 1; i < 5; ++i) ++n_[i];
+        for (int i = 0; i < 5; ++i) want_[i] += step_[i];
+
+        for (int i = 1; i < 4; ++i) {
+            double d = want_[i] - double(n_[i]);
+            if ((d >= 1 && n_[i + 1] - n_[i] > 1) || (d <= -1 && n_[i - 1] - n_[i] < -1)) {
+                int s = d >= 0 ? 1 : -1;
+                double p = parabolic(i, s);
+                h_[i] = h_[i - 1] < p && p < h_[i + 1] ? p : linear(i, s);
+                n_[i] += s;
+            }
+        }
+    }
+
+    template<typename T>
+    void add(const T* v, size_t n) {
+        for (size_t i = 0; i < n; ++i) add(double(v[i]));
+    }
+
+    // The estimate; exact (nearest rank) until five samples have arrived.
+    double value() const {
+        if (count_ == 0) return 0.0;
+        if (count_ < 5) {
+            double s[5];
+            std::copy(h_, h_ + count_, s);
+            std::sort(s, s + count_);
+            return s[static_cast<size_t>(std::lround(q_ * double(count_ - 1)))];
+        }
+        return h_[2];
+    }
+
+private:
+    double parabolic(int i, int s) const {
+        double d = s;
+        double a = double(n_[i + 1] - n_[i - 1]);
+        double up = (double(n_[i] - n_[i - 1]) + d) * (h_[i + 1] - h_[i]) / double(n_[i + 1] - n_[i]);
+        double dn = (double(n_[i + 1] - n_[i]) - d) * (h_[i] - h_[i - 1]) / double(n_[i] - n_[i - 1]);
+        return h_[i] + d / a * (up + dn);
+    }
+
+    double linear(int i, int s) const {
+        return h_[i] + double(s) * (h_[i + s] - h_[i]) / double(n_[i + s] - n_[i]);
+    }
+
+    double      q_;
+    uint64_t    count_ = 0;
+    double      h_[5]    = {};      // marker heights
+    int64_t     n_[5]    = {};      // marker positions
+    double      want_[5] = {};      // desired positions
+    double      step_[5] = {};
+};
+
+// Merging t-digest with the k1 (arcsine) scale function. Samples collect in
+// a fixed buffer and are merged into about Compression centroids when it
+// fills. Centroid size shrinks towards q = 0 and q = 1, so tail quantiles
+// get the finest resolution (about 1e-3 in rank at q = 0.99 with the
+// default compression). decay() scales every weight, which is the decayed
+// window.
+template<size_t Compression = 100, size_t Buffer = 512>
+class tdigest {
+public:
+    void clear() {
+        centroids_ = 0;
+        pending_   = 0;
+        total_     = 0;
+        min_ = max_ = 0;
+    }
+
+    void add(double x, double w = 1.0) {
+        if (w <= 0 || std::isnan(x)) return;
+        if (total_ == 0 && pending_ == 0) {
+            min_ = max_ = x;
+        } else {
+            min_ = std::min(min_, x);
+            max_ = std::max(max_, x);
+        }
+        buffer_[pending_++] = {x, w};
+        if (pending_ == Buffer) merge();
+    }
+
+    template<typename T>
+    void add(const T* v, size_t n) {
+        for (size_t i = 0; i < n; ++i) add(double(v[i]));
+    }
+
+    // Multiplies all weight by keep (1 - alpha) once per frame.
+    void decay(double keep) {
+        merge();
+        for (size_t i = 0; i < centroids_; ++i) merged_[i].second *= keep;
+        total_ *= keep;
+    }
+
+    double total() {
+        merge();
+        return total_;
+    }
+
+    double quantile(double q) {
+        merge();
+        if (centroids_ == 0) return 0.0;
+        if (centroids_ == 1) return merged_[0].first;
+        double target = std::clamp(q, 0.0, 1.0) * total_;
+        // Centroid i covers [cum, cum + w) with its mean at the middle;
+        // interpolate between neighbouring middles, and towards the extremes
+        // at both ends.
+        double cum = 0;
+        for (size_t i = 0; i < centroids_; ++i) {
+            double w = merged_[i].second, mid = cum + w / 2;
+            if (target < mid) {
+                if (i == 0) {
+                    return w > 0 ? min_ + (merged_[0].first - min_) * (target / mid) : min_;
+                }
+                double pmid = cum - merged_[i - 1].second / 2;
+                double t = (target - pmid) / (mid - pmid);
+                return merged_[i - 1].first + (merged_[i].first - merged_[i - 1].first) * t;
+            }
+            cum += w;
+        }
+        double last = merged_[centroids_ - 1].first, w = merged_[centroids_ - 1].second;
+        double t = w > 0 ? (target - (total_ - w / 2)) / (w / 2) : 1.0;
+        return last + (max_ - last) * std::clamp(t, 0.0, 1.0);
+    }
+
+    size_t centroids() {
+        merge();
+        return centroids_;
+    }
+
+private:
+    using point = std::pair<double, double>;     // mean, weight
+
+    static constexpr double pi = 3.14159265358979323846;
+
+    static double k_of(double q) {
+        return double(Compression) / (2 * pi) * std::asin(std::clamp(2 * q - 1, -1.0, 1.0));
+    }
+
+    static double q_of(double k) {
+        return (std::sin(std::clamp(k * 2 * pi / double(Compression), -pi / 2, pi / 2)) + 1) / 2;
+    }
+
+    void merge() {
+        if (pending_ == 0) return;
+        size_t n = 0;
+        for (size_t i = 0; i < centroids_; ++i) scratch_[n++] = merged_[i];
+        for (size_t i = 0; i < pending_; ++i) {
+            scratch_[n++] = buffer_[i];
+            total_ += buffer_[i].second;
+        }
+        pending_ = 0;
+        std::sort(scratch_.begin(), scratch_.begin() + n);
+
+        // Greedy sweep: a centroid grows while it spans at most one unit of k.
+        centroids_ = 0;
+        double before = 0;
+        double limit = total_ * q_of(k_of(0.0) + 1);
+        point cur = scratch_[0];
+        for (size_t i = 1; i < n; ++i) {
+            const point& p = scratch_[i];
+            if (before + cur.second + p.second <= limit) {
+                double w = cur.second + p.second;
+                cur.first += (p.first - cur.first) * p.second / w;
+                cur.second = w;
+            } else {
+                before += cur.second;
+                push(cur);
+                limit = total_ * q_of(k_of(before / total_) + 1);
+                cur = p;
+            }
+        }
+        push(cur);
+    }
+
+    void push(const point& p) {
+        if (centroids_ < capacity) {
+            merged_[centroids_++] = p;
+            return;
+        }
+        point& last = merged_[capacity - 1];
+        double w = last.second + p.second;
+        last.first += (p.first - last.first) * p.second / w;
+        last.second = w;
+    }
+
+    static constexpr size_t capacity = 2 * Compression;
+
+    std::array<point, capacity>             merged_;
+    std::array<point, Buffer>               buffer_;
+    std::array<point, capacity + Buffer>    scratch_;
+    size_t                                  centroids_ = 0;
+    size_t                                  pending_   = 0;
+    double                                  total_     = 0;
+    double                                  min_       = 0;
+    double                                  max_       = 0;
+};
+
+};
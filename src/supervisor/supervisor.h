@@ -0,0 +1,219 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "dispatch/dispatch.h"
+
+namespace supervisor {
+
+using clock = std::chrono::steady_clock;
+
+// log2 buckets of inter-beat interval in microseconds, as timed by the
+// monitor: [0] < 2us ... [31].
+struct histogram {
+    static constexpr size_t buckets = 32;
+
+    std::array<uint64_t, buckets> counts{};
+
+    static size_t bucket(uint64_t us) {
+        return us < 2 ? 0 : std::min<size_t>(63 - __builtin_clzll(us), buckets - 1);
+    }
+
+    uint64_t total() const {
+        uint64_t n = 0;
+        for (auto c : counts) n += c;
+        return n;
+    }
+
+    // Upper bound of the bucket holding quantile q, in microseconds.
+    uint64_t quantile_us(double q) const {
+        uint64_t n = total();
+        if (n == 0) return 0;
+        uint64_t want = static_cast<uint64_t>(q * (n - 1)) + 1, seen = 0;
+        for (size_t b = 0; b < buckets; ++b) {
+            seen += counts[b];
+            if (seen >= want) return uint64_t(2) << b;
+        }
+        return UINT64_MAX;
+    }
+};
+
+// Per-task liveness slot, alone on its cache line. beat() publishes a
+// task-local counter with one relaxed store: no read-modify-write, no clock
+// read. The monitor only reads, and times the beats itself.
+class alignas(dispatch::cache_line) heartbeat {
+public:
+    void beat() { seq_.store(++local_, std::memory_order_relaxed); }
+
+    // False once the token trips or the supervisor has replaced this instance.
+    bool alive(const dispatch::cancel_token& tok) const {
+        return !tok.cancelled() && !retired_.load(std::memory_order_relaxed);
+    }
+
+private:
+    friend class supervisor;
+
+    std::atomic<uint64_t>   seq_{0};
+    uint64_t                local_ = 0;
+    alignas(dispatch::cache_line) std::atomic<bool> retired_{false};
+};
+
+struct stall {
+    std::string         name;
+    clock::duration     silent_for;
+    unsigned            restarts;
+};
+
+struct stats {
+    std::string     name;
+    uint64_t        beats    = 0;
+    unsigned        stalls   = 0;
+    unsigned        restarts = 0;
+    histogram       intervals;
+};
+
+struct policy {
+    clock::duration deadline     = std::chrono::seconds(1);
+    bool            restart      = true;
+    unsigned        max_restarts = 3;
+};
+
+// Runs long-lived tasks on a dispatch and watches their heartbeats from one
+// monitor thread. A task that stays silent past its deadline is reported to
+// on_stall and, per policy, retired and started again on a fresh slot; the
+// stalled instance is expected to notice heartbeat::alive() going false.
+// on_stall runs on the monitor thread and must not call back into supervisor.
+class supervisor {
+public:
+    using task_t   = std::function<void(heartbeat&, const dispatch::cancel_token&)>;
+    using stall_fn = std::function<void(const stall&)>;
+
+    explicit supervisor(dispatch::dispatch& d, clock::duration poll = std::chrono::milliseconds(5))
+        : dispatch_(d), poll_(poll) {
+        thread_ = std::thread([this] { monitor(); });
+    }
+
+    supervisor(const supervisor&) = delete;
+    supervisor& operator=(const supervisor&) = delete;
+
+    ~supervisor() {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+        std::lock_guard<std::mutex> lock(m_);
+        for (auto& e : entries_) e->slot->retired_.store(true, std::memory_order_relaxed);
+    }
+
+    void supervise(std::string name, policy p, task_t task, stall_fn on_stall = nullptr) {
+        auto e = std::make_unique<entry>();
+        e->name     = std::move(name);
+        e->rules    = p;
+        e->task     = std::move(task);
+        e->on_stall = std::move(on_stall);
+        std::lock_guard<std::mutex> lock(m_);
+        start(*e);
+        entries_.push_back(std::move(e));
+    }
+
+    std::vector<stats> snapshot() const {
+        std::vector<stats> out;
+        std::lock_guard<std::mutex> lock(m_);
+        for (const auto& e : entries_) {
+            stats s;
+            s.name     = e->name;
+            s.beats    = e->beats;
+            s.stalls   = e->stalls;
+            s.restarts  = e->restarts;
+            s.intervals = e->intervals;
+            out.push_back(std::move(s));
+        }
+        return out;
+    }
+
+private:
+    struct entry {
+        std::string                 name;
+        policy                      rules;
+        task_t                      task;
+        stall_fn                    on_stall;
+        std::shared_ptr<heartbeat>  slot;
+        uint64_t                    seen     = 0;
+        clock::time_point           changed;
+        bool                        stalled  = false;
+        uint64_t                    beats    = 0;
+        unsigned                    stalls   = 0;
+        unsigned                    restarts = 0;
+        histogram                   intervals;
+    };
+
+    void start(entry& e) {
+        e.slot    = std::make_shared<heartbeat>();
+        e.seen    = 0;
+        e.changed = clock::now();
+        e.stalled = false;
+        std::string name = e.restarts ? e.name + "#" + std::to_string(e.restarts) : e.name;
+        dispatch_.run(std::move(name), [slot = e.slot, task = e.task](const dispatch::cancel_token& tok) {
+            task(*slot, tok);
+        });
+    }
+
+    void check(entry& e, clock::time_point now) {
+        uint64_t seq = e.slot->seq_.load(std::memory_order_relaxed);
+        if (seq != e.seen) {
+            // Beats landing between two scans share the elapsed time evenly,
+            // so intervals shorter than the poll period are averages.
+            uint64_t n  = seq - e.seen;
+            uint64_t us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - e.changed).count());
+            e.intervals.counts[histogram::bucket(us / n)] += n;
+            e.beats  += n;
+            e.seen    = seq;
+            e.changed = now;
+            e.stalled = false;
+            return;
+        }
+        if (e.stalled || now - e.changed < e.rules.deadline) return;
+
+        e.stalled = true;
+        ++e.stalls;
+        if (e.on_stall) e.on_stall({e.name, now - e.changed, e.restarts});
+        if (e.rules.restart && e.restarts < e.rules.max_restarts) {
+            e.slot->retired_.store(true, std::memory_order_relaxed);
+            ++e.restarts;
+            start(e);
+        }
+    }
+
+    void monitor() {
+        std::unique_lock<std::mutex> lock(m_);
+        while (!stop_) {
+            auto now = clock::now();
+            for (auto& e : entries_) check(*e, now);
+            cv_.wait_for(lock, poll_);
+        }
+    }
+
+    dispatch::dispatch&                 dispatch_;
+    clock::duration                     poll_;
+    mutable std::mutex                  m_;
+    std::condition_variable             cv_;
+    bool                                stop_ = false;
+    std::vector<std::unique_ptr<entry>> entries_;
+    std::thread                         thread_;
+};
+
+};
@@ -0,0 +1,420 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "dispatch/dispatch.h"
+
+namespace timer {
+
+using clock = std::chrono::steady_clock;
+
+struct handle {
+    uint32_t index      = UINT32_MAX;
+    uint32_t generation = 0;
+
+    explicit operator bool() const { return index != UINT32_MAX; }
+};
+
+// Hierarchical timing wheel: four levels of 64 slots over integer ticks.
+// insert/cancel are O(1) (intrusive lists over a recycled node array plus a
+// per-level occupancy bitmap); advance() cascades a coarse slot down only when
+// the finer level wraps. Not thread-safe on its own; service serializes it.
+class wheel {
+public:
+    using callback_t = std::function<void()>;
+
+    static constexpr int      bits   = 6;
+    static constexpr int      slots  = 1 << bits;
+    static constexpr int      levels = 4;
+    static constexpr uint32_t nil    = UINT32_MAX;
+
+    explicit wheel(uint64_t now = 0) : now_(now) {
+        for (auto& h : heads_) h = nil;
+    }
+
+    uint64_t now() const { return now_; }
+    size_t   size() const { return live_; }
+
+    // Schedules cb at tick expiry (clamped to the next tick). period > 0
+    // re-arms the timer every period ticks until cancelled.
+    handle insert(uint64_t expiry, callback_t cb, uint64_t period = 0) {
+        uint32_t i = acquire();
+        node& n  = nodes_[i];
+        n.expiry = expiry > now_ ? expiry : now_ + 1;
+        n.period = period;
+        n.cb     = std::move(cb);
+        link(i);
+        ++live_;
+        return {i, n.generation};
+    }
+
+    bool cancel(handle h) {
+        if (!alive(h)) return false;
+        unlink(h.index);
+        release(h.index);
+        --live_;
+        return true;
+    }
+
+    bool alive(handle h) const {
+        return h.index < nodes_.size() && nodes_[h.index].generation == h.generation
+            && nodes_[h.index].slot >= 0;
+    }
+
+    // Processes every tick in (now, to]; fire(callback_t&) is invoked for each
+    // expired timer in expiry order.
+    template<typename Fire>
+    void advance(uint64_t to, Fire&& fire) {
+        while (now_ < to) {
+            ++now_;
+            for (int l = levels - 1; l > 0; --l) {
+                if ((now_ & ((uint64_t(1) << (bits * l)) - 1)) == 0) {
+                    cascade(l, (now_ >> (bits * l)) & (slots - 1));
+                }
+            }
+            int s = now_ & (slots - 1);
+            while (heads_[s] != nil) {
+                uint32_t i = heads_[s];
+                unlink(i);
+                node& n = nodes_[i];
+                if (n.period) {
+                    callback_t cb = n.cb;
+                    n.expiry = now_ + n.period;
+                    link(i);
+                    fire(cb);
+                } else {
+                    callback_t cb = std::move(n.cb);
+                    release(i);
+                    --live_;
+                    fire(cb);
+                }
+            }
+        }
+    }
+
+    // Earliest tick at which advance() may have work; a lower bound when only
+    // coarse levels are populated (that tick is the next cascade).
+    uint64_t next_event() const {
+        if (live_ == 0) return UINT64_MAX;
+        int from = (now_ + 1) & (slots - 1);
+        uint64_t base = (now_ + 1) & ~uint64_t(slots - 1);
+        if (from != 0) {
+            uint64_t pending = occupied_[0] >> from;
+            if (pending) return base + from + __builtin_ctzll(pending);
+            return base + slots;
+        }
+        return base;
+    }
+
+private:
+    struct node {
+        uint64_t    expiry     = 0;
+        uint64_t    period     = 0;
+        uint32_t    prev       = nil;
+        uint32_t    next       = nil;
+        uint32_t    generation = 0;
+        int32_t     slot       = -1;
+        callback_t  cb;
+    };
+
+    uint32_t acquire() {
+        if (free_ != nil) {
+            uint32_t i = free_;
+            free_ = nodes_[i].next;
+            return i;
+        }
+        nodes_.emplace_back();
+        return static_cast<uint32_t>(nodes_.size() - 1);
+    }
+
+    void release(uint32_t i) {
+        node& n = nodes_[i];
+        n.cb = nullptr;
+        n.slot = -1;
+        ++n.generation;
+        n.next = free_;
+        free_ = i;
+    }
+
+    int slot_for(uint64_t expiry) const {
+        int l = 0;
+        while (l < levels - 1 && (expiry >> (bits * (l + 1))) != (now_ >> (bits * (l + 1)))) ++l;
+        // The top level also takes anything past the wheel's span: its slot
+        // comes round no later than expiry and the cascade re-files it.
+        return l * slots + ((expiry >> (bits * l)) & (slots - 1));
+    }
+
+    void link(uint32_t i) {
+        node& n = nodes_[i];
+        int s  = slot_for(n.expiry);
+        n.slot = s;
+        n.prev = nil;
+        n.next = heads_[s];
+        if (n.next != nil) nodes_[n.next].prev = i;
+        heads_[s] = i;
+        occupied_[s / slots] |= uint64_t(1) << (s % slots);
+    }
+
+    void unlink(uint32_t i) {
+        node& n = nodes_[i];
+        int s = n.slot;
+        if (n.prev != nil) nodes_[n.prev].next = n.next;
+        else               heads_[s] = n.next;
+        if (n.next != nil) nodes_[n.next].prev = n.prev;
+        if (heads_[s] == nil) occupied_[s / slots] &= ~(uint64_t(1) << (s % slots));
+        n.prev = n.next = nil;
+    }
+
+    void cascade(int level, uint64_t idx) {
+        int s = level * slots + static_cast<int>(idx);
+        uint32_t i = heads_[s];
+        heads_[s] = nil;
+        occupied_[level] &= ~(uint64_t(1) << idx);
+        while (i != nil) {
+            uint32_t next = nodes_[i].next;
+            link(i);
+            i = next;
+        }
+    }
+
+    std::vector<node>   nodes_;
+    uint32_t            heads_[levels * slots];
+    uint64_t            occupied_[levels] = {};
+    uint32_t            free_ = nil;
+    uint64_t            now_;
+    size_t              live_ = 0;
+};
+
+// Owns a wheel and a thread that advances it, posting expired callbacks to a
+// dispatch pool. Destroy the service before the dispatch it posts to.
+class service {
+public:
+    using callback_t = wheel::callback_t;
+
+    explicit service(dispatch::dispatch& pool, clock::duration resolution = std::chrono::milliseconds(1))
+        : pool_(pool), resolution_(resolution), epoch_(clock::now()) {
+        thread_ = std::thread([this] { loop(); });
+    }
+
+    service(const service&) = delete;
+    service& operator=(const service&) = delete;
+
+    ~service() {
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    // Whole ticks covering d, rounded up; zero for negative durations (a
+    // time point already past).
+    uint64_t ticks(clock::duration d) const {
+        if (d <= clock::duration::zero()) return 0;
+        return static_cast<uint64_t>((d + resolution_ - clock::duration(1)) / resolution_);
+    }
+
+    uint64_t now() const { return tick_of(clock::now()); }
+
+    // Tick containing t; zero for anything before the service started.
+    uint64_t tick_of(clock::time_point t) const {
+        return t <= epoch_ ? 0 : static_cast<uint64_t>((t - epoch_) / resolution_);
+    }
+
+    handle after(clock::duration d, callback_t cb) {
+        return schedule(now() + std::max<uint64_t>(ticks(d), 1), std::move(cb), 0);
+    }
+
+    handle at(clock::time_point t, callback_t cb) {
+        return after(t - clock::now(), std::move(cb));
+    }
+
+    handle at_tick(uint64_t tick, callback_t cb) {
+        return schedule(tick, std::move(cb), 0);
+    }
+
+    handle every(clock::duration period, callback_t cb) {
+        uint64_t p = std::max<uint64_t>(ticks(period), 1);
+        return schedule(now() + p, std::move(cb), p);
+    }
+
+    bool cancel(handle h) {
+        std::lock_guard<std::mutex> lock(m_);
+        return wheel_.cancel(h);
+    }
+
+private:
+    handle schedule(uint64_t expiry, callback_t cb, uint64_t period) {
+        handle h;
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            h = wheel_.insert(expiry, std::move(cb), period);
+            wake = expiry < planned_;
+        }
+        if (wake) cv_.notify_one();
+        return h;
+    }
+
+    void loop() {
+        std::vector<callback_t> expired;
+        std::unique_lock<std::mutex> lock(m_);
+        while (!stop_) {
+            wheel_.advance(now(), [&expired](callback_t& cb) { expired.push_back(cb); });
+            planned_ = wheel_.next_event();
+            if (!expired.empty()) {
+                lock.unlock();
+                for (auto& cb : expired) {
+                    try {
+                        pool_.post(std::move(cb));
+                    } catch (const std::logic_error&) {
+                        // Pool already shut down; nothing left to run it on.
+                    }
+                }
+                expired.clear();
+                lock.lock();
+                continue;
+            }
+            if (planned_ == UINT64_MAX) {
+                cv_.wait(lock);
+            } else {
+                cv_.wait_until(lock, epoch_ + planned_ * resolution_);
+            }
+        }
+    }
+
+    dispatch::dispatch&     pool_;
+    clock::duration         resolution_;
+    clock::time_point       epoch_;
+    wheel                   wheel_;
+    uint64_t                planned_ = UINT64_MAX;
+    bool                    stop_ = false;
+    std::mutex              m_;
+    std::condition_variable cv_;
+    std::thread             thread_;
+};
+
+namespace detail {
+
+// Shared machinery for watchdog and debouncer: kick() is one monotonic clock
+// read (vDSO, no syscall) and a relaxed store of the raw count, with no
+// division or lock; the timer converts it to ticks, polls at most once per
+// timeout and only fires once per quiet period.
+class quiet_period {
+public:
+    void kick() { st_->last.store(clock::now().time_since_epoch().count(), std::memory_order_relaxed); }
+
+protected:
+    quiet_period(service& svc, clock::duration timeout, std::function<void()> on_quiet, bool fire_unkicked)
+        : st_(std::make_shared<state>(svc, std::max<uint64_t>(svc.ticks(timeout), 1), std::move(on_quiet))) {
+        clock::time_point t = clock::now();
+        st_->last.store(t.time_since_epoch().count(), std::memory_order_relaxed);
+        st_->fired = fire_unkicked ? std::numeric_limits<clock::rep>::min() : t.time_since_epoch().count();
+        arm(st_, svc.tick_of(t) + st_->timeout);
+    }
+
+    ~quiet_period() {
+        std::lock_guard<std::mutex> lock(st_->m);
+        st_->stopped = true;
+        st_->svc.cancel(st_->pending);
+    }
+
+    quiet_period(const quiet_period&) = delete;
+    quiet_period& operator=(const quiet_period&) = delete;
+
+private:
+    struct state {
+        state(service& s, uint64_t t, std::function<void()> f) : svc(s), timeout(t), on_quiet(std::move(f)) {}
+
+        service&                svc;
+        uint64_t                timeout;
+        std::function<void()>   on_quiet;
+        std::atomic<clock::rep> last{0};       // clock count of the latest kick
+        clock::rep              fired = 0;
+        bool                    stopped = false;
+        std::mutex              m;
+        handle                  pending;
+    };
+
+    static void arm(const std::shared_ptr<state>& st, uint64_t tick) {
+        std::lock_guard<std::mutex> lock(st->m);
+        if (st->stopped) return;
+        st->pending = st->svc.at_tick(tick, [w = std::weak_ptr<state>(st)] { poll(w); });
+    }
+
+    static void poll(const std::weak_ptr<state>& w) {
+        auto st = w.lock();
+        if (!st) return;
+        clock::rep raw  = st->last.load(std::memory_order_relaxed);
+        uint64_t   last = st->svc.tick_of(clock::time_point(clock::duration(raw)));
+        uint64_t   now  = st->svc.now();
+        // A kick racing this poll can land on or after now; that is not quiet.
+        if (last < now && now - last >= st->timeout) {
+            if (raw != st->fired) {
+                // Under m so the destructor, once it has returned, can no
+                // longer be overtaken by a poll already on the pool. on_quiet
+                // must therefore not destroy its own watchdog.
+                std::lock_guard<std::mutex> lock(st->m);
+                if (st->stopped) return;
+                st->fired = raw;
+                st->on_quiet();
+            }
+            arm(st, now + st->timeout);
+        } else {
+            arm(st, last + st->timeout);
+        }
+    }
+
+    std::shared_ptr<state> st_;
+};
+
+};
+
+// Fires on_timeout once each time kick() has not been called for timeout,
+// including when it was never kicked at all.
+class watchdog : public detail::quiet_period {
+public:
+    watchdog(service& svc, clock::duration timeout, std::function<void()> on_timeout)
+        : quiet_period(svc, timeout, std::move(on_timeout), true) {}
+};
+
+// Fires on_settled once a burst of kick() calls has been quiet for period.
+class debouncer : public detail::quiet_period {
+public:
+    debouncer(service& svc, clock::duration period, std::function<void()> on_settled)
+        : quiet_period(svc, period, std::move(on_settled), false) {}
+};
+
+// Admits at most one caller per interval. try_acquire() is one atomic
+// exchange; a timer reopens the gate, so nothing reads the clock per call.
+class rate_limiter {
+public:
+    rate_limiter(service& svc, clock::duration interval)
+        : svc_(svc), interval_(interval), open_(std::make_shared<std::atomic<bool>>(true)) {}
+
+    bool try_acquire() {
+        if (!open_->exchange(false, std::memory_order_acquire)) return false;
+        svc_.after(interval_, [open = std::weak_ptr<std::atomic<bool>>(open_)] {
+            if (auto o = open.lock()) o->store(true, std::memory_order_release);
+        });
+        return true;
+    }
+
+private:
+    service&                            svc_;
+    clock::duration                     interval_;
+    std::shared_ptr<std::atomic<bool>>  open_;
+};
+
+};
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <vector>
+
+#include "dispatch/dispatch.h"
+#include "frame/frame.h"
+
+namespace vision {
+
+// Letterbox preprocessing for the detector in a single pass: bilinear resize
+// (OpenCV INTER_LINEAR sampling), constant padding, channel swap and the
+// conversion to the tensor's element type are fused, so each output pixel is
+// written exactly once, straight into the inference input buffer. Output
+// rows are split into bands that run on a dispatch pool.
+
+enum class element { u8, i8, f32 };
+
+enum class order { rgb, bgr };
+
+struct tensor_spec {
+    uint32_t    width   = 640;
+    uint32_t    height  = 640;
+    element     type    = element::u8;
+    order       out     = order::rgb;
+    bool        planar  = false;            // NCHW instead of NHWC
+    uint8_t     pad     = 0;                // border pixel value, before conversion
+
+    // i8 and f32: value = pixel * norm, then i8 quantizes
+    // q = round(value / qscale) + zero_point, saturated.
+    float       norm        = 1.0f / 255.0f;
+    float       qscale      = 1.0f / 255.0f;
+    int32_t     zero_point  = -128;
+
+    size_t element_size() const { return type == element::f32 ? 4 : 1; }
+    size_t bytes() const { return size_t(width) * height * 3 * element_size(); }
+};
+
+// Source image: packed 3-channel pixels in BGR or RGB order.
+struct image {
+    const uint8_t*  data   = nullptr;
+    uint32_t        width  = 0;
+    uint32_t        height = 0;
+    size_t          stride = 0;     // bytes per row, 0 = width * 3
+    order           in     = order::bgr;
+};
+
+// Where the source landed in the tensor. Maps detections back with
+// x_src = (x_tensor - pad_x) / scale.
+struct geometry {
+    float       scale  = 1.0f;
+    uint32_t    pad_x  = 0;
+    uint32_t    pad_y  = 0;
+    uint32_t    width  = 0;     // scaled source size inside the tensor
+    uint32_t    height = 0;
+    uint32_t    source_width  = 0;
+    uint32_t    source_height = 0;
+
+    float to_source_x(float x) const { return (x - float(pad_x)) / scale; }
+    float to_source_y(float y) const { return (y - float(pad_y)) / scale; }
+};
+
+inline geometry fit(uint32_t src_w, uint32_t src_h, uint32_t dst_w, uint32_t dst_h) {
+    geometry g;
+    g.source_width  = src_w;
+    g.source_height = src_h;
+    if (!src_w || !src_h) return g;
+    g.scale  = std::min(float(dst_w) / float(src_w), float(dst_h) / float(src_h));
+    g.width  = std::min(dst_w, static_cast<uint32_t>(float(src_w) * g.scale));
+    g.height = std::min(dst_h, static_cast<uint32_t>(float(src_h) * g.scale));
+    g.pad_x  = (dst_w - g.width) / 2;
+    g.pad_y  = (dst_h - g.height) / 2;
+    return g;
+}
+
+namespace detail {
+
+// Bilinear weights in 11-bit fixed point, like OpenCV's INTER_LINEAR.
+constexpr int weight_bits = 11;
+constexpr int weight_one  = 1 << weight_bits;
+
+struct taps {
+    std::vector<uint32_t>   index;      // first source sample (pixel, not byte)
+    std::vector<int16_t>    weight;     // weight of index + 1
+};
+
+inline taps sample(uint32_t src, uint32_t dst) {
+    taps t;
+    t.index.resize(dst);
+    t.weight.resize(dst);
+    double ratio = double(src) / double(dst);
+    for (uint32_t i = 0; i < dst; ++i) {
+        double s  = (i + 0.5) * ratio - 0.5;
+        int32_t k = static_cast<int32_t>(std::floor(s));
+        double f  = s - k;
+        if (k < 0) k = 0, f = 0.0;
+        if (k >= int32_t(src) - 1) k = int32_t(src) - 1, f = 0.0;
+        t.index[i]  = static_cast<uint32_t>(k);
+        t.weight[i] = static_cast<int16_t>(std::lround(f * weight_one));
+    }
+    return t;
+}
+
+};
+
+class letterbox {
+public:
+    explicit letterbox(const tensor_spec& spec = {}) : spec_(spec) {
+        if (spec_.type != element::u8) {
+            for (int v = 0; v < 256; ++v) {
+                float x = float(v) * spec_.norm;
+                if (spec_.type == element::f32) {
+                    f32_[v] = x;
+                } else {
+                    long q = std::lround(x / spec_.qscale) + spec_.zero_point;
+                    i8_[v] = static_cast<int8_t>(std::clamp<long>(q, -128, 127));
+                }
+            }
+        }
+    }
+
+    const tensor_spec& spec() const { return spec_; }
+
+    // Fills out (spec().bytes()) from src. Returns the placement for mapping
+    // results back to the source.
+    geometry run(const image& src, void* out, dispatch::dispatch* pool = nullptr) {
+        geometry g = fit(src.width, src.height, spec_.width, spec_.height);
+        if (!src.data || !g.width || !g.height) return g;
+        prepare(src, g);
+
+        size_t stride = src.stride ? src.stride : size_t(src.width) * 3;
+        bool swap = src.in != spec_.out;
+        bool direct = spec_.type == element::u8 && !spec_.planar;
+        size_t bands = pool ? std::min<size_t>(spec_.height / 32 + 1, pool->workers() + 1) : 1;
+        dispatch::parallel_for(pool, bands, [&](size_t b) {
+            uint32_t r0 = static_cast<uint32_t>(spec_.height * b / bands);
+            uint32_t r1 = static_cast<uint32_t>(spec_.height * (b + 1) / bands);
+            size_t row_bytes = size_t(spec_.width) * 3;
+            if (direct) {
+                // Packed u8 is already the tensor format: resample in place.
+                for (uint32_t y = r0; y < r1; ++y) fill_row(src, stride, g, swap, y, static_cast<uint8_t*>(out) + y * row_bytes);
+                return;
+            }
+            // Staging row on the worker's frame arena; no malloc per band.
+            dispatch::scratch tmp;
+            std::pmr::vector<uint8_t> row(row_bytes, &tmp.resource());
+            for (uint32_t y = r0; y < r1; ++y) {
+                fill_row(src, stride, g, swap, y, row.data());
+                store(row.data(), y, out);
+            }
+        });
+        return g;
+    }
+
+    // Letterboxes a BGR/RGB frame from the frame pool.
+    geometry run(const frame::frame& in, void* out, dispatch::dispatch* pool = nullptr) {
+        if (!in) return {};
+        const frame::format& l = in.layout();
+        if (l.fourcc != frame::bgr24 && l.fourcc != frame::rgb24) return {};
+        return run(image{in.data(), l.width, l.height, l.stride, l.fourcc == frame::rgb24 ? order::rgb : order::bgr}, out, pool);
+    }
+
+private:
+    // Sampling tables depend only on the source size; camera streams keep it.
+    void prepare(const image& src, const geometry& g) {
+        if (src.width == src_w_ && src.height == src_h_) return;
+        xs_ = detail::sample(src.width, g.width);
+        ys_ = detail::sample(src.height, g.height);
+        src_w_ = src.width;
+        src_h_ = src.height;
+    }
+
+    // One packed output row in the tensor's channel order, before conversion.
+    void fill_row(const image& src, size_t stride, const geometry& g, bool swap, uint32_t y, uint8_t* row) const {
+        const uint8_t pad = spec_.pad;
+        if (y < g.pad_y || y >= g.pad_y + g.height) {
+            std::memset(row, pad, size_t(spec_.width) * 3);
+            return;
+        }
+        std::memset(row, pad, size_t(g.pad_x) * 3);
+        uint32_t x_end = g.pad_x + g.width;
+        std::memset(row + size_t(x_end) * 3, pad, size_t(spec_.width - x_end) * 3);
+
+        uint32_t sy = y - g.pad_y;
+        const uint8_t* top = src.data + size_t(ys_.index[sy]) * stride;
+        const uint8_t* bot = ys_.index[sy] + 1 < src.height ? top + stride : top;
+        int32_t wy = ys_.weight[sy];
+        uint8_t* dst = row + size_t(g.pad_x) * 3;
+        const int c0 = swap ? 2 : 0, c2 = swap ? 0 : 2;
+        constexpr int shift = 2 * detail::weight_bits;
+        constexpr int32_t half = 1 << (shift - 1);
+        for (uint32_t x = 0; x < g.width; ++x) {
+            size_t i0 = size_t(xs_.index[x]) * 3;
+            size_t i1 = xs_.index[x] + 1 < src.width ? i0 + 3 : i0;
+            int32_t wx = xs_.weight[x];
+            int32_t a00 = (detail::weight_one - wx) * (detail::weight_one - wy);
+            int32_t a01 = wx * (detail::weight_one - wy);
+            int32_t a10 = (detail::weight_one - wx) * wy;
+            int32_t a11 = wx * wy;
+            int32_t v[3];
+            for (int c = 0; c < 3; ++c) {
+                v[c] = (top[i0 + c] * a00 + top[i1 + c] * a01 + bot[i0 + c] * a10 + bot[i1 + c] * a11 + half) >> shift;
+            }
+            dst[3 * x]     = static_cast<uint8_t>(v[c0]);
+            dst[3 * x + 1] = static_cast<uint8_t>(v[1]);
+            dst[3 * x + 2] = static_cast<uint8_t>(v[c2]);
+        }
+    }
+
+    // Writes one packed row into tensor row y, converting element type and
+    // layout (packed u8 never gets here). Conversions are table lookups.
+    void store(const uint8_t* row, uint32_t y, void* out) const {
+        size_t w = spec_.width;
+        size_t plane = w * spec_.height;
+        if (!spec_.planar) {
+            size_t n = w * 3, at = size_t(y) * n;
+            if (spec_.type == element::i8) {
+                int8_t* dst = static_cast<int8_t*>(out) + at;
+                for (size_t i = 0; i < n; ++i) dst[i] = i8_[row[i]];
+            } else {
+                float* dst = static_cast<float*>(out) + at;
+                for (size_t i = 0; i < n; ++i) dst[i] = f32_[row[i]];
+            }
+            return;
+        }
+        for (size_t c = 0; c < 3; ++c) {
+            size_t at = c * plane + size_t(y) * w;
+            switch (spec_.type) {
+            case element::u8: {
+                uint8_t* dst = static_cast<uint8_t*>(out) + at;
+                for (size_t x = 0; x < w; ++x) dst[x] = row[3 * x + c];
+                break;
+            }
+            case element::i8: {
+                int8_t* dst = static_cast<int8_t*>(out) + at;
+                for (size_t x = 0; x < w; ++x) dst[x] = i8_[row[3 * x + c]];
+                break;
+            }
+            case element::f32: {
+                float* dst = static_cast<float*>(out) + at;
+                for (size_t x = 0; x < w; ++x) dst[x] = f32_[row[3 * x + c]];
+                break;
+            }
+            }
+        }
+    }
+
+    tensor_spec         spec_;
+    int8_t              i8_[256]  = {};
+    float               f32_[256] = {};
+    detail::taps        xs_, ys_;
+    uint32_t            src_w_ = 0, src_h_ = 0;
+};
+
+};
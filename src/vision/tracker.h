@@ -0,0 +1,376 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "schema/messages.h"
+#include "vision/yolo.h"
+
+namespace vision {
+
+// Multi-object tracker for detector output with persistent ids.
+//
+// Each track runs a constant-velocity Kalman filter on its box centre and
+// size. With a position-only measurement the four axes are independent, so
+// a track is four two-state filters, and all tracks live in fixed-capacity
+// structure-of-arrays storage that is kept dense: every per-track loop is a
+// straight pass over contiguous floats, and the tracker never allocates
+// after construction.
+//
+// Filter state only advances when detections arrive (at their capture
+// time). Between inferences, predict() extrapolates every track to any
+// time without touching the filters, so the servo loop can run at camera
+// rate on smooth predicted positions.
+
+enum class assignment { greedy, optimal };
+
+struct tracker_options {
+    assignment  match            = assignment::greedy;
+    float       min_iou          = 0.2f;
+    uint32_t    confirm_hits     = 3;           // hits before a track is reported
+    uint64_t    max_age_ns       = 1000000000;  // confirmed tracks survive this long unseen
+    float       measurement_std  = 4.0f;        // pixels
+    float       accel_std        = 400.0f;      // pixels / s^2, process noise
+    float       initial_vel_std  = 200.0f;      // pixels / s
+    bool        class_aware      = true;        // only match detections of the same class
+};
+
+struct track {
+    uint32_t    id        = 0;
+    uint32_t    class_id  = 0;
+    float       cx = 0, cy = 0, w = 0, h = 0;   // source pixels
+    float       vx = 0, vy = 0;                 // pixels / s
+    float       score     = 0;                  // last matched detection
+    uint32_t    hits      = 0;
+    bool        confirmed = false;
+    uint64_t    seen_ns   = 0;                  // last matched detection time
+};
+
+template<size_t Capacity = 64>
+class tracker {
+public:
+    static constexpr size_t capacity = Capacity;
+
+    explicit tracker(tracker_options o = {}) : opt_(o) {}
+
+    size_t size() const { return n_; }
+
+    // Matches one frame's detections (captured at t_ns) to the tracks,
+    // corrects the matched ones, starts tracks for the rest and retires
+    // tracks that have gone unseen.
+    void update(const std::vector<detection>& dets, uint64_t t_ns) {
+        advance(t_ns);
+        size_t m = std::min(dets.size(), Capacity);
+        associate(dets, m);
+
+        for (size_t i = 0; i < n_; ++i) {
+            int32_t d = track_match_[i];
+            if (d < 0) {
+                miss_[i] = 1;
+                continue;
+            }
+            const detection& det = dets[static_cast<size_t>(d)];
+            float z[4] = {0.5f * (det.x1 + det.x2), 0.5f * (det.y1 + det.y2), det.x2 - det.x1, det.y2 - det.y1};
+            for (size_t a = 0; a < 4; ++a) correct(a, i, z[a]);
+            score_[i] = det.score;
+            seen_[i]  = t_ns;
+            ++hits_[i];
+            miss_[i] = 0;
+        }
+
+        // Tentative tracks die on their first miss; confirmed ones on age.
+        for (size_t i = 0; i < n_;) {
+            bool confirmed = hits_[i] >= opt_.confirm_hits;
+            bool dead = miss_[i] && (!confirmed || t_ns - seen_[i] > opt_.max_age_ns);
+            if (dead) {
+                remove(i);
+            } else {
+                ++i;
+            }
+        }
+
+        for (size_t d = 0; d < m && n_ < Capacity; ++d) {
+            if (det_match_[d] < 0) spawn(dets[d], t_ns);
+        }
+    }
+
+    // Confirmed tracks extrapolated to t_ns; returns how many were written.
+    size_t predict(uint64_t t_ns, track* out, size_t max) const {
+        size_t k = 0;
+        for (size_t i = 0; i < n_ && k < max; ++i) {
+            if (hits_[i] < opt_.confirm_hits) continue;
+            out[k++] = at(i, t_ns);
+        }
+        return k;
+    }
+
+    void predict(uint64_t t_ns, schema::track_list& out) const {
+        out.timestamp_ns = t_ns;
+        out.count = 0;
+        for (size_t i = 0; i < n_; ++i) {
+            if (hits_[i] < opt_.confirm_hits) continue;
+            track t = at(i, t_ns);
+            schema::track s;
+            s.id       = t.id;
+            s.class_id = static_cast<int32_t>(t.class_id);
+            s.bbox     = {t.cx - 0.5f * t.w, t.cy - 0.5f * t.h, t.cx + 0.5f * t.w, t.cy + 0.5f * t.h};
+            s.vx       = t.vx;
+            s.vy       = t.vy;
+            s.score    = t.score;
+            if (!out.push(s)) break;
+        }
+    }
+
+    // The track the servo should follow at t_ns: the previous lead while it
+    // is still alive, otherwise the confirmed track seen most often. Sticking
+    // to one id is what keeps commands from flapping between targets.
+    bool lead(uint64_t t_ns, track& out) {
+        size_t best = n_;
+        for (size_t i = 0; i < n_; ++i) {
+            if (hits_[i] < opt_.confirm_hits) continue;
+            if (id_[i] == lead_) {
+                best = i;
+                break;
+            }
+            if (best == n_ || hits_[i] > hits_[best]) best = i;
+        }
+        if (best == n_) return false;
+        lead_ = id_[best];
+        out = at(best, t_ns);
+        return true;
+    }
+
+private:
+    enum axis_t { x, y, w, h };
+
+    // All filters share one state time; they move forward together.
+    void advance(uint64_t t_ns) {
+        if (t_ns <= t_ns_) return;
+        float dt = float(t_ns - t_ns_) * 1e-9f;
+        t_ns_ = t_ns;
+        if (n_ == 0) return;
+        float q = opt_.accel_std * opt_.accel_std;
+        float q00 = 0.25f * dt * dt * dt * dt * q, q01 = 0.5f * dt * dt * dt * q, q11 = dt * dt * q;
+        for (size_t a = 0; a < 4; ++a) {
+            float* p = pos_[a].data();
+            float* v = vel_[a].data();
+            float* P00 = p00_[a].data();
+            float* P01 = p01_[a].data();
+            float* P11 = p11_[a].data();
+            for (size_t i = 0; i < n_; ++i) {
+                p[i]   += v[i] * dt;
+                P00[i] += dt * (2.0f * P01[i] + dt * P11[i]) + q00;
+                P01[i] += dt * P11[i] + q01;
+                P11[i] += q11;
+            }
+        }
+        for (size_t i = 0; i < n_; ++i) {
+            pos_[w][i] = std::max(pos_[w][i], 1.0f);
+            pos_[h][i] = std::max(pos_[h][i], 1.0f);
+        }
+    }
+
+    void correct(size_t a, size_t i, float z) {
+        float r = opt_.measurement_std * opt_.measurement_std;
+        float P00 = p00_[a][i], P01 = p01_[a][i], P11 = p11_[a][i];
+        float s = P00 + r;
+        float k0 = P00 / s, k1 = P01 / s;
+        float e = z - pos_[a][i];
+        pos_[a][i] += k0 * e;
+        vel_[a][i] += k1 * e;
+        p00_[a][i] = (1.0f - k0) * P00;
+        p01_[a][i] = (1.0f - k0) * P01;
+        p11_[a][i] = P11 - k1 * P01;
+    }
+
+    track at(size_t i, uint64_t t_ns) const {
+        float dt = t_ns > t_ns_ ? float(t_ns - t_ns_) * 1e-9f : 0.0f;
+        track t;
+        t.id        = id_[i];
+        t.class_id  = class_[i];
+        t.cx        = pos_[x][i] + vel_[x][i] * dt;
+        t.cy        = pos_[y][i] + vel_[y][i] * dt;
+        t.w         = std::max(pos_[w][i] + vel_[w][i] * dt, 1.0f);
+        t.h         = std::max(pos_[h][i] + vel_[h][i] * dt, 1.0f);
+        t.vx        = vel_[x][i];
+        t.vy        = vel_[y][i];
+        t.score     = score_[i];
+        t.hits      = hits_[i];
+        t.confirmed = hits_[i] >= opt_.confirm_hits;
+        t.seen_ns   = seen_[i];
+        return t;
+    }
+
+    float iou(size_t i, const detection& d) const {
+        float tx1 = pos_[x][i] - 0.5f * pos_[w][i], tx2 = pos_[x][i] + 0.5f * pos_[w][i];
+        float ty1 = pos_[y][i] - 0.5f * pos_[h][i], ty2 = pos_[y][i] + 0.5f * pos_[h][i];
+        float iw = std::min(tx2, d.x2) - std::max(tx1, d.x1);
+        float ih = std::min(ty2, d.y2) - std::max(ty1, d.y1);
+        if (iw <= 0 || ih <= 0) return 0.0f;
+        float inter = iw * ih;
+        return inter / (pos_[w][i] * pos_[h][i] + (d.x2 - d.x1) * (d.y2 - d.y1) - inter);
+    }
+
+    // Fills track_match_ / det_match_ (-1 = unmatched) from IoU with the
+    // predicted boxes; pairs below min_iou or of different classes never match.
+    void associate(const std::vector<detection>& dets, size_t m) {
+        std::fill(track_match_.begin(), track_match_.begin() + n_, -1);
+        std::fill(det_match_.begin(), det_match_.begin() + m, -1);
+        if (n_ == 0 || m == 0) return;
+        for (size_t i = 0; i < n_; ++i) {
+            for (size_t d = 0; d < m; ++d) {
+                bool same = !opt_.class_aware || dets[d].class_id == class_[i];
+                float v = same ? iou(i, dets[d]) : 0.0f;
+                iou_[i * Capacity + d] = v >= opt_.min_iou ? v : 0.0f;
+            }
+        }
+        if (opt_.match == assignment::optimal) {
+            hungarian(m);
+        } else {
+            greedy(m);
+        }
+        // The optimal assignment may pair through zero-IoU cells.
+        for (size_t i = 0; i < n_; ++i) {
+            int32_t d = track_match_[i];
+            if (d >= 0 && iou_[i * Capacity + size_t(d)] <= 0.0f) {
+                det_match_[static_cast<size_t>(d)] = -1;
+                track_match_[i] = -1;
+            }
+        }
+    }
+
+    void greedy(size_t m) {
+        size_t k = 0;
+        for (size_t i = 0; i < n_; ++i) {
+            for (size_t d = 0; d < m; ++d) {
+                if (iou_[i * Capacity + d] > 0.0f) pairs_[k++] = static_cast<uint32_t>(i * Capacity + d);
+            }
+        }
+        std::sort(pairs_.begin(), pairs_.begin() + k, [this](uint32_t a, uint32_t b) { return iou_[a] > iou_[b]; });
+        for (size_t p = 0; p < k; ++p) {
+            size_t i = pairs_[p] / Capacity, d = pairs_[p] % Capacity;
+            if (track_match_[i] >= 0 || det_match_[d] >= 0) continue;
+            track_match_[i] = static_cast<int32_t>(d);
+            det_match_[d]   = static_cast<int32_t>(i);
+        }
+    }
+
+    // Minimum-cost assignment on cost = 1 - IoU (Kuhn-Munkres with
+    // potentials, O(n^2 m)), rows being the smaller side.
+    void hungarian(size_t m) {
+        bool rows_are_tracks = n_ <= m;
+        size_t rows = rows_are_tracks ? n_ : m, cols = rows_are_tracks ? m : n_;
+        auto cost = [&](size_t r, size_t c) {
+            size_t i = rows_are_tracks ? r : c, d = rows_are_tracks ? c : r;
+            return 1.0f - iou_[i * Capacity + d];
+        };
+        const float inf = std::numeric_limits<float>::max();
+        std::fill(u_.begin(), u_.begin() + rows + 1, 0.0f);
+        std::fill(v_.begin(), v_.begin() + cols + 1, 0.0f);
+        std::fill(col_row_.begin(), col_row_.begin() + cols + 1, 0);
+        for (size_t r = 1; r <= rows; ++r) {
+            col_row_[0] = static_cast<uint32_t>(r);
+            size_t c0 = 0;
+            std::fill(minv_.begin(), minv_.begin() + cols + 1, inf);
+            std::fill(used_.begin(), used_.begin() + cols + 1, false);
+            do {
+                used_[c0] = true;
+                size_t r0 = col_row_[c0], c1 = 0;
+                float delta = inf;
+                for (size_t c = 1; c <= cols; ++c) {
+                    if (used_[c]) continue;
+                    float cur = cost(r0 - 1, c - 1) - u_[r0] - v_[c];
+                    if (cur < minv_[c]) minv_[c] = cur, way_[c] = static_cast<uint32_t>(c0);
+                    if (minv_[c] < delta) delta = minv_[c], c1 = c;
+                }
+                for (size_t c = 0; c <= cols; ++c) {
+                    if (used_[c]) {
+                        u_[col_row_[c]] += delta;
+                        v_[c] -= delta;
+                    } else {
+                        minv_[c] -= delta;
+                    }
+                }
+                c0 = c1;
+            } while (col_row_[c0] != 0);
+            do {
+                size_t c1 = way_[c0];
+                col_row_[c0] = col_row_[c1];
+                c0 = c1;
+            } while (c0);
+        }
+        for (size_t c = 1; c <= cols; ++c) {
+            if (!col_row_[c]) continue;
+            size_t r = col_row_[c] - 1;
+            size_t i = rows_are_tracks ? r : c - 1, d = rows_are_tracks ? c - 1 : r;
+            track_match_[i] = static_cast<int32_t>(d);
+            det_match_[d]   = static_cast<int32_t>(i);
+        }
+    }
+
+    void spawn(const detection& d, uint64_t t_ns) {
+        size_t i = n_++;
+        float z[4] = {0.5f * (d.x1 + d.x2), 0.5f * (d.y1 + d.y2), d.x2 - d.x1, d.y2 - d.y1};
+        float r = opt_.measurement_std * opt_.measurement_std;
+        float vv = opt_.initial_vel_std * opt_.initial_vel_std;
+        for (size_t a = 0; a < 4; ++a) {
+            pos_[a][i] = z[a];
+            vel_[a][i] = 0.0f;
+            p00_[a][i] = r;
+            p01_[a][i] = 0.0f;
+            p11_[a][i] = vv;
+        }
+        id_[i]    = next_id_++;
+        class_[i] = d.class_id;
+        score_[i] = d.score;
+        hits_[i]  = 1;
+        miss_[i]  = 0;
+        seen_[i]  = t_ns;
+    }
+
+    // Swap-remove keeps the arrays dense.
+    void remove(size_t i) {
+        size_t last = --n_;
+        for (size_t a = 0; a < 4; ++a) {
+            pos_[a][i] = pos_[a][last];
+            vel_[a][i] = vel_[a][last];
+            p00_[a][i] = p00_[a][last];
+            p01_[a][i] = p01_[a][last];
+            p11_[a][i] = p11_[a][last];
+        }
+        id_[i]    = id_[last];
+        class_[i] = class_[last];
+        score_[i] = score_[last];
+        hits_[i]  = hits_[last];
+        miss_[i]  = miss_[last];
+        seen_[i]  = seen_[last];
+    }
+
+    using lane = std::array<float, Capacity>;
+
+    tracker_options                         opt_;
+    size_t                                  n_       = 0;
+    uint64_t                                t_ns_    = 0;
+    uint32_t                                next_id_ = 1;
+    uint32_t                                lead_    = 0;
+
+    std::array<lane, 4>                     pos_{}, vel_{}, p00_{}, p01_{}, p11_{};
+    std::array<uint32_t, Capacity>          id_{}, class_{}, hits_{};
+    std::array<uint8_t, Capacity>           miss_{};
+    std::array<float, Capacity>             score_{};
+    std::array<uint64_t, Capacity>          seen_{};
+
+    // Association scratch.
+    std::array<float, Capacity * Capacity>      iou_{};
+    std::array<uint32_t, Capacity * Capacity>   pairs_{};
+    std::array<int32_t, Capacity>               track_match_{}, det_match_{};
+    std::array<float, Capacity + 1>             u_{}, v_{}, minv_{};
+    std::array<uint32_t, Capacity + 1>          col_row_{}, way_{};
+    std::array<bool, Capacity + 1>              used_{};
+};
+
+};
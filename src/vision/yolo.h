@@ -0,0 +1,263 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "vision/letterbox.h"
+
+namespace vision {
+
+// YOLOv5 head decoding and class-aware NMS for the detector outputs.
+//
+// Each head is the raw [3 * (5 + classes), grid_h, grid_w] tensor, so one
+// anchor's objectness logits are a contiguous plane. Sigmoid is monotonic,
+// which lets the objectness test run on the logits (or on the quantized
+// values for i8 heads) a block at a time; only cells that pass are ever
+// dequantized, passed through a sigmoid or decoded. The class is the argmax
+// of the raw logits, so one sigmoid covers it.
+//
+// Boxes decode as playground/vision/simpleOrangePiNpuYolo.py does for the
+// deployed RKNN model: sigmoid on x/y, raw w/h into (2w)^2 * anchor, and a
+// person (class 0) box is dropped when its aspect ratio leaves [0.2, 3].
+// sigmoid_wh selects the stock YOLOv5 decode, which sigmoids w/h as well.
+//
+// NMS is greedy in score order without a comparison sort: candidates are
+// counting-sorted into score bins, and each is only tested against boxes
+// already kept in the grid cells it covers.
+
+struct detection {
+    float       x1 = 0, y1 = 0, x2 = 0, y2 = 0;     // source pixels
+    float       score    = 0;                       // objectness * class
+    uint32_t    class_id = 0;
+};
+
+// One raw output head. i8 heads dequantize as (q - zero_point) * scale.
+// Heads whose channel count is not 3 * (5 + classes) are skipped.
+struct head_tensor {
+    const void* data        = nullptr;
+    uint32_t    channels    = 0;
+    uint32_t    grid_w      = 0;
+    uint32_t    grid_h      = 0;
+    element     type        = element::f32;         // f32 or i8
+    float       scale       = 1.0f;
+    int32_t     zero_point  = 0;
+};
+
+struct yolo_options {
+    uint32_t                classes         = 80;
+    float                   score_threshold = 0.45f;    // objectness, then objectness * class
+    float                   nms_threshold   = 0.45f;    // IoU
+    float                   min_size        = 5.0f;     // boxes narrower or shorter are dropped
+    size_t                  max_candidates  = 1024;
+    bool                    sigmoid_wh      = false;    // stock YOLOv5 w/h decode
+    int32_t                 aspect_class    = 0;        // class held to the aspect range, -1 = none
+    float                   min_aspect      = 0.2f;     // width / height
+    float                   max_aspect      = 3.0f;
+    std::vector<uint32_t>   keep;                       // class ids to report, empty = all
+    uint32_t                strides[3]      = {8, 16, 32};
+    float                   anchors[3][3][2] = {
+        {{10, 13}, {16, 30}, {33, 23}},
+        {{30, 61}, {62, 45}, {59, 119}},
+        {{116, 90}, {156, 198}, {373, 326}},
+    };
+};
+
+namespace detail {
+
+inline float sigmoid(float x) { return 1.0f / (1.0f + std::exp(-x)); }
+
+// Calls hit(i) for every i with v[i] > threshold. Blocks are rejected on
+// their maximum, a branch-free reduction the compiler vectorizes; nearly
+// every block of an objectness plane is background.
+template<typename T, typename U, typename F>
+void scan_above(const T* v, size_t n, U threshold, F&& hit) {
+    constexpr size_t block = 32;
+    size_t i = 0;
+    for (; i + block <= n; i += block) {
+        T m = v[i];
+        for (size_t k = 1; k < block; ++k) m = v[i + k] > m ? v[i + k] : m;
+        if (m <= threshold) continue;
+        for (size_t k = 0; k < block; ++k) {
+            if (v[i + k] > threshold) hit(i + k);
+        }
+    }
+    for (; i < n; ++i) {
+        if (v[i] > threshold) hit(i);
+    }
+}
+
+inline float iou(const detection& a, const detection& b) {
+    float w = std::min(a.x2, b.x2) - std::max(a.x1, b.x1);
+    float h = std::min(a.y2, b.y2) - std::max(a.y1, b.y1);
+    if (w <= 0 || h <= 0) return 0.0f;
+    float inter = w * h;
+    float uni = (a.x2 - a.x1) * (a.y2 - a.y1) + (b.x2 - b.x1) * (b.y2 - b.y1) - inter;
+    return uni > 0 ? inter / uni : 0.0f;
+}
+
+};
+
+class yolo_decoder {
+public:
+    explicit yolo_decoder(yolo_options o = {}) : opt_(std::move(o)) {
+        float t = std::clamp(opt_.score_threshold, 1e-6f, 1.0f - 1e-6f);
+        logit_ = std::log(t / (1.0f - t));
+        keep_.assign(opt_.classes, opt_.keep.empty() ? 1 : 0);
+        for (uint32_t c : opt_.keep) {
+            if (c < opt_.classes) keep_[c] = 1;
+        }
+    }
+
+    const yolo_options& options() const { return opt_; }
+
+    // Decodes up to three heads (strides 8, 16, 32) into detections in source
+    // pixels. The result is reused by the next call.
+    const std::vector<detection>& run(const head_tensor* heads, size_t count, const geometry& g) {
+        candidates_.clear();
+        for (size_t h = 0; h < count && h < 3; ++h) {
+            if (!heads[h].data || heads[h].channels != 3 * (5 + opt_.classes)) continue;
+            if (heads[h].type == element::i8) {
+                decode_head<int8_t>(heads[h], h, g);
+            } else {
+                decode_head<float>(heads[h], h, g);
+            }
+        }
+        suppress(g);
+        return kept_;
+    }
+
+private:
+    template<typename T>
+    void decode_head(const head_tensor& t, size_t level, const geometry& g) {
+        const T* base = static_cast<const T*>(t.data);
+        size_t plane = size_t(t.grid_w) * t.grid_h;
+        size_t depth = 5 + size_t(opt_.classes);
+        float scale = std::is_same<T, float>::value ? 1.0f : t.scale;
+        int32_t zp = std::is_same<T, float>::value ? 0 : t.zero_point;
+        auto real = [&](T q) { return (float(q) - float(zp)) * scale; };
+
+        // Objectness threshold in the tensor's own domain.
+        using cmp_t = std::conditional_t<std::is_same<T, float>::value, float, int32_t>;
+        cmp_t threshold;
+        if constexpr (std::is_same<T, float>::value) {
+            threshold = logit_;
+        } else {
+            float q = scale > 0 ? std::floor(logit_ / scale + float(zp)) : 127.0f;
+            threshold = static_cast<int32_t>(std::clamp(q, -129.0f, 127.0f));
+        }
+
+        float stride = float(opt_.strides[level]);
+        for (size_t a = 0; a < 3; ++a) {
+            const T* p = base + a * depth * plane;
+            detail::scan_above(p + 4 * plane, plane, threshold, [&](size_t i) {
+                if (candidates_.size() >= opt_.max_candidates) return;
+                const T* cls = p + 5 * plane + i;
+                uint32_t best = 0;
+                T top = cls[0];
+                for (uint32_t c = 1; c < opt_.classes; ++c) {
+                    T v = cls[c * plane];
+                    if (v > top) top = v, best = c;
+                }
+                if (!keep_[best]) return;
+                float score = detail::sigmoid(real(p[4 * plane + i])) * detail::sigmoid(real(top));
+                if (score < opt_.score_threshold) return;
+
+                float gx = float(i % t.grid_w), gy = float(i / t.grid_w);
+                float cx = (detail::sigmoid(real(p[i])) * 2.0f - 0.5f + gx) * stride;
+                float cy = (detail::sigmoid(real(p[plane + i])) * 2.0f - 0.5f + gy) * stride;
+                float w = real(p[2 * plane + i]), h = real(p[3 * plane + i]);
+                if (opt_.sigmoid_wh) w = detail::sigmoid(w), h = detail::sigmoid(h);
+                w *= 2.0f;
+                h *= 2.0f;
+                w = w * w * opt_.anchors[level][a][0];
+                h = h * h * opt_.anchors[level][a][1];
+
+                float sw = float(g.source_width), sh = float(g.source_height);
+                detection d;
+                d.x1 = std::clamp(g.to_source_x(cx - 0.5f * w), 0.0f, sw);
+                d.y1 = std::clamp(g.to_source_y(cy - 0.5f * h), 0.0f, sh);
+                d.x2 = std::clamp(g.to_source_x(cx + 0.5f * w), 0.0f, sw);
+                d.y2 = std::clamp(g.to_source_y(cy + 0.5f * h), 0.0f, sh);
+                float bw = d.x2 - d.x1, bh = d.y2 - d.y1;
+                if (bw < opt_.min_size || bh < opt_.min_size) return;
+                if (int32_t(best) == opt_.aspect_class && (bw > opt_.max_aspect * bh || bw < opt_.min_aspect * bh)) return;
+                d.score    = score;
+                d.class_id = best;
+                candidates_.push_back(d);
+            });
+        }
+    }
+
+    void suppress(const geometry& g) {
+        kept_.clear();
+        if (candidates_.empty()) return;
+
+        // Counting sort into score bins, best first.
+        constexpr size_t bins = 1024;
+        float lo = opt_.score_threshold, span = std::max(1.0f - lo, 1e-6f);
+        auto bin_of = [&](float s) {
+            size_t b = static_cast<size_t>((s - lo) / span * float(bins - 1));
+            return bins - 1 - std::min(b, bins - 1);
+        };
+        counts_.assign(bins + 1, 0);
+        for (const detection& d : candidates_) ++counts_[bin_of(d.score) + 1];
+        for (size_t b = 1; b <= bins; ++b) counts_[b] += counts_[b - 1];
+        order_.resize(candidates_.size());
+        for (uint32_t i = 0; i < candidates_.size(); ++i) order_[counts_[bin_of(candidates_[i].score)]++] = i;
+
+        // Kept boxes are registered in every cell they cover, so any two
+        // overlapping boxes share a cell.
+        uint32_t side = std::max<uint32_t>(std::max(g.source_width, g.source_height) / grid, 1);
+        size_t gw = g.source_width / side + 1, gh = g.source_height / side + 1;
+        if (cells_.size() < gw * gh) cells_.resize(gw * gh);
+        for (size_t c = 0; c < gw * gh; ++c) cells_[c].clear();
+        auto cover = [&](const detection& d, auto&& fn) {
+            size_t cx0 = std::min<size_t>(size_t(d.x1) / side, gw - 1), cx1 = std::min<size_t>(size_t(d.x2) / side, gw - 1);
+            size_t cy0 = std::min<size_t>(size_t(d.y1) / side, gh - 1), cy1 = std::min<size_t>(size_t(d.y2) / side, gh - 1);
+            for (size_t cy = cy0; cy <= cy1; ++cy) {
+                for (size_t cx = cx0; cx <= cx1; ++cx) {
+                    if (!fn(cells_[cy * gw + cx])) return;
+                }
+            }
+        };
+
+        for (uint32_t i : order_) {
+            const detection& d = candidates_[i];
+            bool suppressed = false;
+            cover(d, [&](const std::vector<uint32_t>& cell) {
+                for (uint32_t k : cell) {
+                    const detection& o = kept_[k];
+                    if (o.class_id == d.class_id && detail::iou(o, d) > opt_.nms_threshold) {
+                        suppressed = true;
+                        return false;
+                    }
+                }
+                return true;
+            });
+            if (suppressed) continue;
+            uint32_t k = static_cast<uint32_t>(kept_.size());
+            kept_.push_back(d);
+            cover(d, [&](std::vector<uint32_t>& cell) {
+                cell.push_back(k);
+                return true;
+            });
+        }
+    }
+
+    static constexpr uint32_t grid = 16;    // NMS cells along the longer side
+
+    yolo_options                        opt_;
+    float                               logit_ = 0.0f;
+    std::vector<uint8_t>                keep_;
+    std::vector<detection>              candidates_;
+    std::vector<detection>              kept_;
+    std::vector<uint32_t>               counts_;
+    std::vector<uint32_t>               order_;
+    std::vector<std::vector<uint32_t>>  cells_;
+};
+
+};
@@ -0,0 +1,292 @@
+// Runs infer::engine on a small synthetic RBNN graph and compares its heads
+// with a float reference of the same graph, then feeds the parser corrupt
+// files. Exit status is the number of failed checks.
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "infer/cpu.h"
+
+namespace {
+
+int failures = 0;
+
+void expect(bool ok, const char* what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+// Writes an RBNN file and keeps a float copy of every node for reference().
+// Conv weights are quantized per output channel exactly as the file stores
+// them, so the reference differs from the engine only by activation
+// quantization.
+class graph {
+public:
+    struct layer {
+        infer::op               kind;
+        infer::activation       act;
+        std::vector<uint32_t>   in;
+        uint32_t                out, k, stride, pad;
+        std::vector<float>      weight, bias;   // [cout][k][k][cin]
+    };
+
+    uint32_t tensor(uint32_t h, uint32_t w, uint32_t c) {
+        shapes.push_back({h, w, c});
+        return static_cast<uint32_t>(shapes.size() - 1);
+    }
+
+    uint32_t conv(uint32_t in, uint32_t cout, uint32_t k, uint32_t stride, infer::activation act = infer::activation::silu) {
+        infer::shape s = shapes[in];
+        uint32_t pad = k / 2;
+        uint32_t out = tensor((s.h + 2 * pad - k) / stride + 1, (s.w + 2 * pad - k) / stride + 1, cout);
+        layer l{infer::op::conv, act, {in}, out, k, stride, pad, {}, {}};
+        size_t fan = size_t(k) * k * s.c;
+        std::normal_distribution<float> init(0.0f, 1.0f / std::sqrt(float(fan)));
+        l.weight.resize(cout * fan);
+        l.bias.resize(cout);
+        for (float& v : l.weight) v = init(rng_);
+        for (float& v : l.bias) v = init(rng_);
+        std::vector<float> scale(cout);
+        std::vector<int8_t> q(l.weight.size());
+        for (uint32_t co = 0; co < cout; ++co) {
+            float m = 0.0f;
+            for (size_t j = 0; j < fan; ++j) m = std::max(m, std::fabs(l.weight[co * fan + j]));
+            scale[co] = m / 127.0f;
+            for (size_t j = 0; j < fan; ++j) {
+                q[co * fan + j] = static_cast<int8_t>(std::lround(l.weight[co * fan + j] / scale[co]));
+                l.weight[co * fan + j] = q[co * fan + j] * scale[co];
+            }
+        }
+        header(l);
+        put(k), put(stride), put(pad);
+        for (float v : scale) putf(v);
+        for (float v : l.bias) putf(v);
+        body_.insert(body_.end(), q.begin(), q.end());
+        layers.push_back(std::move(l));
+        return out;
+    }
+
+    uint32_t add(uint32_t a, uint32_t b) {
+        infer::shape s = shapes[a];
+        return simple({infer::op::add, infer::activation::none, {a, b}, tensor(s.h, s.w, s.c), 1, 1, 0, {}, {}});
+    }
+
+    uint32_t concat(uint32_t a, uint32_t b) {
+        infer::shape s = shapes[a];
+        return simple({infer::op::concat, infer::activation::none, {a, b}, tensor(s.h, s.w, s.c + shapes[b].c), 1, 1, 0, {}, {}});
+    }
+
+    uint32_t upsample(uint32_t a) {
+        infer::shape s = shapes[a];
+        return simple({infer::op::upsample, infer::activation::none, {a}, tensor(s.h * 2, s.w * 2, s.c), 1, 1, 0, {}, {}});
+    }
+
+    uint32_t maxpool(uint32_t a) {
+        infer::shape s = shapes[a];
+        layer l{infer::op::maxpool, infer::activation::none, {a}, tensor(s.h, s.w, s.c), 5, 1, 2, {}, {}};
+        header(l);
+        put(l.k), put(l.stride), put(l.pad);
+        layers.push_back(std::move(l));
+        return layers.back().out;
+    }
+
+    std::vector<uint8_t> file(const std::vector<uint32_t>& outputs) const {
+        std::vector<uint8_t> f = {'R', 'B', 'N', 'N'};
+        auto u32 = [&](uint32_t v) { for (int i = 0; i < 4; ++i) f.push_back(uint8_t(v >> (8 * i))); };
+        u32(1);
+        u32(static_cast<uint32_t>(shapes.size()));
+        for (const infer::shape& s : shapes) u32(s.h), u32(s.w), u32(s.c);
+        u32(static_cast<uint32_t>(layers.size()));
+        f.insert(f.end(), body_.begin(), body_.end());
+        u32(static_cast<uint32_t>(outputs.size()));
+        for (uint32_t t : outputs) u32(t);
+        return f;
+    }
+
+    // Float NHWC activations of every tensor.
+    std::vector<std::vector<float>> reference(const std::vector<float>& input) const {
+        std::vector<std::vector<float>> v(shapes.size());
+        v[0] = input;
+        for (const layer& l : layers) {
+            const infer::shape& is = shapes[l.in[0]];
+            const infer::shape& os = shapes[l.out];
+            const std::vector<float>& a = v[l.in[0]];
+            std::vector<float>& o = v[l.out];
+            o.assign(os.size(), 0.0f);
+            for (uint32_t y = 0; y < os.h; ++y) {
+                for (uint32_t x = 0; x < os.w; ++x) {
+                    float* px = o.data() + (size_t(y) * os.w + x) * os.c;
+                    switch (l.kind) {
+                    case infer::op::conv:
+                        for (uint32_t co = 0; co < os.c; ++co) {
+                            float sum = l.bias[co];
+                            for (uint32_t ky = 0; ky < l.k; ++ky) {
+                                for (uint32_t kx = 0; kx < l.k; ++kx) {
+                                    int iy = int(y * l.stride + ky) - int(l.pad), ix = int(x * l.stride + kx) - int(l.pad);
+                                    if (iy < 0 || ix < 0 || iy >= int(is.h) || ix >= int(is.w)) continue;
+                                    const float* w = l.weight.data() + ((size_t(co) * l.k + ky) * l.k + kx) * is.c;
+                                    const float* p = a.data() + (size_t(iy) * is.w + ix) * is.c;
+                                    for (uint32_t c = 0; c < is.c; ++c) sum += w[c] * p[c];
+                                }
+                            }
+                            px[co] = l.act == infer::activation::silu ? sum / (1.0f + std::exp(-sum)) : sum;
+                        }
+                        break;
+                    case infer::op::add:
+                        for (uint32_t c = 0; c < os.c; ++c) px[c] = a[(size_t(y) * os.w + x) * os.c + c] + v[l.in[1]][(size_t(y) * os.w + x) * os.c + c];
+                        break;
+                    case infer::op::concat: {
+                        const infer::shape& bs = shapes[l.in[1]];
+                        for (uint32_t c = 0; c < is.c; ++c) px[c] = a[(size_t(y) * os.w + x) * is.c + c];
+                        for (uint32_t c = 0; c < bs.c; ++c) px[is.c + c] = v[l.in[1]][(size_t(y) * os.w + x) * bs.c + c];
+                        break;
+                    }
+                    case infer::op::upsample:
+                        for (uint32_t c = 0; c < os.c; ++c) px[c] = a[(size_t(y / 2) * is.w + x / 2) * is.c + c];
+                        break;
+                    case infer::op::maxpool:
+                        for (uint32_t c = 0; c < os.c; ++c) {
+                            float m = -INFINITY;
+                            for (int dy = -2; dy <= 2; ++dy) {
+                                for (int dx = -2; dx <= 2; ++dx) {
+                                    int iy = int(y) + dy, ix = int(x) + dx;
+                                    if (iy < 0 || ix < 0 || iy >= int(is.h) || ix >= int(is.w)) continue;
+                                    m = std::max(m, a[(size_t(iy) * is.w + ix) * is.c + c]);
+                                }
+                            }
+                            px[c] = m;
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+        return v;
+    }
+
+    std::vector<infer::shape>   shapes;
+    std::vector<layer>          layers;
+
+private:
+    uint32_t simple(layer l) {
+        header(l);
+        layers.push_back(std::move(l));
+        return layers.back().out;
+    }
+
+    void header(const layer& l) {
+        body_.push_back(uint8_t(l.kind));
+        body_.push_back(uint8_t(l.act));
+        body_.push_back(0);
+        body_.push_back(0);
+        put(static_cast<uint32_t>(l.in.size()));
+        for (uint32_t t : l.in) put(t);
+        put(l.out);
+    }
+
+    void put(uint32_t v) { for (int i = 0; i < 4; ++i) body_.push_back(uint8_t(v >> (8 * i))); }
+    void putf(float f) { uint32_t v; std::memcpy(&v, &f, 4); put(v); }
+
+    std::vector<uint8_t>    body_;
+    std::mt19937            rng_{7};
+};
+
+// A miniature YOLOv5: stem, residual block, SPPF-style pooling, an FPN
+// upsample and two 255-channel detection heads.
+graph detector(std::vector<uint32_t>& heads) {
+    graph g;
+    uint32_t x  = g.tensor(64, 64, 3);
+    uint32_t s0 = g.conv(x, 16, 3, 2);                                          // 32x32
+    uint32_t s1 = g.conv(s0, 32, 3, 2);                                         // 16x16
+    uint32_t r  = g.add(s1, g.conv(g.conv(s1, 16, 1, 1), 32, 3, 1));
+    uint32_t s2 = g.conv(r, 32, 3, 2);                                          // 8x8
+    uint32_t sp = g.concat(s2, g.maxpool(g.maxpool(s2)));
+    uint32_t p4 = g.conv(g.concat(g.upsample(g.conv(sp, 32, 1, 1)), r), 32, 3, 1);
+    heads = {g.conv(p4, 255, 1, 1, infer::activation::none), g.conv(sp, 255, 1, 1, infer::activation::none)};
+    return g;
+}
+
+void matches_float_reference() {
+    std::vector<uint32_t> heads;
+    graph g = detector(heads);
+    std::vector<uint8_t> f = g.file(heads);
+    infer::model m;
+    expect(m.parse(f.data(), f.size()), "synthetic model parses");
+    if (failures) return;
+
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    std::vector<float> input(g.shapes[0].size());
+    for (float& v : input) v = u(rng);
+    auto want = g.reference(input);
+
+    dispatch::pool_options po;
+    po.workers = 2;
+    dispatch::dispatch pool(po);
+    for (dispatch::dispatch* p : {static_cast<dispatch::dispatch*>(nullptr), &pool}) {
+        infer::engine e(m, p);
+        std::copy(input.begin(), input.end(), e.input());
+        e.run();
+        expect(e.outputs() == heads.size(), "one engine output per head");
+        for (size_t i = 0; i < heads.size(); ++i) {
+            const infer::shape& s = g.shapes[heads[i]];
+            vision::head_tensor h = e.output(i);
+            expect(h.channels == s.c && h.grid_w == s.w && h.grid_h == s.h, "head shape");
+            // Output is NCHW, the reference NHWC.
+            const float* got = static_cast<const float*>(h.data);
+            double err = 0, norm = 0;
+            for (size_t px = 0; px < s.pixels(); ++px) {
+                for (uint32_t c = 0; c < s.c; ++c) {
+                    double ref = want[heads[i]][px * s.c + c];
+                    double d = got[c * s.pixels() + px] - ref;
+                    err += d * d;
+                    norm += ref * ref;
+                }
+            }
+            double rel = std::sqrt(err / norm);
+            std::printf("head %zu %ux%ux%u relative error %.4f%s\n", i, s.c, s.h, s.w, rel, p ? " (pool)" : "");
+            expect(rel < 0.02, "head within 2% of the float reference");
+        }
+    }
+}
+
+void rejects_corrupt_files() {
+    std::vector<uint32_t> heads;
+    graph g = detector(heads);
+    std::vector<uint8_t> f = g.file(heads);
+    infer::model m;
+
+    bool truncated = false;
+    for (size_t cut = 0; cut < f.size(); cut += 61) truncated |= m.parse(f.data(), cut);
+    expect(!truncated, "truncated files are rejected");
+
+    // Tensor 1's height claims 2^31 rows.
+    std::vector<uint8_t> tall = f;
+    tall[12 + 12 + 3] = 0x80;
+    expect(!m.parse(tall.data(), tall.size()), "oversized tensor is rejected");
+
+    // A conv declaring 4096 output channels with no weights behind it must
+    // fail on the size check, not allocate.
+    graph big;
+    uint32_t in = big.tensor(8, 8, 16), out = big.tensor(8, 8, 4096);
+    std::vector<uint8_t> b = big.file({out});
+    b.resize(b.size() - 8);     // drop the outputs section
+    const uint8_t node[] = {0, 1, 0, 0, 1, 0, 0, 0, uint8_t(in), 0, 0, 0, uint8_t(out), 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0};
+    b[b.size() - 4] = 1;        // node count
+    b.insert(b.end(), node, node + sizeof(node));
+    expect(!m.parse(b.data(), b.size()), "conv larger than the file is rejected");
+}
+
+};
+
+int main() {
+    matches_float_reference();
+    rejects_corrupt_files();
+    if (failures) std::fprintf(stderr, "%d check(s) failed\n", failures);
+    return failures;
+}